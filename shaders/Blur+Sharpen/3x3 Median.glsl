@@ -1,7 +1,7 @@
 // SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
 // SPDX-License-Identifier: MIT
 
-// @gips_version=1 @coord=none @filter=off
+// @gips_version=1 @coord=none @filter=off @channels=keep
 
 vec3 med3rgb(vec3 a, vec3 b, vec3 c) {
     return max(min(a, b), min(max(a, b), c));
@@ -1,7 +1,7 @@
 // SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
 // SPDX-License-Identifier: MIT
 
-// @gips_version=1 @coord=pixel @filter=off
+// @gips_version=1 @coord=pixel @filter=off @channels=keep
 
 uniform float size = 3.0;  // @min=1 @max=10 @int
 uniform float mixval;      // dilate<->erode
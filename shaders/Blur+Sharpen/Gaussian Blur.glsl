@@ -1,7 +1,7 @@
 // SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
 // SPDX-License-Identifier: MIT
 
-// @gips_version=1 @coord=pixel @filter=off
+// @gips_version=1 @coord=pixel @filter=off @channels=keep
 
 // not a "true" Gaussian blur -- using a cheap (finite) approximation
 
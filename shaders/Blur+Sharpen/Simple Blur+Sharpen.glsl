@@ -1,9 +1,9 @@
 // SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
 // SPDX-License-Identifier: MIT
 
-// @gips_version=1 @coord=none @filter=off
+// @gips_version=1 @coord=none @filter=off @channels=keep
 
-uniform float blurriness;       // @min=-5 @max=1
+uniform float blurriness;       // @min=-5 @max=1 @identity=0
 uniform float threshold = 1.0;  // @digits=3
 uniform float clip;             // @switch avoid ringing when sharpening
 
@@ -0,0 +1,13 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+// @gips_version=1 @channels=2
+
+uniform vec3 downmix = vec3(.299, .587, .114);  // @min=-1 @max=2 RGB weights
+uniform float normWeights = 1.0;                // @switch normalize weights
+
+vec3 run(vec3 rgb) {
+    vec3 w = downmix;
+    if (normWeights > 0.5) { w /= w.x + w.y + w.z; }
+    return vec3(dot(rgb, w));
+}
@@ -3,9 +3,9 @@
 
 // @gips_version=1 @coord=rel
 
-uniform float strength;          // @min=-5 @max=5 @digits=2 linear strength
+uniform float strength;          // @min=-5 @max=5 @digits=2 @identity=0 linear strength
 uniform float frequency = 20.0;  // @min=1 @max=100 @digits=1
-uniform float amplitude;         // @max=1.5 @digits=3
+uniform float amplitude;         // @max=1.5 @digits=3 @identity=0
 uniform float phase;             // @angle
 uniform vec2  center;            // @min=-2 @max=2
 
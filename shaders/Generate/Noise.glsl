@@ -3,7 +3,7 @@
 
 // @gips_version=1
 
-uniform float strength;        // @max=5 strength (logarithmic)
+uniform float strength;        // @max=5 @identity=0 strength (logarithmic)
 uniform float gaussian = 1.0;  // @switch Gaussian luma noise instead of uniform RGB noise
 
 vec4 run(vec4 color) {
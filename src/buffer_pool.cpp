@@ -0,0 +1,263 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+    #include <unistd.h>
+#endif
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <mutex>
+
+#include "buffer_pool.h"
+
+namespace BufferPool {
+
+///////////////////////////////////////////////////////////////////////////////
+
+constexpr size_t MinPooledSize = size_t(1) << 20;
+constexpr size_t HugePageSize = size_t(2) << 20;
+constexpr size_t DefaultIdleLimit = size_t(1) << 30;
+
+struct LiveBuffer {
+    size_t capacity;
+    int usageClass;
+};
+
+struct IdleBuffer {
+    void* ptr;
+    size_t capacity;
+    uint64_t lastUse;
+};
+
+static std::mutex poolLock;
+static std::unordered_map<void*, LiveBuffer> liveBuffers;
+static std::vector<IdleBuffer> idleBuffers;
+static size_t idleLimit = DefaultIdleLimit;
+static bool useHugePages = false;
+static uint64_t useClock = 0;
+static Stats stats;
+
+//! round up to one of four size classes per power of two
+static size_t getSizeClass(size_t size) {
+    size_t pow2 = MinPooledSize;
+    while ((pow2 << 1) <= size) { pow2 <<= 1; }
+    size_t step = pow2 >> 2;
+    return (size + step - 1) / step * step;
+}
+
+//! account for a live buffer entering or leaving a usage class;
+//! poolLock must be held
+static void addLive(int usageClass, size_t capacity) {
+    stats.liveBytes += capacity;
+    stats.classBytes[usageClass] += capacity;
+    stats.peakLiveBytes = std::max(stats.peakLiveBytes, stats.liveBytes);
+    stats.classPeakBytes[usageClass] = std::max(stats.classPeakBytes[usageClass], stats.classBytes[usageClass]);
+}
+static void removeLive(int usageClass, size_t capacity) {
+    stats.liveBytes -= capacity;
+    stats.classBytes[usageClass] -= capacity;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+static void* osAlloc(size_t size, bool hugePages) {
+    #ifdef _WIN32
+        // large pages require the "lock pages in memory" privilege;
+        // if that's missing, the allocation simply fails
+        if (hugePages) {
+            size_t large = GetLargePageMinimum();
+            if (large && !(size % large)) {
+                void* p = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+                if (p) { return p; }
+            }
+        }
+        return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    #else
+        // transparent huge pages are only used for aligned ranges, so map
+        // a bit more and cut off the excess around an aligned range
+        size_t mapSize = hugePages ? (size + HugePageSize) : size;
+        void* p = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) { return nullptr; }
+        if (hugePages) {
+            uintptr_t start = reinterpret_cast<uintptr_t>(p);
+            uintptr_t aligned = (start + HugePageSize - 1) & ~uintptr_t(HugePageSize - 1);
+            if (aligned > start) { munmap(p, aligned - start); }
+            size_t tail = mapSize - (aligned - start) - size;
+            if (tail) { munmap(reinterpret_cast<void*>(aligned + size), tail); }
+            p = reinterpret_cast<void*>(aligned);
+            #ifdef MADV_HUGEPAGE
+                madvise(p, size, MADV_HUGEPAGE);
+            #endif
+        }
+        return p;
+    #endif
+}
+
+static void osFree(void* ptr, size_t size) {
+    #ifdef _WIN32
+        (void)size;
+        VirtualFree(ptr, 0, MEM_RELEASE);
+    #else
+        munmap(ptr, size);
+    #endif
+}
+
+//! free idle buffers (least recently used first) until 'needed' more
+//! bytes fit into the limit; poolLock must be held
+static void evictIdle(size_t needed) {
+    while (!idleBuffers.empty() && ((stats.idleBytes + needed) > idleLimit)) {
+        auto oldest = std::min_element(idleBuffers.begin(), idleBuffers.end(),
+            [] (const IdleBuffer& a, const IdleBuffer& b) { return a.lastUse < b.lastUse; });
+        osFree(oldest->ptr, oldest->capacity);
+        stats.idleBytes -= oldest->capacity;
+        idleBuffers.erase(oldest);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void* alloc(size_t size) {
+    if (size < MinPooledSize) { return malloc(size ? size : 1); }
+    size_t capacity = getSizeClass(size);
+    std::lock_guard<std::mutex> lock(poolLock);
+    ++stats.allocs;
+
+    // reuse the most recently released buffer of the same size class,
+    // as that's the one most likely to be still in the caches
+    void* ptr = nullptr;
+    auto best = idleBuffers.end();
+    for (auto it = idleBuffers.begin();  it != idleBuffers.end();  ++it) {
+        if ((it->capacity == capacity) && ((best == idleBuffers.end()) || (it->lastUse > best->lastUse))) { best = it; }
+    }
+    if (best != idleBuffers.end()) {
+        ptr = best->ptr;
+        stats.idleBytes -= capacity;
+        idleBuffers.erase(best);
+        ++stats.reuses;
+    } else {
+        ptr = osAlloc(capacity, useHugePages && (capacity >= HugePageSize));
+        if (!ptr) {
+            // maybe the idle buffers are in the way
+            evictIdle(idleLimit);
+            ptr = osAlloc(capacity, false);
+            if (!ptr) { return nullptr; }
+        }
+        ++stats.osAllocs;
+        #ifndef NDEBUG
+            fprintf(stderr, "buffer pool: allocated new %llu-byte buffer\n", static_cast<unsigned long long>(capacity));
+        #endif
+    }
+    LiveBuffer& live = liveBuffers[ptr];
+    live.capacity = capacity;
+    live.usageClass = 0;
+    addLive(0, capacity);
+    return ptr;
+}
+
+void release(void* ptr) {
+    if (!ptr) { return; }
+    std::lock_guard<std::mutex> lock(poolLock);
+    auto live = liveBuffers.find(ptr);
+    if (live == liveBuffers.end()) { ::free(ptr); return; }
+    size_t capacity = live->second.capacity;
+    removeLive(live->second.usageClass, capacity);
+    liveBuffers.erase(live);
+    if (capacity > idleLimit) { osFree(ptr, capacity); return; }
+    evictIdle(capacity);
+    IdleBuffer idle;
+    idle.ptr = ptr;
+    idle.capacity = capacity;
+    idle.lastUse = ++useClock;
+    idleBuffers.push_back(idle);
+    stats.idleBytes += capacity;
+}
+
+void* resize(void* ptr, size_t size) {
+    if (!ptr) { return alloc(size); }
+    size_t capacity = 0;
+    int usageClass = 0;
+    {
+        std::lock_guard<std::mutex> lock(poolLock);
+        auto live = liveBuffers.find(ptr);
+        if (live != liveBuffers.end()) { capacity = live->second.capacity;  usageClass = live->second.usageClass; }
+    }
+    if (!capacity) {
+        // not a pooled buffer (typically a small, growing one) -> keep it that way
+        return realloc(ptr, size ? size : 1);
+    }
+    if (size <= capacity) { return ptr; }
+    void* newPtr = alloc(size);
+    if (!newPtr) { return nullptr; }
+    memcpy(newPtr, ptr, capacity);
+    release(ptr);
+    if (usageClass) { setUsageClass(newPtr, usageClass); }
+    return newPtr;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void setIdleLimit(size_t bytes) {
+    std::lock_guard<std::mutex> lock(poolLock);
+    idleLimit = bytes;
+    evictIdle(0);
+}
+
+void setHugePages(bool enable) {
+    std::lock_guard<std::mutex> lock(poolLock);
+    useHugePages = enable;
+}
+
+void trim() {
+    std::lock_guard<std::mutex> lock(poolLock);
+    for (const auto& idle : idleBuffers) {
+        osFree(idle.ptr, idle.capacity);
+    }
+    idleBuffers.clear();
+    stats.idleBytes = 0;
+}
+
+void setUsageClass(void* ptr, int usageClass) {
+    if (!ptr || (usageClass < 0) || (usageClass >= MaxUsageClasses)) { return; }
+    std::lock_guard<std::mutex> lock(poolLock);
+    auto live = liveBuffers.find(ptr);
+    if (live == liveBuffers.end()) { return; }
+    removeLive(live->second.usageClass, live->second.capacity);
+    live->second.usageClass = usageClass;
+    addLive(usageClass, live->second.capacity);
+}
+
+void resetPeaks() {
+    std::lock_guard<std::mutex> lock(poolLock);
+    stats.peakLiveBytes = stats.liveBytes;
+    for (int i = 0;  i < MaxUsageClasses;  ++i) {
+        stats.classPeakBytes[i] = stats.classBytes[i];
+    }
+}
+
+Stats getStats() {
+    std::lock_guard<std::mutex> lock(poolLock);
+    Stats s = stats;
+    s.idleLimit = idleLimit;
+    s.liveBuffers = int(liveBuffers.size());
+    s.idleBuffers = int(idleBuffers.size());
+    return s;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+}  // namespace BufferPool
+
+void* BufferPool_alloc(size_t size)               { return BufferPool::alloc(size); }
+void* BufferPool_resize(void* ptr, size_t size)   { return BufferPool::resize(ptr, size); }
+void  BufferPool_release(void* ptr)               { BufferPool::release(ptr); }
@@ -0,0 +1,82 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+// Process-wide pool for large host memory buffers (image data). Freeing a
+// full-size image and allocating the next one would otherwise go through
+// the system allocator each time, returning the memory to the OS and
+// page-faulting it in again on first touch. Instead, large buffers are
+// rounded up to size classes (four per power of two) and kept around when
+// they're released, up to a configurable total, so repeated operations on
+// images of the same size run without any allocations or page faults.
+// Small buffers are passed through to malloc().
+
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+
+#include <cstdint>
+
+namespace BufferPool {
+
+///////////////////////////////////////////////////////////////////////////////
+
+//! allocate a buffer (uninitialized)
+//! \returns nullptr on failure
+void* alloc(size_t size);
+
+//! return a buffer; this accepts anything obtained from alloc(), resize(),
+//! malloc() or realloc(), so buffers from any source can be released with it
+void release(void* ptr);
+
+//! realloc() equivalent
+void* resize(void* ptr, size_t size);
+
+//! set the maximum total size of idle buffers kept for reuse
+void setIdleLimit(size_t bytes);
+
+//! back (newly allocated) buffers with huge pages, if the OS supports it
+void setHugePages(bool enable);
+
+//! give all idle buffers back to the OS
+void trim();
+
+//! buffers can be assigned to one of a few usage classes, so that their
+//! sizes can be accounted separately; new buffers start in class 0
+constexpr int MaxUsageClasses = 4;
+//! move a buffer into another usage class (ignored for small buffers)
+void setUsageClass(void* ptr, int usageClass);
+//! restart peak tracking at the current usage
+void resetPeaks();
+
+struct Stats {
+    uint64_t allocs    = 0;  //!< pooled allocations
+    uint64_t reuses    = 0;  //!< ... that were served by an idle buffer
+    uint64_t osAllocs  = 0;  //!< ... that needed new memory from the OS
+    size_t liveBytes   = 0;  //!< size of pooled buffers currently in use
+    size_t idleBytes   = 0;  //!< size of buffers kept for reuse
+    size_t idleLimit   = 0;
+    size_t peakLiveBytes = 0;  //!< maximum of liveBytes
+    size_t classBytes[MaxUsageClasses]     = {};  //!< liveBytes per usage class
+    size_t classPeakBytes[MaxUsageClasses] = {};  //!< maximum of classBytes
+    int liveBuffers    = 0;
+    int idleBuffers    = 0;
+};
+Stats getStats();
+
+///////////////////////////////////////////////////////////////////////////////
+
+}  // namespace BufferPool
+
+extern "C" {
+#endif
+
+// C interface for third-party libraries (stb_image etc.)
+void* BufferPool_alloc(size_t size);
+void* BufferPool_resize(void* ptr, size_t size);
+void BufferPool_release(void* ptr);
+
+#ifdef __cplusplus
+}
+#endif
@@ -20,8 +20,8 @@ bool isAvailable();
 char* getString();
 
 //! return the clipboard as a 32-bit (8-bit per channel) RGBA image
-//! \returns pointer to the image, malloc()'d internally,
-//!          to be free()'d by the caller; or nullptr on failure
+//! \returns pointer to the image, allocated from the buffer pool, to be
+//!          freed by the caller with BufferPool::release(); or nullptr on failure
 //! \note the values returned in width and height are undefined on error
 void* getRGBA8Image(int &width, int &height);
 
@@ -18,6 +18,7 @@
 #include <GLFW/glfw3native.h>
 
 #include "stb_image.h"
+#include "buffer_pool.h"
 
 #include "string_util.h"
 
@@ -122,7 +123,7 @@ void* getRGBA8Image(int &width, int &height) {
     // is this image in a format we can handle directly?
     if (headerOK) {
         dibData += bmih->biSize;
-        void *decoded = malloc(width * height * 4);
+        void *decoded = BufferPool::alloc(width * height * 4);
         if (decoded) {
             uint8_t maxAlpha = (bpp > 3) ? 0 : 255;
             int lineSkip = stride - width * bpp;
@@ -164,7 +165,7 @@ void* getRGBA8Image(int &width, int &height) {
 
     // last-ditch effort: add a BITMAPFILEHEADER and let stb_image have a stab at it
     int fullSize = dibSize + sizeof(BITMAPFILEHEADER);
-    uint8_t* fullDIB = (uint8_t*) malloc(fullSize);
+    uint8_t* fullDIB = (uint8_t*) BufferPool::alloc(fullSize);
     if (!fullDIB) { GlobalUnlock(hDIB); CloseClipboard(); return nullptr; }
     fullDIB[0] = 'B';
     fullDIB[1] = 'M';
@@ -183,7 +184,7 @@ void* getRGBA8Image(int &width, int &height) {
         fprintf(stderr, "trying to decode clipboard DIB via stb_image\n");
     #endif
     void* result = stbi_load_from_memory(fullDIB, fullSize, &width, &height, nullptr, 4);
-    ::free(fullDIB);
+    BufferPool::release(fullDIB);
     return result;
 }
 
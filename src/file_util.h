@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
 namespace FileUtil {
@@ -51,6 +52,8 @@ public:
     inline FileFingerprint() {}
     inline explicit FileFingerprint(const char* path) { update(path); }
     inline bool good() const { return m_size || m_mtime; }
+    inline uint64_t size()  const { return m_size; }
+    inline uint64_t mtime() const { return m_mtime; }
     inline bool operator== (const FileFingerprint& other) const
         { return m_size && m_mtime && (m_size == other.m_size) && (m_mtime == other.m_mtime); }
     inline bool newerThan(const FileFingerprint& other) const
@@ -62,4 +65,29 @@ public:
 
 ///////////////////////////////////////////////////////////////////////////////
 
+//! a file mapped into memory in its entirety
+class MappedFile {
+    void* m_data = nullptr;
+    size_t m_size = 0;
+public:
+    //! map an existing file for reading
+    bool open(const char* path);
+    //! create (or truncate) a file of the given size and map it for writing
+    bool create(const char* path, size_t size);
+    inline bool good() const { return (m_data != nullptr); }
+    //! unmap and close the file; data written into a created mapping is
+    //! flushed to disk by the operating system
+    void close();
+
+    inline       void* data()       { return m_data; }
+    inline const void* data() const { return m_data; }
+    inline size_t      size() const { return m_size; }
+
+    inline MappedFile() {}
+    MappedFile(const MappedFile&) = delete;
+    inline ~MappedFile() { close(); }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
 }  // namespace FileUtil
@@ -5,6 +5,8 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <errno.h>
 #include <unistd.h>
 #include <dirent.h>
@@ -102,4 +104,46 @@ bool FileFingerprint::update(const char* path) {
 
 ///////////////////////////////////////////////////////////////////////////////
 
+bool MappedFile::open(const char* path) {
+    close();
+    if (!path || !path[0]) { return false; }
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) { return false; }
+    struct stat st;
+    if (!fstat(fd, &st) && (st.st_size > 0)) {
+        void* data = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        if (data != MAP_FAILED) {
+            madvise(data, size_t(st.st_size), MADV_SEQUENTIAL);
+            m_data = data;
+            m_size = size_t(st.st_size);
+        }
+    }
+    ::close(fd);  // the mapping stays valid without the descriptor
+    return good();
+}
+
+bool MappedFile::create(const char* path, size_t size) {
+    close();
+    if (!path || !path[0] || !size) { return false; }
+    int fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) { return false; }
+    if (!ftruncate(fd, off_t(size))) {
+        void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (data != MAP_FAILED) {
+            m_data = data;
+            m_size = size;
+        }
+    }
+    ::close(fd);
+    return good();
+}
+
+void MappedFile::close() {
+    if (m_data) { munmap(m_data, m_size); }
+    m_data = nullptr;
+    m_size = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
 }  // namespace FileUtil
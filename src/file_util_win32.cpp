@@ -104,4 +104,48 @@ bool FileFingerprint::update(const char* path) {
 
 ///////////////////////////////////////////////////////////////////////////////
 
+bool MappedFile::open(const char* path) {
+    close();
+    if (!path || !path[0]) { return false; }
+    HANDLE hFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ,
+        nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE) { return false; }
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(hFile, &size) && (size.QuadPart > 0)) {
+        HANDLE hMap = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (hMap) {
+            m_data = MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
+            if (m_data) { m_size = size_t(size.QuadPart); }
+            CloseHandle(hMap);  // the view keeps the mapping alive
+        }
+    }
+    CloseHandle(hFile);
+    return good();
+}
+
+bool MappedFile::create(const char* path, size_t size) {
+    close();
+    if (!path || !path[0] || !size) { return false; }
+    HANDLE hFile = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0,
+        nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE) { return false; }
+    uint64_t size64 = uint64_t(size);
+    HANDLE hMap = CreateFileMappingA(hFile, nullptr, PAGE_READWRITE, DWORD(size64 >> 32), DWORD(size64), nullptr);
+    if (hMap) {
+        m_data = MapViewOfFile(hMap, FILE_MAP_WRITE, 0, 0, 0);
+        if (m_data) { m_size = size; }
+        CloseHandle(hMap);
+    }
+    CloseHandle(hFile);
+    return good();
+}
+
+void MappedFile::close() {
+    if (m_data) { UnmapViewOfFile(m_data); }
+    m_data = nullptr;
+    m_size = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
 }  // namespace FileUtil
@@ -12,7 +12,9 @@
 #include <cmath>
 #include <cassert>
 
+#include <vector>
 #include <algorithm>
+#include <atomic>
 
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
@@ -22,15 +24,17 @@
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
-#include "stb_image.h"
-#include "stb_image_write.h"
 #include "stb_image_resize.h"
 
 #include "sysinfo.h"
 #include "string_util.h"
 #include "file_util.h"
+#include "buffer_pool.h"
+#include "thread_pool.h"
 #include "vfs.h"
 #include "clipboard.h"
+#include "image_util.h"
+#include "jpeg_util.h"
 
 #include "patterns.h"
 
@@ -38,6 +42,9 @@
 extern "C" const char* git_rev;
 extern "C" const char* git_branch;
 
+#include "gips_context.h"
+#include "gips_memory.h"
+#include "gips_pnm.h"
 #include "gips_app.h"
 
 namespace GIPS {
@@ -59,13 +66,17 @@ bool App::isImageFile(uint32_t extCode) {
         || (extCode == StringUtil::makeExtCode("jpeg"))
         || (extCode == StringUtil::makeExtCode("jpe"))
         || (extCode == StringUtil::makeExtCode("png"))
+        || (extCode == StringUtil::makeExtCode("qoi"))
         || (extCode == StringUtil::makeExtCode("tga"))
         || (extCode == StringUtil::makeExtCode("bmp"))
         || (extCode == StringUtil::makeExtCode("psd"))
         || (extCode == StringUtil::makeExtCode("gif"))
         || (extCode == StringUtil::makeExtCode("pgm"))
         || (extCode == StringUtil::makeExtCode("ppm"))
-        || (extCode == StringUtil::makeExtCode("pnm"));
+        || (extCode == StringUtil::makeExtCode("pnm"))
+        || (extCode == StringUtil::makeExtCode("pam"))
+        || (extCode == StringUtil::makeExtCode("pfm"))
+        || (extCode == StringUtil::makeExtCode("raw"));
 }
 
 bool App::isSaveImageFile(uint32_t extCode) {
@@ -73,8 +84,14 @@ bool App::isSaveImageFile(uint32_t extCode) {
         || (extCode == StringUtil::makeExtCode("jpeg"))
         || (extCode == StringUtil::makeExtCode("jpe"))
         || (extCode == StringUtil::makeExtCode("png"))
+        || (extCode == StringUtil::makeExtCode("qoi"))
         || (extCode == StringUtil::makeExtCode("tga"))
-        || (extCode == StringUtil::makeExtCode("bmp"));
+        || (extCode == StringUtil::makeExtCode("bmp"))
+        || (extCode == StringUtil::makeExtCode("pgm"))
+        || (extCode == StringUtil::makeExtCode("ppm"))
+        || (extCode == StringUtil::makeExtCode("pnm"))
+        || (extCode == StringUtil::makeExtCode("pam"))
+        || (extCode == StringUtil::makeExtCode("pfm"));
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -93,6 +110,8 @@ int App::run(int argc, char *argv[]) {
     #endif
 
     setPaths(argv[0]);
+    ThreadPool::makeCurrent(&m_threadPool);
+    BufferPool::setHugePages(true);
 
     if (!glfwInit()) {
         const char* err = "unknown error";
@@ -181,13 +200,22 @@ int App::run(int argc, char *argv[]) {
         return 1;
     }
 
+    // both display programs can sRGB-encode the linear-light results
+    #define SRGB_ENCODE_FUNC \
+              "uniform bool gips_encode;" \
+        "\n" "vec4 encode(vec4 c) {" \
+        "\n" "  if (!gips_encode) { return c; }" \
+        "\n" "  vec3 l = clamp(c.rgb, 0.0, 1.0);" \
+        "\n" "  return vec4(mix(12.92 * l, 1.055 * pow(l, vec3(1.0 / 2.4)) - 0.055, step(0.0031308, l)), c.a);" \
+        "\n" "}"
     if (!m_renderDirect.init(m_pipeline.vs(), "direct rendering",
             "#version 330 core"
         "\n" "uniform sampler2D gips_tex;"
         "\n" "in vec2 gips_pos;"
         "\n" "out vec4 gips_frag;"
+        "\n" SRGB_ENCODE_FUNC
         "\n" "void main() {"
-        "\n" "  gips_frag = texture(gips_tex, gips_pos);"
+        "\n" "  gips_frag = encode(texture(gips_tex, gips_pos));"
         "\n" "}"
         "\n")) { return 1; }
     if (!m_renderWithAlpha.init(m_pipeline.vs(), "alpha-visualization rendering",
@@ -195,12 +223,14 @@ int App::run(int argc, char *argv[]) {
         "\n" "uniform sampler2D gips_tex;"
         "\n" "in vec2 gips_pos;"
         "\n" "out vec4 gips_frag;"
+        "\n" SRGB_ENCODE_FUNC
         "\n" "void main() {"
         "\n" "  vec2 cb = mod(floor(gl_FragCoord.xy * 0.125), 2.0);"
-        "\n" "  vec4 color = texture(gips_tex, gips_pos);"
+        "\n" "  vec4 color = encode(texture(gips_tex, gips_pos));"
         "\n" "  gips_frag = vec4(mix(vec3(0.5 + 0.25 * abs(cb.x - cb.y)), color.rgb, color.a), 1.0);"
         "\n" "}"
         "\n")) { return 1; }
+    #undef SRGB_ENCODE_FUNC
 
     GLint maxTex, maxVP[2];
     glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTex);
@@ -252,9 +282,38 @@ int App::run(int argc, char *argv[]) {
             requestFrames(1);
         }
 
-        // image processing
+        // precision analysis (before the normal rendering, which restores
+        // the pipeline's result in the selected format)
+        if (m_precisionRequested) {
+            runPrecisionAnalysis();
+        }
+
+        // image processing; if a time budget is set, the pipeline is
+        // rendered in bands across as many frames as necessary, and any
+        // change restarts it
         if (m_pipeline.changed()) {
-            m_pipeline.render(m_imgTex, m_imgWidth, m_imgHeight, m_requestedFormat, m_showIndex);
+            m_renderCancelled = false;
+            if (m_renderBudget_ms > 0.0f) {
+                m_pipeline.beginRender(m_imgTex, m_imgWidth, m_imgHeight, m_requestedFormat, m_showIndex);
+            } else {
+                m_pipeline.render(m_imgTex, m_imgWidth, m_imgHeight, m_requestedFormat, m_showIndex);
+            }
+        }
+        if (m_pipeline.renderInProgress() && !m_pipeline.continueRender(m_renderBudget_ms)) {
+            requestFrames(1);
+        }
+        if (m_showInspector) {
+            updateInspector();
+        }
+
+        // A/B comparison snapshot management
+        if (m_abSnapshotRequested) {
+            takeSnapshot();
+        } else if (m_abStale && (m_abMode != ABMode::Off)) {
+            renderSnapshot();
+        }
+        if (m_abMode == ABMode::Flicker) {
+            requestFrames(1);  // keep animating
         }
 
         // request to save?
@@ -276,15 +335,29 @@ int App::run(int argc, char *argv[]) {
         glClearColor(0.125f, 0.125f, 0.125f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
 
-        // draw the main image
+        // draw the main image; when zoomed out, it's sampled trilinearly
+        // from a mip pyramid that is only regenerated if the result changed
         updateImageGeometry();
         RenderProgram& renderer = m_showAlpha ? m_renderWithAlpha : m_renderDirect;
         if (renderer.prog.use()) {
-            glBindTexture(GL_TEXTURE_2D, m_pipeline.resultTex());
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            GLuint displayTex = m_pipeline.resultTex();
+            bool minify = (m_imgZoom < 0.99f);
+            bool split = (m_abMode == ABMode::Split) && haveSnapshot();
+            if (abShowsSnapshot()) {
+                displayTex = m_abTex;  // flicker mode, snapshot phase
+            }
+            glBindTexture(GL_TEXTURE_2D, displayTex);
+            if (minify && (displayTex != m_abTex) && ((displayTex != m_displayMipTex) || (m_pipeline.resultSerial() != m_displayMipSerial))) {
+                glGenerateMipmap(GL_TEXTURE_2D);
+                m_displayMipTex = displayTex;
+                m_displayMipSerial = m_pipeline.resultSerial();
+                GLutil::checkError("main image mipmap generation");
+            }
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minify ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
             float scaleX =  2.0f / m_io->DisplaySize.x;
             float scaleY = -2.0f / m_io->DisplaySize.y;
+            glUniform1i(renderer.encodeLoc, m_linearLight ? 1 : 0);
             glUniform4f(renderer.areaLoc,
                 scaleX * float(m_imgX0) - 1.0f,
                 scaleY * float(m_imgY0) + 1.0f,
@@ -293,6 +366,22 @@ int App::run(int argc, char *argv[]) {
             GLutil::checkError("main image uniform setup");
             glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
             GLutil::checkError("main image draw");
+
+            // split view: draw the snapshot (which has mipmaps already)
+            // over the left part of the image
+            if (split) {
+                int splitX = m_imgX0 + int(m_imgZoom * float(m_imgWidth) * m_abSplit + 0.5f);
+                if (splitX > 0) {
+                    glEnable(GL_SCISSOR_TEST);
+                    glScissor(0, 0, splitX, int(m_io->DisplaySize.y));
+                    glBindTexture(GL_TEXTURE_2D, m_abTex);
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minify ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+                    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+                    glDisable(GL_SCISSOR_TEST);
+                    GLutil::checkError("A/B snapshot draw");
+                }
+            }
             glBindTexture(GL_TEXTURE_2D, 0);
         }
 
@@ -308,7 +397,13 @@ int App::run(int argc, char *argv[]) {
     #endif
     glUseProgram(0);
     glDeleteTextures(1, &m_imgTex);
+    Memory::untrackTexture(m_imgTex);
     m_pipeline.free();
+    m_precisionAdvisor.free();
+    m_inspector.free();
+    m_tapReader.free();
+    discardSnapshot();
+    m_rawDecoder.free();
     m_renderDirect.prog.free();
     m_renderWithAlpha.prog.free();
     GLutil::done();
@@ -337,6 +432,7 @@ bool App::RenderProgram::init(GLuint vs, const char* desc, const char* fsSource)
     }
     if (prog.use()) {
         areaLoc = prog.getUniformLocation("gips_pos2ndc");
+        encodeLoc = prog.getUniformLocation("gips_encode");
         glUniform4f(prog.getUniformLocation("gips_rel2map"), 0.0f, 0.0f, 1.0f, 1.0f);
         GLutil::checkError("uniform lookup");
         glUseProgram(0);
@@ -638,17 +734,67 @@ bool App::loadPipeline(const char* filename) {
 
 ///////////////////////////////////////////////////////////////////////////////
 
-bool App::uploadImageTexture(uint8_t* data, int width, int height, ImageSource src, bool mustFreeData) {
+bool App::uploadImageTexture(uint8_t* data, int width, int height, ImageSource src, bool mustFreeData, int channels) {
+    // there are no single- or dual-channel sRGB formats, so these images
+    // need to be expanded to RGBA in linear-light mode
+    if (data && m_linearLight && (channels < 3)) {
+        uint8_t* rgba = static_cast<uint8_t*>(BufferPool::alloc(size_t(width) * size_t(height) * 4u));
+        if (!rgba) {
+            if (mustFreeData) { BufferPool::release(data); }
+            return setError("out of memory");
+        }
+        const uint8_t* s = data;
+        uint8_t* d = rgba;
+        for (int i = width * height;  i;  --i) {
+            d[0] = d[1] = d[2] = s[0];
+            d[3] = (channels > 1) ? s[1] : 0xFF;
+            s += channels;
+            d += 4;
+        }
+        if (mustFreeData) { BufferPool::release(data); }
+        data = rgba;
+        mustFreeData = true;
+        channels = 4;
+    }
+
+    // upload with the native number of channels and let the texture
+    // swizzle present them as RGBA
+    static const GLenum pixelFormats[5] = { 0, GL_RED, GL_RG, GL_RGB, GL_RGBA };
+    static const GLint swizzles[5][4] = {
+        { GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA },
+        { GL_RED, GL_RED,   GL_RED,  GL_ONE   },  // gray
+        { GL_RED, GL_RED,   GL_RED,  GL_GREEN },  // gray + alpha
+        { GL_RED, GL_GREEN, GL_BLUE, GL_ONE   },  // RGB
+        { GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA },  // RGBA
+    };
+    if ((channels < 1) || (channels > 4)) { channels = 4; }
+    GLint texFormat;
+    switch (channels) {
+        case 1:  texFormat = GL_R8;  break;
+        case 2:  texFormat = GL_RG8; break;
+        case 3:  texFormat = m_linearLight ? GL_SRGB8 : GL_RGB8; break;
+        default: texFormat = m_linearLight ? GL_SRGB8_ALPHA8 : GL_RGBA8; break;
+    }
+    if (!Memory::fitsGPU(Memory::textureSize(width, height, GLenum(texFormat)) + m_pipeline.estimateMemoryUsage(width, height, m_requestedFormat),
+                         Memory::trackedTextureSize(m_imgTex) + m_pipeline.memoryUsage())) {
+        if (mustFreeData) { BufferPool::release(data); }
+        return setError("image would exceed the video memory budget");
+    }
     GLutil::clearError();
     glBindTexture(GL_TEXTURE_2D, m_imgTex);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, texFormat, width, height, 0, pixelFormats[channels], GL_UNSIGNED_BYTE, data);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
     GLenum error = GLutil::checkError("texture upload");
+    Memory::trackTexture(MemCategory::SourceImage, m_imgTex, error ? 0 : width, height, GLenum(texFormat));
+    glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzles[channels]);
     glBindTexture(GL_TEXTURE_2D, 0);
     glFlush();
     glFinish();
-    if (mustFreeData) { ::free(data); }
+    if (mustFreeData) { BufferPool::release(data); }
     m_imgWidth = width;
     m_imgHeight = height;
+    m_imgChannels = channels;
     m_imgSource = src;
     m_imgAutofit = true;
     switch (error) {
@@ -659,13 +805,64 @@ bool App::uploadImageTexture(uint8_t* data, int width, int height, ImageSource s
     }
     if (!error) {
         m_pipeline.markAsChanged();
+        m_abStale = !m_abState.empty();
         return setSuccess();
     }
     return false;
 }
 
+bool App::uploadRawImage(const RawImage& raw) {
+    if ((raw.width > m_imgMaxSize) || (raw.height > m_imgMaxSize)) {
+        return setError("raw image is too large");  // can't be resized without breaking the mosaic
+    }
+    // 16-bit source texture, plus (at most) a staging texture of the
+    // file's size for unpacking
+    uint64_t required = Memory::textureSize(raw.width, raw.height, GL_R16)
+                      + uint64_t(raw.rowSize()) * uint64_t(raw.height)
+                      + m_pipeline.estimateMemoryUsage(raw.width, raw.height, m_requestedFormat);
+    if (!Memory::fitsGPU(required, Memory::trackedTextureSize(m_imgTex) + m_pipeline.memoryUsage())) {
+        return setError("raw image would exceed the video memory budget");  // can't be downscaled either
+    }
+    if (!m_rawDecoder.decode(raw, m_imgTex)) {
+        return setError("raw image upload failed");
+    }
+    glFlush();
+    glFinish();
+    m_imgChannels = 1;
+    m_imgWidth = raw.width;
+    m_imgHeight = raw.height;
+    m_imgSource = ImageSource::Image;
+    m_imgAutofit = true;
+    m_pipeline.markAsChanged();
+    m_abStale = !m_abState.empty();
+    return setSuccess();
+}
+
+bool App::loadRawImage(const char* filename) {
+    FileUtil::MappedFile file;
+    if (!file.open(filename)) { return setError("failed to read image file"); }
+    const uint8_t* data = static_cast<const uint8_t*>(file.data());
+    size_t size = file.size();
+    RawImage raw;
+    if (StringUtil::extractExtCode(filename) == StringUtil::makeExtCode("raw")) {
+        m_imgSource = ImageSource::Image;  // keep the layout settings visible even if loading fails
+        raw.width  = m_rawWidth;
+        raw.height = m_rawHeight;
+        raw.bits   = m_rawBits;
+        raw.packing = m_rawPacked ? RawPacking::MIPI : RawPacking::None;
+        raw.bigEndian = m_rawBigEndian;
+        raw.data = data + m_rawHeaderSize;
+        if (!raw.valid() || (m_rawHeaderSize < 0) || ((size_t(m_rawHeaderSize) + raw.dataSize()) > size)) {
+            return setError("raw image layout doesn't match the file");
+        }
+    } else if (!parsePGM(data, size, raw)) {
+        return false;
+    }
+    return uploadRawImage(raw);
+}
+
 bool App::loadColor() {
-    if ((m_targetImgWidth != m_imgWidth) || (m_targetImgHeight != m_imgHeight)) {
+    if ((m_targetImgWidth != m_imgWidth) || (m_targetImgHeight != m_imgHeight) || (m_imgChannels != 4)) {
         if (!uploadImageTexture(nullptr, m_targetImgWidth, m_targetImgHeight, ImageSource::Color)) {
             return false;
         }
@@ -677,6 +874,43 @@ bool App::loadColor() {
     return setSuccess();
 }
 
+//! load a binary PNM-family file into a tightly packed, top-down 8-bit image
+//! with the file's number of channels; 16-bit and float samples are
+//! converted, as the source image texture has 8 bits per channel anyway
+static uint8_t* loadPNM(const char* filename, int& width, int& height, int& channels) {
+    FileUtil::MappedFile file;
+    ImageBuffer image;
+    if (!file.open(filename) || !parsePNM(file.data(), file.size(), image)) { return nullptr; }
+    size_t rowSize = size_t(image.width) * size_t(image.channels);
+    size_t size = rowSize * size_t(image.height);
+    uint8_t* data = Memory::fitsHost(size) ? static_cast<uint8_t*>(BufferPool::alloc(size)) : nullptr;
+    if (!data) { return nullptr; }
+    for (int y = 0;  y < image.height;  ++y) {
+        const uint8_t* src = static_cast<const uint8_t*>(image.data) + size_t(image.bottomUp ? (image.height - 1 - y) : y) * image.rowPitch();
+        uint8_t* dest = &data[size_t(y) * rowSize];
+        if (image.format == PixelFormat::Int8) {
+            memcpy(dest, src, rowSize);
+        } else if (image.format == PixelFormat::Int16) {
+            for (size_t i = 0;  i < rowSize;  ++i, src += 2) {
+                unsigned v = image.bigEndian ? ((unsigned(src[0]) << 8) | src[1]) : ((unsigned(src[1]) << 8) | src[0]);
+                dest[i] = uint8_t((v * 255u + 32767u) / 65535u);
+            }
+        } else {  // Float32
+            for (size_t i = 0;  i < rowSize;  ++i, src += 4) {
+                uint8_t b[4] = { src[0], src[1], src[2], src[3] };
+                if (image.bigEndian) { std::swap(b[0], b[3]);  std::swap(b[1], b[2]); }
+                float f;
+                memcpy(&f, b, 4);
+                dest[i] = uint8_t(((f > 0.0f) ? ((f < 1.0f) ? f : 1.0f) : 0.0f) * 255.0f + 0.5f);
+            }
+        }
+    }
+    width = image.width;
+    height = image.height;
+    channels = image.channels;
+    return data;
+}
+
 bool App::loadImage(const char* filename, bool useClipboard, bool updateClipboard) {
     if (!useClipboard && (!filename || !filename[0])) {
         m_imgFilename.clear();
@@ -694,11 +928,14 @@ bool App::loadImage(const char* filename, bool useClipboard, bool updateClipboar
     #endif
     uint8_t* rawData = nullptr;
     bool mustFreeRawData = false;
-    int rawWidth = 0, rawHeight = 0;
+    int rawWidth = 0, rawHeight = 0, rawChannels = 4;
+    int targetWidth  = m_imgResize ? m_targetImgWidth  : m_imgMaxSize;
+    int targetHeight = m_imgResize ? m_targetImgHeight : m_imgMaxSize;
     if (updateClipboard || (useClipboard && !m_clipboardImage)) {
-        ::free(m_clipboardImage);
+        BufferPool::release(m_clipboardImage);
         m_clipboardImage = Clipboard::getRGBA8Image(m_clipboardWidth, m_clipboardHeight);
         if (!m_clipboardImage) { return setError("failed to import pipeline or image from the clipboard"); }
+        Memory::tagClipboardBuffer(m_clipboardImage);
     }
     if (useClipboard) {
         rawData = (uint8_t*) m_clipboardImage;
@@ -707,16 +944,36 @@ bool App::loadImage(const char* filename, bool useClipboard, bool updateClipboar
         rawHeight = m_clipboardHeight;
     } else {
         m_imgFilename = filename;
-        ::free(m_clipboardImage);
+        BufferPool::release(m_clipboardImage);
         m_clipboardImage = nullptr;
-        rawData = stbi_load(filename, &rawWidth, &rawHeight, nullptr, 4);
+        // headerless raw data and binary PGM files go directly to the GPU;
+        // the other binary PNM-family files are converted to 8 bits here,
+        // and everything else (including ASCII PGM) is decoded by stb_image
+        uint32_t extCode = StringUtil::extractExtCode(filename);
+        if (extCode == StringUtil::makeExtCode("raw")) {
+            return loadRawImage(filename);
+        }
+        if ((extCode == StringUtil::makeExtCode("pgm")) && loadRawImage(filename)) {
+            return true;
+        }
+        if (isPNMFile(filename)) {
+            rawData = loadPNM(filename, rawWidth, rawHeight, rawChannels);
+        }
+        if (JPEGUtil::isAvailable() && ((extCode == StringUtil::makeExtCode("jpg"))
+                                     || (extCode == StringUtil::makeExtCode("jpeg"))
+                                     || (extCode == StringUtil::makeExtCode("jpe")))) {
+            // large JPEGs can be decoded at a reduced size right away
+            rawData = JPEGUtil::loadScaled(filename, targetWidth, targetHeight, rawWidth, rawHeight, rawChannels);
+        }
+        if (!rawData) {
+            rawData = ImageUtil::load(filename, rawWidth, rawHeight, &rawChannels);
+        }
         if (!rawData) { return setError("failed to read image file"); }
         mustFreeRawData = true;
     }
-    int targetWidth  = m_imgResize ? m_targetImgWidth  : m_imgMaxSize;
-    int targetHeight = m_imgResize ? m_targetImgHeight : m_imgMaxSize;
+    bool shrunk = fitImageToBudget(rawWidth, rawHeight, targetWidth, targetHeight);
     if ((rawWidth <= targetWidth) && (rawHeight <= targetHeight)) {
-        return uploadImageTexture(rawData, rawWidth, rawHeight, ImageSource::Image, mustFreeRawData);
+        return uploadImageTexture(rawData, rawWidth, rawHeight, ImageSource::Image, mustFreeRawData, rawChannels);
     }
     int scaledWidth  = targetWidth;
     int scaledHeight = (rawHeight * scaledWidth + (rawWidth / 2)) / rawWidth;
@@ -727,17 +984,109 @@ bool App::loadImage(const char* filename, bool useClipboard, bool updateClipboar
     #ifndef NDEBUG
         fprintf(stderr, "downscaling %dx%d -> %dx%d\n", rawWidth, rawHeight, scaledWidth, scaledHeight);
     #endif
-    uint8_t* scaledData = (uint8_t*) malloc(scaledWidth * scaledHeight * 4);
+    if ((rawWidth <= m_imgMaxSize) && (rawHeight <= m_imgMaxSize) && !shrunk) {
+        // the full image fits into a texture -> let the GPU do the resizing
+        if (!uploadImageTexture(rawData, rawWidth, rawHeight, ImageSource::Image, mustFreeRawData, rawChannels)) {
+            return false;
+        }
+        return downscaleImageTexture(scaledWidth, scaledHeight);
+    }
+    size_t scaledSize = size_t(scaledWidth) * size_t(scaledHeight) * size_t(rawChannels);
+    uint8_t* scaledData = Memory::fitsHost(scaledSize) ? (uint8_t*) BufferPool::alloc(scaledSize) : nullptr;
     if (!scaledData) {
-        if (mustFreeRawData) { ::free(rawData); }
+        if (mustFreeRawData) { BufferPool::release(rawData); }
         return setError("out of memory");
     }
-    if (!stbir_resize_uint8(
-           rawData,    rawWidth,    rawHeight, 0,
-        scaledData, scaledWidth, scaledHeight, 0,
-        4)) { ::free(rawData); return setError("could not downscale image"); }
-    if (mustFreeRawData) { ::free(rawData); }
-    return uploadImageTexture(scaledData, scaledWidth, scaledHeight, ImageSource::Image);
+
+    // resize in horizontal bands on all threads; each band is a region of
+    // the same overall mapping, so the result is that of a single resize
+    // (with the same defaults as stbir_resize_uint8())
+    std::atomic<bool> resized(true);
+    m_threadPool.parallelFor(0, scaledHeight, 64, [&] (int y0, int y1) {
+        if (!stbir_resize_region(
+               rawData,    rawWidth, rawHeight, 0,
+            &scaledData[size_t(y0) * size_t(scaledWidth * rawChannels)], scaledWidth, y1 - y0, 0,
+            STBIR_TYPE_UINT8, rawChannels, STBIR_ALPHA_CHANNEL_NONE, 0,
+            STBIR_EDGE_CLAMP, STBIR_EDGE_CLAMP, STBIR_FILTER_DEFAULT, STBIR_FILTER_DEFAULT,
+            STBIR_COLORSPACE_LINEAR, nullptr,
+            0.0f, float(y0) / float(scaledHeight), 1.0f, float(y1) / float(scaledHeight))) {
+            resized = false;
+        }
+    });
+    if (mustFreeRawData) { BufferPool::release(rawData); }
+    if (!resized) { BufferPool::release(scaledData); return setError("could not downscale image"); }
+    if (!uploadImageTexture(scaledData, scaledWidth, scaledHeight, ImageSource::Image, true, rawChannels)) {
+        return false;
+    }
+    return shrunk ? setSuccess("image downscaled to fit into the video memory budget") : true;
+}
+
+bool App::fitImageToBudget(int width, int height, int& targetWidth, int& targetHeight) {
+    // the source texture and the pipeline's buffers scale with the image
+    // area, everything else (display, snapshot etc.) stays as it is
+    uint64_t budget = Memory::gpuBudget();
+    if (!budget) { return false; }
+    uint64_t fixed = Memory::getGPUTotal().current;
+    fixed -= std::min(fixed, Memory::trackedTextureSize(m_imgTex) + m_pipeline.memoryUsage());
+    if (fixed >= budget) { return false; }  // nothing would fit; let the upload fail
+    uint64_t perPixel = 4u + m_pipeline.estimateMemoryUsage(1, 1, m_requestedFormat);
+    double maxArea = double((budget - fixed) / perPixel);
+    double area = double(std::min(width, targetWidth)) * double(std::min(height, targetHeight));
+    if (area <= maxArea) { return false; }
+    double scale = std::sqrt(maxArea / (double(width) * double(height)));
+    targetWidth  = std::max(1, std::min(targetWidth,  int(double(width)  * scale)));
+    targetHeight = std::max(1, std::min(targetHeight, int(double(height) * scale)));
+    #ifndef NDEBUG
+        fprintf(stderr, "image doesn't fit into the video memory budget, limiting size to %dx%d\n", targetWidth, targetHeight);
+    #endif
+    return true;
+}
+
+bool App::downscaleImageTexture(int width, int height) {
+    GLuint tex = 0;
+    GLutil::clearError();
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, m_linearLight ? GL_SRGB8_ALPHA8 : GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    if (GLutil::checkError("downscaling texture creation")) {
+        glDeleteTextures(1, &tex);
+        return setError("failed to create texture for downscaling");
+    }
+    Memory::trackTexture(MemCategory::SourceImage, tex, width, height, GL_RGBA8);
+
+    // trilinear filtering from the mipmapped full-size image; in
+    // linear-light mode, this happens on linear values
+    glBindTexture(GL_TEXTURE_2D, m_imgTex);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    m_renderDirect.prog.use();
+    glUniform4f(m_renderDirect.areaLoc, -1.0f, -1.0f, 2.0f, 2.0f);
+    glUniform1i(m_renderDirect.encodeLoc, 0);
+    glViewport(0, 0, width, height);
+    if (m_linearLight) { glEnable(GL_FRAMEBUFFER_SRGB); }
+    m_helperFBO.begin(tex);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    m_helperFBO.end();
+    glDisable(GL_FRAMEBUFFER_SRGB);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(0);
+    if (GLutil::checkError("downscaling")) {
+        glDeleteTextures(1, &tex);
+        Memory::untrackTexture(tex);
+        return setError("could not downscale image");
+    }
+
+    // replace the source texture by the downscaled one
+    glDeleteTextures(1, &m_imgTex);
+    Memory::untrackTexture(m_imgTex);
+    m_imgTex = tex;
+    m_imgWidth = width;
+    m_imgHeight = height;
+    m_imgChannels = 4;
+    return setSuccess();
 }
 
 bool App::loadPattern() {
@@ -753,7 +1102,7 @@ bool App::loadPattern() {
                 m_targetImgWidth, m_targetImgHeight,
                 pat.name, m_imgPatternNoAlpha ? "without" : "with");
     #endif
-    uint8_t* data = (uint8_t*)malloc(m_targetImgWidth * m_targetImgHeight * 4);
+    uint8_t* data = (uint8_t*) BufferPool::alloc(m_targetImgWidth * m_targetImgHeight * 4);
     if (!data) { return setError("out of memory"); }
     pat.render(data, m_targetImgWidth, m_targetImgHeight, !m_imgPatternNoAlpha);
     if (m_imgPatternNoAlpha && !pat.alwaysWritesAlpha) {
@@ -766,6 +1115,16 @@ bool App::loadPattern() {
     return uploadImageTexture(data, m_targetImgWidth, m_targetImgHeight, ImageSource::Pattern);
 }
 
+void App::setLinearLight(bool enable) {
+    if (enable == m_linearLight) { return; }
+    m_linearLight = enable;
+    m_pipeline.setLinearLight(enable);
+    // the source texture needs to be re-created with the proper format
+    m_imgWidth = m_imgHeight = 0;
+    updateImage();
+    requestFrames(2);
+}
+
 bool App::updateImage() {
     switch (m_imgSource) {
         case ImageSource::Color:   return loadColor();
@@ -777,6 +1136,75 @@ bool App::updateImage() {
 
 ///////////////////////////////////////////////////////////////////////////////
 
+//! write an RGBA8 image into a PNM-family file, with the layout that the
+//! file name's extension asks for
+static bool savePNM(const char* filename, const uint8_t* data, int width, int height) {
+    ImageBuffer image(nullptr, width, height);
+    std::string header = makePNMHeader(filename, image);
+    FileUtil::MappedFile file;
+    if (header.empty() || !file.create(filename, header.size() + image.dataSize())) { return false; }
+    uint8_t* out = static_cast<uint8_t*>(file.data());
+    memcpy(out, header.data(), header.size());
+    out += header.size();
+    for (int y = 0;  y < height;  ++y) {
+        const uint8_t* src = &data[size_t(image.bottomUp ? (height - 1 - y) : y) * size_t(width) * 4u];
+        for (int x = 0;  x < width;  ++x, src += 4) {
+            for (int c = 0;  c < image.channels;  ++c) {
+                if (image.format == PixelFormat::Float32) {
+                    float f = float(src[c]) * (1.0f / 255.0f);
+                    memcpy(out, &f, 4);
+                    out += 4;
+                } else {
+                    *out++ = src[c];
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool App::saveTaps(const char* filename) {
+    // the taps are read back one after another (which needs the GL context),
+    // while the ones read before are already being encoded in the background
+    int width = m_imgWidth, height = m_imgHeight, quality = m_jpegQuality;
+    JPEGUtil::Subsampling subsampling = m_jpegSubsampling;
+    std::vector<uint8_t*> buffers;
+    std::atomic<int> savedCount(0);
+    TaskGroup encoders(&m_threadPool);
+    for (int i = 0;  i < m_tapReader.tapCount();  ++i) {
+        size_t size = size_t(width) * size_t(height) * 4u;
+        uint8_t *data = Memory::fitsHost(size) ? (uint8_t*) BufferPool::alloc(size) : nullptr;
+        if (!data) { break; }
+        buffers.push_back(data);
+        std::string tapFilename = makeTapFilename(filename, m_tapReader.nodeIndex(i));
+        #ifndef NDEBUG
+            fprintf(stderr, "saving output of node %d to '%s'\n", m_tapReader.nodeIndex(i) + 1, tapFilename.c_str());
+        #endif
+        if (!m_tapReader.read(i, ImageBuffer(data, width, height))) { continue; }
+        encoders.run([=, &savedCount] {
+            bool ok = isPNMFile(tapFilename.c_str()) ? savePNM(tapFilename.c_str(), data, width, height)
+                    : ImageUtil::save(tapFilename.c_str(), data, width, height, quality, subsampling);
+            if (ok) { ++savedCount; }
+        });
+    }
+    encoders.wait();
+    for (uint8_t* data : buffers) { BufferPool::release(data); }
+    int saved = savedCount;
+    if (saved < m_tapReader.tapCount()) {
+        return setError("image saved, but " + std::to_string(m_tapReader.tapCount() - saved) + " intermediate output(s) failed");
+    }
+    return setSuccess("image and " + std::to_string(saved) + " intermediate output(s) saved");
+}
+
+void App::completeRender() {
+    // the result must be complete, even if that takes a while
+    if (m_renderCancelled) {
+        m_pipeline.render(m_imgTex, m_imgWidth, m_imgHeight, m_requestedFormat, m_showIndex);
+        m_renderCancelled = false;
+    }
+    m_pipeline.finishRender();
+}
+
 bool App::saveFile(const char* filename, bool toClipboard) {
     // decide what to do and where to put it
     if (!toClipboard && (!filename || !filename[0])) { return false; }
@@ -805,16 +1233,36 @@ bool App::saveFile(const char* filename, bool toClipboard) {
     }
 
     if (saveImage) {
+        // if the outputs of some nodes shall be exported as well, read them
+        // back during a single full render that also produces the result
+        std::vector<int> taps;
+        if (!toClipboard) {
+            for (int i = 0;  i < m_showIndex;  ++i) {
+                if (m_pipeline.node(i).exportTap()) { taps.push_back(i); }
+            }
+        }
+        if (!taps.empty() && m_tapReader.begin(taps, PixelFormat::Int8, m_linearLight)) {
+            m_pipeline.render(m_imgTex, m_imgWidth, m_imgHeight, m_requestedFormat, m_showIndex, m_tapReader.callback());
+            m_renderCancelled = false;
+        } else {
+            taps.clear();
+            completeRender();
+        }
         GLuint tex = 0;
-        bool needStagingTexture = (m_pipeline.format() != PixelFormat::Int8);
+        bool needStagingTexture = (m_pipeline.format() != PixelFormat::Int8) || (m_pipeline.resultChannels() < 4)
+                               || ((m_imgChannels < 4) && (m_pipeline.resultTex() == m_imgTex));
 
         if (needStagingTexture) {
             // create staging texture
+            if (!Memory::fitsGPU(Memory::textureSize(m_imgWidth, m_imgHeight, GL_RGBA8))) {
+                return setError("staging texture for saving would exceed the video memory budget");
+            }
             GLutil::clearError();
             glGenTextures(1, &tex);
             glBindTexture(GL_TEXTURE_2D, tex);
             glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, m_imgWidth, m_imgHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
             if (GLutil::checkError("saving texture creation")) { return setError("failed to create temporary texture for saving"); }
+            Memory::trackTexture(MemCategory::Staging, tex, m_imgWidth, m_imgHeight, GL_RGBA8);
 
             // copy result into staging texture
             m_renderDirect.prog.use();
@@ -822,6 +1270,7 @@ bool App::saveFile(const char* filename, bool toClipboard) {
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
             glUniform4f(m_renderDirect.areaLoc, -1.0f, -1.0f, 2.0f, 2.0f);
+            glUniform1i(m_renderDirect.encodeLoc, m_linearLight ? 1 : 0);
             glViewport(0, 0, m_imgWidth, m_imgHeight);
             if (GLutil::checkError("saving render preparation")) { return setError("image retrieval failed"); }
             m_helperFBO.begin(tex);
@@ -830,48 +1279,41 @@ bool App::saveFile(const char* filename, bool toClipboard) {
             if (GLutil::checkError("saving render draw operation")) { return setError("image retrieval failed"); }
         } else {
             // pipeline runs in 8-bit integer mode -> can read the source directly
-            tex = m_pipeline.resultTex();
+            // (in linear-light mode, it's stored sRGB-encoded already)
+            tex = m_pipeline.encodeResult();
         }
 
         // read image data from the texture
-        uint8_t *data = (uint8_t*) malloc(m_imgWidth * m_imgHeight * 4);
-        if (!data) { return setError("out of memory"); }
+        size_t size = size_t(m_imgWidth) * size_t(m_imgHeight) * 4u;
+        uint8_t *data = Memory::fitsHost(size) ? (uint8_t*) BufferPool::alloc(size) : nullptr;
+        if (!data) {
+            if (needStagingTexture) { glDeleteTextures(1, &tex);  Memory::untrackTexture(tex); }
+            return setError("out of memory");
+        }
         glBindTexture(GL_TEXTURE_2D, tex);
         glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
         glBindTexture(GL_TEXTURE_2D, 0);
         if (needStagingTexture) {
             glDeleteTextures(1, &tex);
+            Memory::untrackTexture(tex);
         }
-        if (GLutil::checkError("saving texture readback")) { ::free(data); return setError("image retrieval failed"); }
+        if (GLutil::checkError("saving texture readback")) { BufferPool::release(data); return setError("image retrieval failed"); }
 
         // save the image
         if (toClipboard) {
             bool ok = Clipboard::setRGBA8ImageAndText(data, m_imgWidth, m_imgHeight, savePipeline.c_str(), int(savePipeline.size()));
-            ::free(data);
+            BufferPool::release(data);
             if (ok) { return setSuccess("pipeline and image copied into the clipboard"); }
             else    { return setError("failed to set clipboard contents"); }
         } else {
-            int res;
-            switch (StringUtil::extractExtCode(filename)) {
-                case StringUtil::makeExtCode("jpg"):
-                case StringUtil::makeExtCode("jpeg"):
-                case StringUtil::makeExtCode("jpe"):
-                    res = stbi_write_jpg(filename, m_imgWidth, m_imgHeight, 4, data, 98);
-                    break;
-                case StringUtil::makeExtCode("png"):
-                    res = stbi_write_png(filename, m_imgWidth, m_imgHeight, 4, data, 0);
-                    break;
-                case StringUtil::makeExtCode("tga"):
-                    res = stbi_write_tga(filename, m_imgWidth, m_imgHeight, 4, data);
-                    break;
-                case StringUtil::makeExtCode("bmp"):
-                    res = stbi_write_bmp(filename, m_imgWidth, m_imgHeight, 4, data);
-                    break;
-                default:
-                    ::free(data); return setError("unrecognized output file format");
+            if (!isSaveImageFile(filename)) {
+                BufferPool::release(data); return setError("unrecognized output file format");
             }
-            ::free(data);
-            if (res == 0) { return setError("image saving failed"); }
+            bool ok = isPNMFile(filename) ? savePNM(filename, data, m_imgWidth, m_imgHeight)
+                    : ImageUtil::save(filename, data, m_imgWidth, m_imgHeight, m_jpegQuality, m_jpegSubsampling);
+            BufferPool::release(data);
+            if (!ok) { return setError("image saving failed"); }
+            if (!taps.empty()) { return saveTaps(filename); }
             return setSuccess("image saved");
         }
     } else if (!savePipeline.empty()) {
@@ -889,6 +1331,143 @@ bool App::saveFile(const char* filename, bool toClipboard) {
 
 ///////////////////////////////////////////////////////////////////////////////
 
+void App::runPrecisionAnalysis() {
+    m_precisionRequested = false;
+    m_precisionValid = m_precisionAdvisor.analyze(m_pipeline, m_imgTex, m_imgWidth, m_imgHeight, m_showIndex,
+                                                  m_precisionTolerance / 255.0f, m_precisionReport);
+    m_pipeline.markAsChanged();
+    requestFrames(1);
+    if (!m_precisionValid) {
+        setError("precision analysis failed");
+        return;
+    }
+    std::string msg("recommended pixel format: ");
+    msg += pixelFormatName(m_precisionReport.recommended);
+    if (m_precisionAutoApply) {
+        m_requestedFormat = m_precisionReport.recommended;
+        msg += " (applied)";
+    }
+    setSuccess(msg);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void App::updateInspector() {
+    // collect the previous readback, if it's done; otherwise, keep polling
+    if (m_inspector.poll()) { requestFrames(1); }
+    if (m_inspector.pending()) { requestFrames(1); return; }
+
+    // request the region under the mouse cursor, unless nothing changed
+    if (!ImGui::IsMousePosValid()) { return; }
+    int x = int(std::floor((m_io->MousePos.x - float(m_imgX0)) / m_imgZoom));
+    int y = int(std::floor((m_io->MousePos.y - float(m_imgY0)) / m_imgZoom));
+    if ((x < 0) || (y < 0) || (x >= m_imgWidth) || (y >= m_imgHeight)) { return; }
+    if (m_inspector.hasResult() && (x == m_inspector.resultX()) && (y == m_inspector.resultY())
+    && (m_inspectorSize == m_inspector.resultSize()) && (m_pipeline.resultSerial() == m_inspectorSerial)) {
+        return;
+    }
+    if (m_inspector.request(m_pipeline.resultTex(), m_imgWidth, m_imgHeight, x, y, m_inspectorSize)) {
+        m_inspectorSerial = m_pipeline.resultSerial();
+        requestFrames(1);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool App::abShowsSnapshot() const {
+    if ((m_abMode != ABMode::Flicker) || !haveSnapshot()) { return false; }
+    double interval = std::max(double(m_abFlickerInterval), 0.05);
+    return (std::fmod(glfwGetTime(), 2.0 * interval) < interval);
+}
+
+bool App::takeSnapshot() {
+    m_abSnapshotRequested = false;
+    completeRender();
+    m_abState = m_pipeline.serialize(m_showIndex);
+    m_abFormat = m_requestedFormat;
+    m_abStale = false;
+    if (!copyToSnapshot(m_pipeline.resultTex(), m_pipeline.format())) { return false; }
+    if (m_abMode == ABMode::Off) { m_abMode = ABMode::Split; }
+    return setSuccess("snapshot taken");
+}
+
+bool App::renderSnapshot() {
+    m_abStale = false;
+    if (m_abState.empty()) { return false; }
+    #ifndef NDEBUG
+        fprintf(stderr, "re-rendering A/B snapshot for the new input image\n");
+    #endif
+    if (!m_abPipeline.init()) { return setError("failed to initialize the snapshot's pipeline"); }
+    m_abPipeline.setLinearLight(m_linearLight);
+    std::string state(m_abState);  // unserialize() modifies its input
+    int showIndex = m_abPipeline.unserialize(&state[0]);
+    if (showIndex < 0) { return setError("failed to restore the snapshot's pipeline"); }
+    m_abPipeline.render(m_imgTex, m_imgWidth, m_imgHeight, m_abFormat, showIndex);
+    return copyToSnapshot(m_abPipeline.resultTex(), m_abPipeline.format());
+}
+
+bool App::copyToSnapshot(GLuint tex, PixelFormat format) {
+    // keep the result's precision; in linear-light mode, 8-bit data is
+    // stored sRGB-encoded, just like in the pipeline's buffers
+    GLenum texFormat, pixelFormat, dataType;
+    getGLFormat(format, texFormat, pixelFormat, dataType);
+    bool srgb = m_linearLight && (format == PixelFormat::Int8);
+    if (srgb) { texFormat = GL_SRGB8_ALPHA8; }
+    if (!Memory::fitsGPU(Memory::textureSize(m_imgWidth, m_imgHeight, texFormat), Memory::trackedTextureSize(m_abTex))) {
+        discardSnapshot();
+        return setError("snapshot would exceed the video memory budget");
+    }
+    GLutil::clearError();
+    if (!m_abTex) { glGenTextures(1, &m_abTex); }
+    glBindTexture(GL_TEXTURE_2D, m_abTex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GLint(texFormat), m_imgWidth, m_imgHeight, 0, pixelFormat, dataType, nullptr);
+    if (GLutil::checkError("snapshot texture creation")) {
+        discardSnapshot();
+        return setError("failed to create snapshot texture");
+    }
+    Memory::trackTexture(MemCategory::Staging, m_abTex, m_imgWidth, m_imgHeight, texFormat);
+
+    // copy through the display shader, which honors the swizzles of
+    // narrow results, and build the mipmaps for zoomed-out display
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    m_renderDirect.prog.use();
+    glUniform4f(m_renderDirect.areaLoc, -1.0f, -1.0f, 2.0f, 2.0f);
+    glUniform1i(m_renderDirect.encodeLoc, 0);
+    glViewport(0, 0, m_imgWidth, m_imgHeight);
+    if (srgb) { glEnable(GL_FRAMEBUFFER_SRGB); }
+    m_helperFBO.begin(m_abTex);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    m_helperFBO.end();
+    if (srgb) { glDisable(GL_FRAMEBUFFER_SRGB); }
+    glBindTexture(GL_TEXTURE_2D, m_abTex);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(0);
+    if (GLutil::checkError("snapshot copy")) {
+        discardSnapshot();
+        return setError("failed to copy the snapshot");
+    }
+    m_abWidth = m_imgWidth;
+    m_abHeight = m_imgHeight;
+    return true;
+}
+
+void App::discardSnapshot() {
+    if (m_abTex) { glDeleteTextures(1, &m_abTex); }
+    Memory::untrackTexture(m_abTex);
+    m_abTex = 0;
+    m_abWidth = m_abHeight = 0;
+    m_abState.clear();
+    m_abStale = false;
+    m_abPipeline.free();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
 void App::startAutoTest(const char* scanDir) {
     if (!scanDir) {
         // main entry point
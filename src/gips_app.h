@@ -15,8 +15,14 @@
 #include "imgui.h"
 
 #include "string_util.h"
+#include "jpeg_util.h"
+#include "thread_pool.h"
 
 #include "gips_core.h"
+#include "gips_precision.h"
+#include "gips_inspector.h"
+#include "gips_taps.h"
+#include "gips_raw.h"
 
 namespace GIPS {
 
@@ -70,12 +76,23 @@ private:
     int m_editTargetHeight =  720;
     int m_imgWidth = 0;
     int m_imgHeight = 0;
+    int m_imgChannels = 4;  //!< channels stored in the source texture; the others are swizzled in
     int m_imgMaxSize = 1024;
 
+    // raw sensor data input (layout settings are for headerless files only)
+    RawDecoder m_rawDecoder;
+    int m_rawWidth = 0;
+    int m_rawHeight = 0;
+    int m_rawBits = 16;
+    int m_rawHeaderSize = 0;
+    bool m_rawPacked = false;
+    bool m_rawBigEndian = false;
+
     // rendering resources
     struct RenderProgram {
         GLutil::Program prog;
         GLint areaLoc = -1;
+        GLint encodeLoc = -1;
         bool init(GLuint vs, const char* desc, const char *fsSource);
     };
     RenderProgram m_renderDirect;
@@ -91,6 +108,19 @@ private:
     Pipeline m_pipeline;
     int m_showIndex = 0;
     PixelFormat m_requestedFormat = PixelFormat::DontCare;
+    bool m_linearLight = false;
+    float m_renderBudget_ms = 16.0f;  //!< time slice per frame for rendering; 0 = render everything at once
+    bool m_renderCancelled = false;   //!< the result is incomplete because a time-sliced render was cancelled
+    GLuint m_displayMipTex = 0;       //!< texture whose mipmaps have been generated for display
+    unsigned m_displayMipSerial = 0;  //!< Pipeline::resultSerial() at that time
+
+    // image export options
+    int m_jpegQuality = 98;
+    JPEGUtil::Subsampling m_jpegSubsampling = JPEGUtil::Subsampling::Auto;
+
+    // CPU worker threads for image encoding, resizing, pattern generation
+    // and directory scans; this is the current pool for library code, too
+    ThreadPool m_threadPool;
 
     // image geometry, zoom&pan
     int m_imgX0 = 0;
@@ -136,6 +166,49 @@ private:
         std::string path;     //!< path to load (for LoadNode and SaveFile only)
     } m_pcr;
 
+    // precision advisor
+    PrecisionAdvisor m_precisionAdvisor;
+    PrecisionReport m_precisionReport;
+    bool m_showPrecision = false;
+    bool m_precisionRequested = false;
+    bool m_precisionValid = false;
+    bool m_precisionAutoApply = false;
+    float m_precisionTolerance = 1.0f;  //!< error tolerance in 8-bit steps
+    void runPrecisionAnalysis();
+
+    // pixel inspector
+    PixelInspector m_inspector;
+    bool m_showInspector = false;
+    int m_inspectorSize = 9;             //!< edge length of the loupe, in pixels
+    unsigned m_inspectorSerial = 0;      //!< Pipeline::resultSerial() of the last request
+    void updateInspector();
+
+    // export of intermediate node outputs along with the result
+    TapReader m_tapReader;
+    bool saveTaps(const char* filename);
+
+    // A/B comparison: a cached snapshot ("A") of an earlier result is shown
+    // next to, or alternating with, the live result ("B"); the snapshot is
+    // only re-rendered (from its saved pipeline state) if the input changes
+    enum class ABMode : int { Off = 0, Split, Flicker };
+    ABMode m_abMode = ABMode::Off;
+    GLuint m_abTex = 0;
+    int m_abWidth = 0;
+    int m_abHeight = 0;
+    std::string m_abState;                //!< serialized pipeline that produced the snapshot
+    PixelFormat m_abFormat = PixelFormat::DontCare;
+    Pipeline m_abPipeline;                //!< used to re-render the snapshot for a new input image
+    bool m_abSnapshotRequested = false;
+    bool m_abStale = false;               //!< the input image changed since the snapshot was rendered
+    float m_abSplit = 0.5f;               //!< position of the split, relative to the image width
+    float m_abFlickerInterval = 0.5f;     //!< seconds per side in flicker mode
+    inline bool haveSnapshot() const { return m_abTex && (m_abWidth == m_imgWidth) && (m_abHeight == m_imgHeight); }
+    bool abShowsSnapshot() const;
+    bool takeSnapshot();
+    bool renderSnapshot();
+    bool copyToSnapshot(GLuint tex, PixelFormat format);
+    void discardSnapshot();
+
     // auto-test mode
     std::list<std::string> m_autoTestList;
     int m_autoTestTotal = 0;
@@ -164,13 +237,22 @@ private:
     bool loadPipeline(const char* filename);
 
     // image source modification functions
-    bool uploadImageTexture(uint8_t* data, int width, int height, ImageSource src, bool mustFreeData=true);
+    bool uploadImageTexture(uint8_t* data, int width, int height, ImageSource src, bool mustFreeData=true, int channels=4);
+    bool uploadRawImage(const RawImage& raw);
+    bool loadRawImage(const char* filename);
     bool loadColor();
     bool loadImage(const char* filename, bool useClipboard=false, bool updateClipboard=false);
+    bool downscaleImageTexture(int width, int height);
+    //! reduce the target size of an image so that the source texture and
+    //! the pipeline's buffers fit into the video memory budget
+    //! \returns true if the target size has been reduced
+    bool fitImageToBudget(int width, int height, int& targetWidth, int& targetHeight);
     bool loadPattern();
     bool updateImage();
+    void setLinearLight(bool enable);
 
     // pipeline and image result saving
+    void completeRender();
     bool saveFile(const char* filename, bool toClipboard=false);
 
     // auto-test mode implementation
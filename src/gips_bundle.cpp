@@ -0,0 +1,282 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+// Pipeline bundles: self-contained binary files with everything that is
+// needed to instantiate a pipeline without touching the shader files.
+//
+// All integers are little-endian; strings are stored as a 32-bit length
+// followed by the (non-terminated) characters. Layout:
+//   char[8]  magic "GIPSBNDL"
+//   u32      format version (BundleVersion)
+//   str      driver ID (vendor, renderer and version; binaries are only
+//            used if this matches the current driver)
+//   i32      show index
+//   u32      number of nodes, followed by the nodes:
+//     str    name
+//     str    original filename (informational only)
+//     str    non-fatal load errors
+//     u32    flags (bit 0 = enabled, bit 1 = generator)
+//     u32    preferred PixelFormat
+//     i32    output channels (1, 2 or 4; 0 = same as input)
+//     u32    number of parameters, followed by the parameters:
+//       str  name, description, format string
+//       u32  ParameterType
+//       i32  digits
+//       f32  min, max, value[4], default value[4]
+//       u32  1 if the parameter has an identity value, 0 otherwise
+//       f32  identity value
+//     u32    number of passes, followed by the passes:
+//       u32  flags (bit 0 = texture filtering, bit 1 = coordinate input)
+//       u32  CoordMapMode
+//       str  fragment shader source code
+//       u32  program binary format (0 = no binary)
+//       str  program binary
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <string>
+
+#include "gl_header.h"
+#include "gl_util.h"
+
+#include "gips_core.h"
+
+namespace GIPS {
+
+///////////////////////////////////////////////////////////////////////////////
+
+static constexpr char BundleMagic[8] = { 'G', 'I', 'P', 'S', 'B', 'N', 'D', 'L' };
+static constexpr uint32_t BundleVersion = 3;
+
+static std::string getDriverID() {
+    std::string id;
+    for (GLenum e : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+        const char* s = reinterpret_cast<const char*>(glGetString(e));
+        id += s ? s : "?";
+        id.push_back('\n');
+    }
+    return id;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+class BundleWriter {
+    std::string& m_out;
+public:
+    inline explicit BundleWriter(std::string& out) : m_out(out) {}
+    inline void u32(uint32_t x) {
+        for (int i = 0;  i < 4;  ++i) { m_out.push_back(char(uint8_t(x >> (i * 8)))); }
+    }
+    inline void i32(int32_t x) { u32(uint32_t(x)); }
+    inline void f32(float x) { uint32_t u; memcpy(&u, &x, 4); u32(u); }
+    inline void str(const std::string& s) { u32(uint32_t(s.size())); m_out += s; }
+};
+
+class BundleReader {
+    const uint8_t* m_pos;
+    const uint8_t* m_end;
+    bool m_ok = true;
+public:
+    inline BundleReader(const char* data, size_t size)
+        : m_pos(reinterpret_cast<const uint8_t*>(data)), m_end(m_pos + size) {}
+    inline bool good() const { return m_ok; }
+    inline bool need(size_t n) {
+        if (m_ok && (size_t(m_end - m_pos) >= n)) { return true; }
+        m_ok = false;
+        return false;
+    }
+    inline void skip(size_t n) { if (need(n)) { m_pos += n; } }
+    inline uint32_t u32() {
+        if (!need(4)) { return 0; }
+        uint32_t x = uint32_t(m_pos[0]) | (uint32_t(m_pos[1]) << 8) | (uint32_t(m_pos[2]) << 16) | (uint32_t(m_pos[3]) << 24);
+        m_pos += 4;
+        return x;
+    }
+    inline int32_t i32() { return int32_t(u32()); }
+    inline float f32() { uint32_t u = u32(); float x; memcpy(&x, &u, 4); return x; }
+    inline std::string str() {
+        size_t len = u32();
+        if (!need(len)) { return std::string(); }
+        std::string s(reinterpret_cast<const char*>(m_pos), len);
+        m_pos += len;
+        return s;
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool Pipeline::isBundle(const char* data, size_t size) {
+    return data && (size >= sizeof(BundleMagic)) && !memcmp(data, BundleMagic, sizeof(BundleMagic));
+}
+
+std::string Pipeline::serializeBundle(int showIndex) {
+    std::string out(BundleMagic, sizeof(BundleMagic));
+    BundleWriter w(out);
+    bool withBinaries = GLutil::haveProgramBinaries();
+    w.u32(BundleVersion);
+    w.str(withBinaries ? getDriverID() : std::string());
+    w.i32(showIndex);
+    w.u32(uint32_t(m_nodes.size()));
+
+    for (const Node* node : m_nodes) {
+        w.str(node->m_name);
+        w.str(node->m_filename);
+        w.str(node->m_errors);
+        w.u32((node->m_enabled ? 1u : 0u) | (node->m_generator ? 2u : 0u));
+        w.u32(uint32_t(node->m_preferredFormat));
+        w.i32(node->m_channels);
+
+        w.u32(uint32_t(node->m_params.size()));
+        for (const auto& p : node->m_params) {
+            w.str(p.m_name);
+            w.str(p.m_desc);
+            w.str(p.m_format);
+            w.u32(uint32_t(p.m_type));
+            w.i32(p.m_digits);
+            w.f32(p.m_minValue);
+            w.f32(p.m_maxValue);
+            for (int i = 0;  i < 4;  ++i) { w.f32(p.m_value[i]); }
+            for (int i = 0;  i < 4;  ++i) { w.f32(p.m_defaultValue[i]); }
+            w.u32(p.m_hasIdentity ? 1u : 0u);
+            w.f32(p.m_identityValue);
+        }
+
+        w.u32(uint32_t(node->m_passCount));
+        for (int passIndex = 0;  passIndex < node->m_passCount;  ++passIndex) {
+            const auto& pass = node->m_passes[passIndex];
+            w.u32((pass.texFilter ? 1u : 0u) | ((pass.locMap2Tex >= 0) ? 2u : 0u));
+            w.u32(uint32_t(pass.coordMode));
+            w.str(pass.source);
+
+            // the node's own program may not have been linked with the
+            // "retrievable" hint, so link a fresh copy for the binary
+            GLenum binaryFormat = 0;
+            std::string binary;
+            if (withBinaries) {
+                GLutil::Shader fs(GL_FRAGMENT_SHADER, pass.source.c_str());
+                GLutil::Program prog;
+                if (!fs.good() || !prog.link(m_vs, fs, true) || !prog.getBinary(binaryFormat, binary)) {
+                    binaryFormat = 0;
+                    binary.clear();
+                }
+            }
+            w.u32(binaryFormat);
+            w.str(binary);
+        }
+    }
+
+    #ifndef NDEBUG
+        fprintf(stderr, "serialized pipeline into %d-byte bundle (%s program binaries)\n", int(out.size()), withBinaries ? "with" : "without");
+    #endif
+    return out;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+int Pipeline::unserializeBundle(const char* data, size_t size) {
+    if (!isBundle(data, size) || !init()) { return -1; }
+    BundleReader r(data, size);
+    r.skip(sizeof(BundleMagic));
+    if (r.u32() != BundleVersion) { return -1; }
+    bool useBinaries = (r.str() == getDriverID()) && GLutil::haveProgramBinaries();
+    int showIndex = r.i32();
+    uint32_t bundleNodeCount = r.u32();
+    if (!r.good()) { return -1; }
+    #ifndef NDEBUG
+        fprintf(stderr, "loading pipeline bundle with %u nodes (%s program binaries)\n", bundleNodeCount, useBinaries ? "using" : "ignoring");
+    #endif
+    clear();
+
+    for (uint32_t nodeIndex = 0;  r.good() && (nodeIndex < bundleNodeCount);  ++nodeIndex) {
+        Node* node = addNode();
+        if (!node) { return -1; }
+        node->m_bundled = true;
+        node->m_programChanged = true;
+        node->m_passCount = 0;
+        node->m_name     = r.str();
+        node->m_filename = r.str();
+        node->m_errors   = r.str();
+        node->m_loadErrorsLength = node->m_errors.size();
+        uint32_t nodeFlags = r.u32();
+        node->m_enabled   = !!(nodeFlags & 1u);
+        node->m_generator = !!(nodeFlags & 2u);
+        node->m_preferredFormat = static_cast<PixelFormat>(r.u32());
+        node->m_channels = r.i32();
+
+        uint32_t paramCount = r.u32();
+        for (uint32_t i = 0;  r.good() && (i < paramCount);  ++i) {
+            node->m_params.emplace_back();
+            auto& p = node->m_params.back();
+            p.m_name   = r.str();
+            p.m_desc   = r.str();
+            p.m_format = r.str();
+            p.m_type   = static_cast<ParameterType>(r.u32());
+            p.m_digits = r.i32();
+            p.m_minValue = r.f32();
+            p.m_maxValue = r.f32();
+            for (int j = 0;  j < 4;  ++j) { p.m_value[j] = r.f32(); }
+            for (int j = 0;  j < 4;  ++j) { p.m_defaultValue[j] = r.f32(); }
+            p.m_hasIdentity   = !!r.u32();
+            p.m_identityValue = r.f32();
+        }
+
+        uint32_t passCount = r.u32();
+        if (passCount > uint32_t(MaxPasses)) { return -1; }
+        for (int passIndex = 0;  r.good() && (passIndex < int(passCount));  ++passIndex) {
+            auto& pass = node->m_passes[passIndex];
+            uint32_t flags = r.u32();
+            pass.texFilter = !!(flags & 1u);
+            pass.coordMode = static_cast<CoordMapMode>(r.u32());
+            pass.source = r.str();
+            GLenum binaryFormat = r.u32();
+            std::string binary = r.str();
+            if (!r.good()) { break; }
+            if (!useBinaries) { binaryFormat = 0; }
+            if (!node->setupBundledPass(passIndex, m_vs, !!(flags & 2u), binaryFormat, binary)) { break; }
+            node->m_passCount = passIndex + 1;
+        }
+    }
+    if (!r.good()) { return -1; }
+    return ((showIndex >= 0) && (showIndex <= nodeCount())) ? showIndex : nodeCount();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool Node::setupBundledPass(int passIndex, const GLutil::Shader& vs, bool coordInput, GLenum binaryFormat, const std::string& binary) {
+    auto& pass = m_passes[passIndex];
+    GLutil::Program& prog = pass.program;
+
+    // try the program binary first, fall back to compiling the source code
+    if (!binaryFormat || !prog.loadBinary(binaryFormat, binary.data(), int(binary.size()))) {
+        #ifndef NDEBUG
+            if (binaryFormat) { fprintf(stderr, "program binary for '%s' pass %d rejected, recompiling\n", m_name.c_str(), passIndex + 1); }
+        #endif
+        GLutil::Shader fs(GL_FRAGMENT_SHADER, pass.source.c_str());
+        if (fs.haveLog()) { m_errors += fs.getLog(); m_errors += "\n"; }
+        if (!fs.good()) { return false; }
+        prog.link(vs, fs);
+        if (prog.haveLog()) { m_errors += prog.getLog(); m_errors += "\n"; }
+        if (!prog.good()) { return false; }
+    }
+
+    // get uniform locations
+    prog.use();
+    GLutil::checkError("bundled node setup");
+    glUniform4f(prog.getUniformLocation("gips_pos2ndc"), -1.0f, -1.0f, 2.0f, 2.0f);
+    pass.locImageSize = prog.getUniformLocation("gips_image_size");
+    pass.locRel2Map = prog.getUniformLocation("gips_rel2map");
+    pass.locMap2Tex = coordInput ? prog.getUniformLocation("gips_map2tex") : (-1);
+    pass.locPackAlpha = prog.getUniformLocation("gips_pack_alpha");
+    for (auto& p : m_params) {
+        p.m_location[passIndex] = prog.getUniformLocation(p.m_name.c_str());
+    }
+    GLutil::checkError("bundled node uniform lookup");
+    glUseProgram(0);
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+}  // namespace GIPS
@@ -0,0 +1,272 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "file_util.h"
+#include "hash_util.h"
+#include "string_util.h"
+
+#include "gips_context.h"
+#include "gips_cache.h"
+
+namespace GIPS {
+
+///////////////////////////////////////////////////////////////////////////////
+
+static const char* const CacheFileExt = ".gipsc";
+constexpr size_t KeyChars = 32;
+
+uint64_t hashImage(const ImageBuffer& image, uint64_t seed) {
+    // always chained row by row in top-down order, so that the hash only
+    // depends on the pixels and not on the buffer's layout
+    uint64_t h = seed;
+    for (int y = 0;  y < image.height;  ++y) {
+        int row = image.bottomUp ? (image.height - 1 - y) : y;
+        h = HashUtil::hash64(static_cast<const uint8_t*>(image.data) + size_t(row) * image.rowPitch(), image.rowSize(), h);
+    }
+    return h;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+CacheKey makeFileRenderKey(const void* inData, size_t inSize, const std::string& signature, PixelFormat format, const char* outFile) {
+    std::string setup = signature + "\nfmt=" + std::to_string(static_cast<int>(format))
+                      + "\nout=" + StringUtil::pathExt(outFile);
+    CacheKey key;
+    key.content = HashUtil::hash64(inData, inSize);
+    key.setup = HashUtil::hash64(setup.data(), setup.size());
+    return key;
+}
+
+std::string makeFileRenderEntry(const void* fileData, size_t fileSize, int width, int height) {
+    std::string entry(8, '\0');
+    int32_t size[2] = { width, height };
+    memcpy(&entry[0], size, 8);
+    entry.append(static_cast<const char*>(fileData), fileSize);
+    return entry;
+}
+
+bool restoreFileRenderEntry(const std::string& entry, const char* outFile, int& width, int& height) {
+    if (entry.size() <= 8) { return false; }
+    FILE* f = fopen(outFile, "wb");
+    bool ok = f && (fwrite(&entry[8], 1, entry.size() - 8, f) == (entry.size() - 8));
+    ok = f && !fclose(f) && ok;
+    if (!ok) { return false; }
+    int32_t size[2];
+    memcpy(size, entry.data(), 8);
+    width = size[0];
+    height = size[1];
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+std::string CacheKey::toString() const {
+    char buf[KeyChars + 1];
+    snprintf(buf, sizeof(buf), "%016llx%016llx",
+             static_cast<unsigned long long>(content), static_cast<unsigned long long>(setup));
+    return buf;
+}
+
+bool CacheKey::fromString(const char* str) {
+    uint64_t v[2] = { 0, 0 };
+    for (size_t i = 0;  i < KeyChars;  ++i) {
+        char c = str[i];
+        int d = ((c >= '0') && (c <= '9')) ? (c - '0')
+              : ((c >= 'a') && (c <= 'f')) ? (c - 'a' + 10) : -1;
+        if (d < 0) { return false; }
+        v[i / 16] = (v[i / 16] << 4) | uint64_t(d);
+    }
+    content = v[0];
+    setup = v[1];
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+std::string ResultCache::diskPath(const CacheKey& key) const {
+    return m_diskDir + "/" + key.toString() + CacheFileExt;
+}
+
+void ResultCache::setMemoryLimit(size_t bytes) {
+    m_memoryLimit = bytes;
+    evictMemory(0);
+}
+
+bool ResultCache::setDiskTier(const char* dir, uint64_t limit) {
+    m_disk.clear();
+    m_diskUsed = 0;
+    m_diskDir.clear();
+    m_diskLimit = 0;
+    if (!dir || !dir[0]) { return true; }
+    FileUtil::Directory d(dir);
+    if (!d.good()) { return false; }
+    m_diskDir = dir;
+    while (!m_diskDir.empty() && ((m_diskDir.back() == '/') || (m_diskDir.back() == '\\'))) { m_diskDir.pop_back(); }
+    m_diskLimit = limit;
+
+    // pick up the entries of earlier runs; their modification times
+    // determine the initial LRU order
+    struct Found { CacheKey key; uint64_t size; uint64_t mtime; };
+    std::vector<Found> found;
+    while (d.nextNonDot()) {
+        const char* name = d.currentItemName();
+        if (!name || (strlen(name) != (KeyChars + strlen(CacheFileExt))) || strcmp(&name[KeyChars], CacheFileExt)) { continue; }
+        Found f;
+        if (!f.key.fromString(name)) { continue; }
+        FileUtil::FileFingerprint fp((m_diskDir + "/" + name).c_str());
+        if (!fp.good()) { continue; }
+        f.size = fp.size();
+        f.mtime = fp.mtime();
+        found.push_back(f);
+    }
+    std::sort(found.begin(), found.end(), [] (const Found& a, const Found& b) { return a.mtime < b.mtime; });
+    for (const auto& f : found) {
+        DiskEntry& e = m_disk[f.key];
+        e.size = f.size;
+        e.lastUse = ++m_clock;
+        m_diskUsed += f.size;
+    }
+    #ifndef NDEBUG
+        fprintf(stderr, "result cache: %d entries (%llu bytes) found in '%s'\n", int(m_disk.size()),
+                static_cast<unsigned long long>(m_diskUsed), m_diskDir.c_str());
+    #endif
+    evictDisk(0);
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void ResultCache::evictMemory(size_t needed) {
+    while (!m_memory.empty() && ((m_memoryUsed + needed) > m_memoryLimit)) {
+        auto oldest = m_memory.begin();
+        for (auto it = m_memory.begin();  it != m_memory.end();  ++it) {
+            if (it->second.lastUse < oldest->second.lastUse) { oldest = it; }
+        }
+        m_memoryUsed -= oldest->second.data.size();
+        m_memory.erase(oldest);
+        ++m_stats.evictions;
+    }
+}
+
+void ResultCache::evictDisk(uint64_t needed) {
+    while (!m_disk.empty() && ((m_diskUsed + needed) > m_diskLimit)) {
+        auto oldest = m_disk.begin();
+        for (auto it = m_disk.begin();  it != m_disk.end();  ++it) {
+            if (it->second.lastUse < oldest->second.lastUse) { oldest = it; }
+        }
+        remove(diskPath(oldest->first).c_str());
+        m_diskUsed -= oldest->second.size;
+        m_disk.erase(oldest);
+        ++m_stats.evictions;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+const std::string* ResultCache::lookup(const CacheKey& key) {
+    auto mem = m_memory.find(key);
+    if (mem != m_memory.end()) {
+        mem->second.lastUse = ++m_clock;
+        ++m_stats.hits;
+        return &mem->second.data;
+    }
+
+    auto disk = m_disk.find(key);
+    if (disk != m_disk.end()) {
+        FileUtil::MappedFile f;
+        if (f.open(diskPath(key).c_str()) && (f.size() == disk->second.size)) {
+            disk->second.lastUse = ++m_clock;
+            ++m_stats.diskHits;
+            std::string data(static_cast<const char*>(f.data()), f.size());
+            if (data.size() <= m_memoryLimit) {
+                evictMemory(data.size());
+                MemoryEntry& e = m_memory[key];
+                e.data.swap(data);
+                e.lastUse = m_clock;
+                m_memoryUsed += e.data.size();
+                return &e.data;
+            }
+            m_diskData.swap(data);
+            return &m_diskData;
+        }
+        // the file has vanished or changed behind our back
+        m_diskUsed -= disk->second.size;
+        m_disk.erase(disk);
+    }
+    ++m_stats.misses;
+    return nullptr;
+}
+
+bool ResultCache::storeOnDisk(const CacheKey& key, const void* data, size_t size) {
+    // write into a temporary file first, so that an interrupted write
+    // can't leave a truncated entry behind
+    std::string path = diskPath(key);
+    std::string tempPath = path + ".tmp";
+    FILE* f = fopen(tempPath.c_str(), "wb");
+    if (!f) { return false; }
+    bool ok = (fwrite(data, 1, size, f) == size);
+    ok = !fclose(f) && ok;
+    remove(path.c_str());  // rename() doesn't replace existing files everywhere
+    if (!ok || rename(tempPath.c_str(), path.c_str())) {
+        remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+void ResultCache::store(const CacheKey& key, const void* data, size_t size) {
+    if (!data || !size) { return; }
+    bool stored = false;
+    if (size <= m_memoryLimit) {
+        auto old = m_memory.find(key);
+        if (old != m_memory.end()) {
+            m_memoryUsed -= old->second.data.size();
+            m_memory.erase(old);
+        }
+        evictMemory(size);
+        MemoryEntry& e = m_memory[key];
+        e.data.assign(static_cast<const char*>(data), size);
+        e.lastUse = ++m_clock;
+        m_memoryUsed += size;
+        stored = true;
+    }
+    if (!m_diskDir.empty() && (uint64_t(size) <= m_diskLimit)) {
+        auto old = m_disk.find(key);
+        if (old != m_disk.end()) {
+            m_diskUsed -= old->second.size;
+            m_disk.erase(old);
+        }
+        evictDisk(size);
+        if (storeOnDisk(key, data, size)) {
+            DiskEntry& e = m_disk[key];
+            e.size = size;
+            e.lastUse = ++m_clock;
+            m_diskUsed += size;
+            stored = true;
+        }
+    }
+    if (stored) { ++m_stats.stores; }
+}
+
+void ResultCache::clear() {
+    for (const auto& entry : m_disk) {
+        remove(diskPath(entry.first).c_str());
+    }
+    m_disk.clear();
+    m_diskUsed = 0;
+    m_memory.clear();
+    m_memoryUsed = 0;
+    m_diskData.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+}  // namespace GIPS
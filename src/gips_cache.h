@@ -0,0 +1,121 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+// Content-addressed cache for render results: entries are keyed by hashes
+// of the input data and of everything else that determines the result
+// (pipeline, parameters, shader code, formats). There's a memory tier and
+// an optional disk tier, both limited in size and evicted least recently
+// used first; entries that are found on disk are promoted into memory.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <string>
+#include <map>
+
+#include "gips_context.h"
+
+namespace GIPS {
+
+///////////////////////////////////////////////////////////////////////////////
+
+//! hash the pixels of a host-memory image (excluding row padding); the
+//! result is independent of the row pitch and orientation of the buffer
+uint64_t hashImage(const ImageBuffer& image, uint64_t seed=0);
+
+struct CacheKey {
+    uint64_t content = 0;  //!< hash of the input data
+    uint64_t setup = 0;    //!< hash of everything else that affects the result
+
+    inline bool operator< (const CacheKey& other) const {
+        return (content < other.content) || ((content == other.content) && (setup < other.setup));
+    }
+    //! 32 hex digits, used as the file name in the disk tier
+    std::string toString() const;
+    bool fromString(const char* str);
+};
+
+//! key of a file-to-file render: the input file's contents (not its decoded
+//! pixels, so hits don't need to decode anything), the pipeline's render
+//! signature (see Context::renderSignature()), the requested pixel format
+//! and the output file type
+CacheKey makeFileRenderKey(const void* inData, size_t inSize, const std::string& signature, PixelFormat format, const char* outFile);
+
+//! cache entry of a file-to-file render: the image size (two int32 values),
+//! followed by the complete output file
+std::string makeFileRenderEntry(const void* fileData, size_t fileSize, int width, int height);
+
+//! write the output file of a file-to-file render entry
+//! \returns false if the entry is malformed or the file can't be written
+bool restoreFileRenderEntry(const std::string& entry, const char* outFile, int& width, int& height);
+
+class ResultCache {
+public:
+    struct Stats {
+        uint64_t hits       = 0;  //!< lookups served from memory
+        uint64_t diskHits   = 0;  //!< lookups served from disk
+        uint64_t misses     = 0;
+        uint64_t stores     = 0;
+        uint64_t evictions  = 0;
+    };
+
+private:
+    struct MemoryEntry {
+        std::string data;
+        uint64_t lastUse = 0;
+    };
+    struct DiskEntry {
+        uint64_t size = 0;
+        uint64_t lastUse = 0;
+    };
+    std::map<CacheKey, MemoryEntry> m_memory;
+    std::map<CacheKey, DiskEntry> m_disk;
+    size_t   m_memoryLimit = 0;
+    size_t   m_memoryUsed  = 0;
+    uint64_t m_diskLimit   = 0;
+    uint64_t m_diskUsed    = 0;
+    std::string m_diskDir;
+    std::string m_diskData;  //!< disk hit, if the memory tier is disabled
+    uint64_t m_clock = 0;    //!< use counter for LRU eviction
+    Stats m_stats;
+
+    std::string diskPath(const CacheKey& key) const;
+    void evictMemory(size_t needed);
+    void evictDisk(uint64_t needed);
+    bool storeOnDisk(const CacheKey& key, const void* data, size_t size);
+
+public:
+    //! set the size limit of the memory tier in bytes (0 = disabled)
+    void setMemoryLimit(size_t bytes);
+    //! enable the disk tier in an existing directory, picking up entries
+    //! from earlier runs; a null or empty directory disables it
+    bool setDiskTier(const char* dir, uint64_t limit);
+
+    inline bool enabled() const { return m_memoryLimit || !m_diskDir.empty(); }
+
+    //! look up an entry; \returns the cached data (valid until the next
+    //! call of a non-const method), or nullptr if there's no such entry
+    const std::string* lookup(const CacheKey& key);
+    //! put an entry into all tiers it fits into
+    void store(const CacheKey& key, const void* data, size_t size);
+    //! remove all entries, including those on disk
+    void clear();
+
+    inline const Stats& stats()         const { return m_stats; }
+    inline size_t       memoryUsed()    const { return m_memoryUsed; }
+    inline size_t       memoryLimit()   const { return m_memoryLimit; }
+    inline int          memoryEntries() const { return int(m_memory.size()); }
+    inline uint64_t     diskUsed()      const { return m_diskUsed; }
+    inline uint64_t     diskLimit()     const { return m_diskLimit; }
+    inline int          diskEntries()   const { return int(m_disk.size()); }
+    inline const char*  diskDir()       const { return m_diskDir.c_str(); }
+
+    inline ResultCache() {}
+    ResultCache(const ResultCache&) = delete;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+}  // namespace GIPS
@@ -0,0 +1,379 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+#include "gl_header.h"
+#include "gl_util.h"
+
+#include "string_util.h"
+#include "file_util.h"
+#include "image_util.h"
+#include "buffer_pool.h"
+#include "thread_pool.h"
+
+#include "gips_paths.h"
+#include "gips_context.h"
+#include "gips_memory.h"
+#include "gips_cache.h"
+#include "gips_pnm.h"
+#include "gips_cli.h"
+
+namespace GIPS {
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool HeadlessContext::initHeadless(const char* title) {
+    if (!glfwInit()) {
+        const char* err = "unknown error";
+        glfwGetError(&err);
+        fprintf(stderr, "glfwInit failed: %s\n", err);
+        return false;
+    }
+
+    // create an invisible window, just for the sake of getting a GL context
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    #ifndef NDEBUG
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
+    #endif
+    m_window = glfwCreateWindow(64, 64, title, nullptr, nullptr);
+    if (m_window == nullptr) {
+        const char* err = "unknown error";
+        glfwGetError(&err);
+        fprintf(stderr, "glfwCreateWindow failed: %s\n", err);
+        return false;
+    }
+    glfwMakeContextCurrent(m_window);
+
+    if (!init(reinterpret_cast<GetProcAddressFunc>(glfwGetProcAddress))) {
+        fprintf(stderr, "%s\n", error());
+        return false;
+    }
+    GLutil::enableDebugMessages();
+    return true;
+}
+
+void HeadlessContext::doneHeadless() {
+    if (m_window) {
+        done();
+        GLutil::done();
+        glfwDestroyWindow(m_window);
+        m_window = nullptr;
+    }
+    glfwTerminate();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+namespace CLI {
+
+bool isCommand(const char* arg) {
+    return arg && (!strcmp(arg, "--bundle") || !strcmp(arg, "--render"));
+}
+
+static int usage() {
+    fprintf(stderr,
+        "Usage:\n"
+        "  gips --bundle <pipeline.gips> [-o <pipeline.gipsb>]\n"
+        "      create a precompiled pipeline bundle\n"
+        "  gips --render <pipeline.gips> <input> -o <output> [-f <format>] [-t <node>]...\n"
+        "      process an image; each -t option additionally saves the output of\n"
+        "      a node (1-based) into <output>.tap<node>.<ext>, in the same render\n"
+        "      options: --cache <dir> [--cache-size <MiB>]\n"
+        "      reuse earlier results from (and store new results in) a cache\n"
+        "      directory; inputs are identified by the contents of the files\n"
+        "Common options:\n"
+        "  -j <threads>  number of CPU threads to use (default: all cores)\n"
+        "  --gpu-budget <MiB>, --host-budget <MiB>\n"
+        "      refuse jobs that would need more video or host image memory\n"
+        "  --mem-stats   report current and peak memory usage at exit\n");
+    return 2;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+//! image file to be written; PNM-family files receive the pixels in (up
+//! to) the processing precision directly in a mapping of the file,
+//! everything else is collected as 8-bit RGBA and encoded when saving
+class OutputFile {
+    std::string m_filename;
+    FileUtil::MappedFile m_file;
+    uint8_t* m_data = nullptr;
+public:
+    ImageBuffer image;
+
+    bool create(const char* filename, int width, int height, PixelFormat format) {
+        m_filename = filename;
+        image = ImageBuffer(nullptr, width, height, format);
+        std::string header = makePNMHeader(filename, image);
+        if (!header.empty()) {
+            if (!m_file.create(filename, header.size() + image.dataSize())) { return false; }
+            uint8_t* fileData = static_cast<uint8_t*>(m_file.data());
+            memcpy(fileData, header.data(), header.size());
+            image.data = &fileData[header.size()];
+            return true;
+        }
+        size_t size = size_t(width) * size_t(height) * 4u;
+        if (!Memory::fitsHost(size)) {
+            fprintf(stderr, "%s: output image would exceed the host memory budget\n", filename);
+            return false;
+        }
+        m_data = static_cast<uint8_t*>(BufferPool::alloc(size));
+        image = ImageBuffer(m_data, width, height);
+        return (m_data != nullptr);
+    }
+    bool save() {
+        if (m_file.good()) { m_file.close(); return true; }
+        return m_data && ImageUtil::save(m_filename.c_str(), m_data, image.width, image.height);
+    }
+    void discard() {
+        if (m_file.good()) { m_file.close(); remove(m_filename.c_str()); }
+    }
+    inline const char* filename() const { return m_filename.c_str(); }
+
+    inline OutputFile() {}
+    OutputFile(const OutputFile&) = delete;
+    inline ~OutputFile() { BufferPool::release(m_data); }
+};
+
+//! disk-cached render results; entries consist of the image size
+//! and the complete output file
+class RenderCache {
+    ResultCache m_cache;
+    CacheKey m_key;
+public:
+    bool open(const char* dir, int sizeMiB) {
+        if (!m_cache.setDiskTier(dir, uint64_t(sizeMiB) << 20)) {
+            fprintf(stderr, "%s: can't open cache directory\n", dir);
+            return false;
+        }
+        return true;
+    }
+    inline bool enabled() const { return m_cache.enabled(); }
+
+    //! compute the key of a render and copy a cached result into the
+    //! output file, if there is one
+    bool restore(const void* inData, size_t inSize, const std::string& signature, PixelFormat format, const char* outFile) {
+        m_key = makeFileRenderKey(inData, inSize, signature, format, outFile);
+        const std::string* hit = m_cache.lookup(m_key);
+        int width = 0, height = 0;
+        if (!hit || !restoreFileRenderEntry(*hit, outFile, width, height)) { return false; }
+        printf("%s: %dx%d (cached)\n", outFile, width, height);
+        return true;
+    }
+
+    //! put a freshly written output file into the cache
+    void store(const char* outFile, int width, int height) {
+        FileUtil::MappedFile f;
+        if (!f.open(outFile)) { return; }
+        std::string entry = makeFileRenderEntry(f.data(), f.size(), width, height);
+        m_cache.store(m_key, entry.data(), entry.size());
+    }
+};
+
+static int runRender(const char* pipelineFile, const char* inFile, const char* outFile, const std::vector<int>& tapNodes, PixelFormat format,
+                     const char* cacheDir, int cacheSizeMiB) {
+    if (!outFile) { return usage(); }
+    HeadlessContext ctx;
+    if (!ctx.initHeadless("GIPS Renderer")) { return 1; }
+    if (!ctx.loadPipeline("main", pipelineFile)) {
+        fprintf(stderr, "%s: %s\n", pipelineFile, ctx.error());
+        return 1;
+    }
+
+    // look up the result cache (only for plain renders without taps);
+    // the key covers the input file's contents, all of the pipeline's
+    // code and parameters, the pixel format and the output file type
+    FileUtil::MappedFile inMap;
+    RenderCache cache;
+    if (cacheDir && tapNodes.empty()) {
+        if (!cache.open(cacheDir, cacheSizeMiB)) { return 1; }
+        if (!inMap.open(inFile)) {
+            fprintf(stderr, "%s: failed to read input image\n", inFile);
+            return 1;
+        }
+        if (cache.restore(inMap.data(), inMap.size(), ctx.renderSignature("main"), format, outFile)) { return 0; }
+    }
+
+    // load the input image; PNM-family files are used in place
+    uint8_t* inData = nullptr;
+    ImageBuffer input;
+    if (!isPNMFile(inFile) || !(inMap.good() || inMap.open(inFile)) || !parsePNM(inMap.data(), inMap.size(), input)) {
+        inMap.close();
+        int width = 0, height = 0;
+        inData = ImageUtil::load(inFile, width, height);
+        if (!inData) {
+            fprintf(stderr, "%s: failed to read input image\n", inFile);
+            return 1;
+        }
+        input = ImageBuffer(inData, width, height);
+    }
+
+    // set up the result and tap outputs, all in the same file format
+    PixelFormat outFormat = (format == PixelFormat::DontCare) ? input.format : combinePixelFormats(input.format, format);
+    std::vector<std::unique_ptr<OutputFile>> outputs;
+    std::vector<TapImage> taps;
+    bool ok = true;
+    for (int i = -1;  ok && (i < int(tapNodes.size()));  ++i) {
+        std::string filename = (i < 0) ? std::string(outFile) : makeTapFilename(outFile, tapNodes[size_t(i)]);
+        outputs.emplace_back(new(std::nothrow) OutputFile);
+        ok = outputs.back() && outputs.back()->create(filename.c_str(), input.width, input.height, outFormat);
+        if (!ok) { fprintf(stderr, "%s: failed to create output image\n", filename.c_str()); }
+        else if (i >= 0) { taps.emplace_back(tapNodes[size_t(i)], outputs.back()->image); }
+    }
+
+    // process everything in a single render, then save the files
+    if (ok && !ctx.render("main", input, outputs[0]->image, taps, format)) {
+        fprintf(stderr, "%s: %s\n", inFile, ctx.error());
+        ok = false;
+    }
+    BufferPool::release(inData);
+    inMap.close();
+    for (auto& out : outputs) {
+        if (!out) { continue; }
+        if (!ok) { out->discard(); continue; }
+        if (!out->save()) {
+            fprintf(stderr, "%s: failed to write output image\n", out->filename());
+            ok = false;
+        } else {
+            printf("%s: %dx%d\n", out->filename(), input.width, input.height);
+        }
+    }
+    if (ok && cache.enabled()) { cache.store(outFile, input.width, input.height); }
+    return ok ? 0 : 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+static int runBundle(const char* inFile, const char* outFile) {
+    std::string outName;
+    if (!outFile) {
+        // derive the output file name from the input file name
+        int extPos = StringUtil::pathExtStartIndex(inFile);
+        outName = std::string(inFile, size_t(extPos)) + ".gipsb";
+        outFile = outName.c_str();
+    }
+
+    HeadlessContext ctx;
+    if (!ctx.initHeadless("GIPS Bundler")) { return 1; }
+    if (!ctx.loadPipeline("main", inFile)) {
+        fprintf(stderr, "%s: %s\n", inFile, ctx.error());
+        return 1;
+    }
+    const Pipeline& p = *ctx.pipeline("main");
+    for (int i = 0;  i < p.nodeCount();  ++i) {
+        if (p.node(i).hasErrors()) {
+            fprintf(stderr, "warnings for node %d (%s):\n%s", i + 1, p.node(i).name(), p.node(i).errors());
+        }
+    }
+    if (!ctx.saveBundle("main", outFile)) {
+        fprintf(stderr, "%s: %s\n", outFile, ctx.error());
+        return 1;
+    }
+    printf("%s: %d nodes%s\n", outFile, p.nodeCount(), GLutil::haveProgramBinaries() ? ", including program binaries" : "");
+    return 0;
+}
+
+int run(int argc, char* argv[]) {
+    const char* command = nullptr;
+    const char* inFile = nullptr;
+    const char* imageFile = nullptr;
+    const char* outFile = nullptr;
+    const char* cacheDir = nullptr;
+    int cacheSizeMiB = 1024;
+    int threads = 0;
+    int gpuBudgetMiB = 0, hostBudgetMiB = 0;
+    bool memStats = false;
+    std::vector<int> taps;
+    PixelFormat format = PixelFormat::DontCare;
+    for (int i = 1;  i < argc;  ++i) {
+        const char* arg = argv[i];
+        if (isCommand(arg)) {
+            if (command) { return usage(); }
+            command = arg;
+        } else if (!strcmp(arg, "-o") && ((i + 1) < argc)) {
+            outFile = argv[++i];
+        } else if (!strcmp(arg, "-t") && ((i + 1) < argc)) {
+            int node = atoi(argv[++i]);
+            if (node < 1) {
+                fprintf(stderr, "invalid node number '%s'\n", argv[i]);
+                return usage();
+            }
+            taps.push_back(node - 1);
+        } else if (!strcmp(arg, "--cache") && ((i + 1) < argc)) {
+            cacheDir = argv[++i];
+        } else if (!strcmp(arg, "--cache-size") && ((i + 1) < argc)) {
+            cacheSizeMiB = atoi(argv[++i]);
+            if (cacheSizeMiB < 1) {
+                fprintf(stderr, "invalid cache size '%s'\n", argv[i]);
+                return usage();
+            }
+        } else if (!strcmp(arg, "-j") && ((i + 1) < argc)) {
+            threads = atoi(argv[++i]);
+            if (threads < 1) {
+                fprintf(stderr, "invalid thread count '%s'\n", argv[i]);
+                return usage();
+            }
+        } else if ((!strcmp(arg, "--gpu-budget") || !strcmp(arg, "--host-budget")) && ((i + 1) < argc)) {
+            int& budget = !strcmp(arg, "--gpu-budget") ? gpuBudgetMiB : hostBudgetMiB;
+            budget = atoi(argv[++i]);
+            if (budget < 1) {
+                fprintf(stderr, "invalid memory budget '%s'\n", argv[i]);
+                return usage();
+            }
+        } else if (!strcmp(arg, "--mem-stats")) {
+            memStats = true;
+        } else if (!strcmp(arg, "-f") && ((i + 1) < argc)) {
+            format = parsePixelFormat(argv[++i]);
+            if (format == PixelFormat::DontCare) {
+                fprintf(stderr, "unrecognized pixel format '%s'\n", argv[i]);
+                return usage();
+            }
+        } else if ((arg[0] != '-') && !inFile) {
+            inFile = arg;
+        } else if ((arg[0] != '-') && !imageFile) {
+            imageFile = arg;
+        } else {
+            fprintf(stderr, "unrecognized argument '%s'\n", arg);
+            return usage();
+        }
+    }
+    if (!command || !inFile) { return usage(); }
+
+    // register the shader search paths, so that pipelines can refer
+    // to the stock shaders just like in the GUI
+    std::string appDir, uiConfigFile;
+    setupPaths(argv[0], appDir, uiConfigFile);
+    ThreadPool pool(threads);
+    ThreadPool::makeCurrent(&pool);
+    Memory::setBudget(uint64_t(gpuBudgetMiB) << 20, uint64_t(hostBudgetMiB) << 20);
+    int result;
+    if (!strcmp(command, "--render")) {
+        if (!imageFile) { return usage(); }
+        result = runRender(inFile, imageFile, outFile, taps, format, cacheDir, cacheSizeMiB);
+    } else {
+        if (imageFile || !taps.empty() || (format != PixelFormat::DontCare) || cacheDir) { return usage(); }
+        result = runBundle(inFile, outFile);
+    }
+    if (memStats) { fputs(Memory::getReport().c_str(), stderr); }
+    return result;
+}
+
+}  // namespace CLI
+
+///////////////////////////////////////////////////////////////////////////////
+
+}  // namespace GIPS
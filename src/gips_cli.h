@@ -0,0 +1,40 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+#include "gips_context.h"
+
+namespace GIPS {
+
+///////////////////////////////////////////////////////////////////////////////
+
+//! processing context on an invisible GLFW window, for operation without UI
+class HeadlessContext : public Context {
+    GLFWwindow* m_window = nullptr;
+public:
+    //! create the window and initialize the context; errors are reported on stderr
+    bool initHeadless(const char* title);
+    void doneHeadless();
+    inline ~HeadlessContext() { doneHeadless(); }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+//! command-line (non-interactive) operation modes
+namespace CLI {
+
+//! check whether a command-line argument selects a CLI operation mode
+bool isCommand(const char* arg);
+
+//! run a CLI operation; \returns the process exit code
+int run(int argc, char* argv[]);
+
+}  // namespace CLI
+
+///////////////////////////////////////////////////////////////////////////////
+
+}  // namespace GIPS
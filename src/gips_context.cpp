@@ -0,0 +1,471 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <new>
+#include <algorithm>
+#include <string>
+#include <chrono>
+
+#include "gl_header.h"
+#include "gl_util.h"
+#include "string_util.h"
+#include "file_util.h"
+#include "vfs.h"
+
+#include "gips_core.h"
+#include "gips_memory.h"
+#include "gips_context.h"
+
+namespace GIPS {
+
+///////////////////////////////////////////////////////////////////////////////
+
+static bool isValidBuffer(const ImageBuffer& image, bool isOutput) {
+    switch (image.format) {
+        case PixelFormat::Int8:
+        case PixelFormat::RGB10A2:
+        case PixelFormat::Int16:
+        case PixelFormat::R11G11B10F:
+        case PixelFormat::Float16:
+        case PixelFormat::Float32:
+            break;
+        case PixelFormat::RGB9E5:
+            if (isOutput) { return false; }
+            break;
+        default:
+            return false;
+    }
+    if (!image.isPacked()) {
+        if ((image.channels < 1) || (image.channels > 4)) { return false; }
+        if (isOutput && (image.channels == 2)) { return false; }  // no gray+alpha readback in core GL
+    }
+    return image.data && (image.width > 0) && (image.height > 0)
+        && (image.rowPitch() >= image.rowSize())
+        && !(image.rowPitch() % size_t(image.pixelSize()));
+}
+
+//! get the GL pixel data format for an image with less than four channels
+static GLenum getChannelFormat(const ImageBuffer& image, GLenum rgbaFormat) {
+    if (image.isPacked()) { return rgbaFormat; }
+    switch (image.channels) {
+        case 1:  return GL_RED;
+        case 2:  return GL_RG;
+        case 3:  return GL_RGB;
+        default: return rgbaFormat;
+    }
+}
+
+//! copy an image between host memory and a mapped buffer object, flipping
+//! it vertically if the host image is stored bottom-up; the buffer object
+//! always uses the host image's row pitch
+static void copyImage(const ImageBuffer& image, uint8_t* dest, const uint8_t* src, bool toHost) {
+    size_t pitch = image.rowPitch();
+    if (!image.bottomUp && (!toHost || (pitch == image.rowSize()))) {
+        memcpy(dest, src, image.dataSize());
+        return;
+    }
+    // copy row by row to leave the caller's padding bytes alone
+    for (int y = 0;  y < image.height;  ++y) {
+        size_t srcOffset  = size_t(y) * pitch;
+        size_t destOffset = size_t(image.bottomUp ? (image.height - 1 - y) : y) * pitch;
+        memcpy(&dest[destOffset], &src[srcOffset], image.rowSize());
+    }
+}
+
+static inline float msSince(const std::chrono::steady_clock::time_point& t0) {
+    return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool Context::init(GetProcAddressFunc getProcAddress) {
+    if (m_initialized) { return true; }
+    if (getProcAddress) {
+        #ifdef GL_HEADER_IS_GLAD
+            if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(getProcAddress))) {
+                return setError("failed to load OpenGL 3.3 functions");
+            }
+        #else
+            #error no valid GL header / loader
+        #endif
+    }
+    if (!GLutil::init()) {
+        return setError("OpenGL initialization failed");
+    }
+
+    GLutil::clearError();
+    glGenTextures(1, &m_srcTex);
+    glBindTexture(GL_TEXTURE_2D, m_srcTex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glGenBuffers(1, &m_unpackPBO);
+    glGenBuffers(1, &m_packPBO);
+    if (GLutil::checkError("context setup")) {
+        return setError("failed to create OpenGL resources");
+    }
+
+    GLint maxTex, maxVP[2];
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTex);
+    glGetIntegerv(GL_MAX_VIEWPORT_DIMS, maxVP);
+    m_maxImageSize = std::min(maxTex, std::min(maxVP[0], maxVP[1]));
+    m_initialized = true;
+    return true;
+}
+
+void Context::done() {
+    if (!m_initialized) { return; }
+    m_pipelines.clear();
+    m_rawDecoder.free();
+    m_tapReader.free();
+    Memory::untrackTexture(m_srcTex);
+    Memory::untrackBuffer(m_unpackPBO);
+    Memory::untrackBuffer(m_packPBO);
+    if (m_srcTex)    { glDeleteTextures(1, &m_srcTex);   m_srcTex = 0; }
+    if (m_unpackPBO) { glDeleteBuffers(1, &m_unpackPBO); m_unpackPBO = 0; }
+    if (m_packPBO)   { glDeleteBuffers(1, &m_packPBO);   m_packPBO = 0; }
+    m_unpackPBOSize = m_packPBOSize = 0;
+    m_initialized = false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+Context::PipelineSlot* Context::findSlot(const std::string& name) {
+    auto it = m_pipelines.find(name);
+    return (it != m_pipelines.end()) ? it->second.get() : nullptr;
+}
+
+Pipeline* Context::pipeline(const std::string& name) {
+    PipelineSlot* slot = findSlot(name);
+    return slot ? &slot->pipeline : nullptr;
+}
+
+bool Context::loadPipeline(const std::string& name, const char* filename) {
+    m_lastLoadWarm = false;
+    if (!m_initialized) { return setError("context not initialized"); }
+    FileUtil::FileFingerprint fp(filename);
+    if (!fp.good()) { return setError("can't access pipeline file"); }
+
+    auto& slotPtr = m_pipelines[name];
+    if (!slotPtr) {
+        slotPtr.reset(new(std::nothrow) PipelineSlot);
+        if (!slotPtr || !slotPtr->pipeline.init()) {
+            m_pipelines.erase(name);
+            return setError("failed to initialize pipeline");
+        }
+        slotPtr->pipeline.setLinearLight(m_linearLight);
+    }
+    PipelineSlot& slot = *slotPtr;
+
+    if ((slot.filename == filename) && (slot.fp == fp)) {
+        // same pipeline file as before -> only reload shaders that changed on disk
+        slot.pipeline.reload();
+        m_lastLoadWarm = true;
+    } else {
+        int size = 0;
+        char* data = StringUtil::loadTextFile(filename, size);
+        if (!data) {
+            m_pipelines.erase(name);
+            return setError("can't read pipeline file");
+        }
+        int showIndex;
+        if (Pipeline::isBundle(data, size_t(size))) {
+            // precompiled bundle -> no file system lookups needed
+            showIndex = slot.pipeline.unserializeBundle(data, size_t(size));
+        } else {
+            VFS::TemporaryRoot tempRoot(filename);
+            showIndex = slot.pipeline.unserialize(data);
+            tempRoot.end();
+        }
+        ::free(data);
+        if (showIndex < 0) {
+            m_pipelines.erase(name);
+            return setError("invalid pipeline file");
+        }
+        slot.filename = filename;
+        slot.fp = fp;
+        slot.showIndex = showIndex;
+    }
+
+    // check the nodes for fatal errors
+    for (int i = 0;  i < slot.pipeline.nodeCount();  ++i) {
+        const Node& node = slot.pipeline.node(i);
+        if (!node.good()) {
+            slot.filename.clear();  // force a full reload next time
+            return setError("node " + std::to_string(i + 1) + " (" + node.name() + ") failed to load");
+        }
+    }
+    return true;
+}
+
+bool Context::saveBundle(const std::string& name, const char* filename) {
+    PipelineSlot* slot = findSlot(name);
+    if (!slot) { return setError("no such pipeline"); }
+    std::string data = slot->pipeline.serializeBundle(slot->showIndex);
+    FILE* f = fopen(filename, "wb");
+    if (!f) { return setError("can't open output file"); }
+    bool ok = (fwrite(data.data(), 1, data.size(), f) == data.size());
+    ok = !fclose(f) && ok;
+    if (!ok) { return setError("error writing output file"); }
+    return true;
+}
+
+std::string Context::renderSignature(const std::string& name) {
+    PipelineSlot* slot = findSlot(name);
+    if (!slot) { return std::string(); }
+    const Pipeline& p = slot->pipeline;
+    // parameter values go in as their raw bits, as any textual form (like
+    // the one from Pipeline::serialize()) would round them; strings are
+    // prefixed with their length to keep the fields apart
+    std::string sig;
+    auto addInt = [&sig] (uint32_t v) { sig.append(reinterpret_cast<const char*>(&v), sizeof(v)); };
+    auto addString = [&sig, &addInt] (const std::string& s) { addInt(uint32_t(s.size()));  sig += s; };
+    addInt(m_linearLight ? 1u : 0u);
+    addInt(uint32_t(slot->showIndex));
+    addInt(uint32_t(p.nodeCount()));
+    for (int i = 0;  i < p.nodeCount();  ++i) {
+        const Node& node = p.node(i);
+        addInt(node.enabled() ? 1u : 0u);
+        addInt(uint32_t(node.passCount()));
+        for (int pass = 0;  pass < node.passCount();  ++pass) {
+            addString(node.passSource(pass));
+        }
+        addInt(uint32_t(node.paramCount()));
+        for (int j = 0;  j < node.paramCount();  ++j) {
+            const Parameter& param = node.param(j);
+            addString(param.name());
+            sig.append(reinterpret_cast<const char*>(param.value()), 4 * sizeof(float));
+        }
+    }
+    return sig;
+}
+
+bool Context::unloadPipeline(const std::string& name) {
+    if (!m_pipelines.erase(name)) { return setError("no such pipeline"); }
+    return true;
+}
+
+bool Context::setParameter(const std::string& name, int nodeIndex, const char* param, const float* values, int count) {
+    Pipeline* p = pipeline(name);
+    if (!p) { return setError("no such pipeline"); }
+    if ((nodeIndex < 0) || (nodeIndex >= p->nodeCount())) { return setError("invalid node index"); }
+    if ((count < 1) || (count > 4)) { return setError("invalid number of values"); }
+    Node& node = p->node(nodeIndex);
+
+    // ".enabled" pseudo-parameter
+    if (!strcmp(param, ".enabled") || !strcmp(param, ".enable") || !strcmp(param, ".active")) {
+        node.setEnabled(values[0] > 0.5f);
+        return true;
+    }
+
+    // normal parameter
+    Parameter* par = node.findParam(param);
+    if (!par) { return setError("unknown parameter '" + std::string(param) + "'"); }
+    for (int i = 0;  i < count;  ++i) {
+        par->value()[i] = values[i];
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool Context::uploadImage(const ImageBuffer& image) {
+    if (!m_initialized) { return setError("context not initialized"); }
+    if (!isValidBuffer(image, false)) { return setError("invalid input image"); }
+    if ((image.width > m_maxImageSize) || (image.height > m_maxImageSize)) { return setError("input image is too large"); }
+    auto t0 = std::chrono::steady_clock::now();
+    size_t size = image.dataSize();
+
+    GLutil::clearError();
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_unpackPBO);
+    if (size > m_unpackPBOSize) {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, GLsizeiptr(size), nullptr, GL_STREAM_DRAW);
+        Memory::trackBuffer(MemCategory::Staging, m_unpackPBO, size);
+        m_unpackPBOSize = size;
+    }
+    void* pbo = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, GLsizeiptr(size), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (!pbo) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        m_unpackPBOSize = 0;
+        return setError("failed to map upload buffer");
+    }
+    copyImage(image, static_cast<uint8_t*>(pbo), static_cast<const uint8_t*>(image.data), false);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    GLenum texFormat, pixelFormat, dataType;
+    getGLFormat(image.format, texFormat, pixelFormat, dataType);
+    pixelFormat = getChannelFormat(image, pixelFormat);
+    if (m_linearLight && (image.format == PixelFormat::Int8)) {
+        texFormat = GL_SRGB8_ALPHA8;  // let the sampler decode sRGB
+    }
+    static const GLint swizzles[3][4] = {
+        { GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA },  // RGB(A); also resets swizzles left over from a raw image
+        { GL_RED, GL_RED,   GL_RED,  GL_ONE   },  // gray
+        { GL_RED, GL_RED,   GL_RED,  GL_GREEN },  // gray+alpha
+    };
+    int swizzle = (pixelFormat == GL_RED) ? 1 : (pixelFormat == GL_RG) ? 2 : 0;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, GLint(image.rowPitch() / size_t(image.pixelSize())));
+    glPixelStorei(GL_UNPACK_SWAP_BYTES, image.bigEndian ? GL_TRUE : GL_FALSE);  // all supported hosts are little-endian
+    glBindTexture(GL_TEXTURE_2D, m_srcTex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GLint(texFormat), image.width, image.height, 0, pixelFormat, dataType, nullptr);
+    Memory::trackTexture(MemCategory::SourceImage, m_srcTex, image.width, image.height, texFormat);
+    glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzles[swizzle]);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPixelStorei(GL_UNPACK_SWAP_BYTES, GL_FALSE);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (GLutil::checkError("context texture upload")) { return setError("texture upload failed"); }
+    m_lastUploadTime_ms = msSince(t0);
+    return true;
+}
+
+bool Context::uploadRawImage(const RawImage& raw) {
+    if (!m_initialized) { return setError("context not initialized"); }
+    if (!raw.data || !raw.valid()) { return setError("invalid raw input image"); }
+    if ((raw.width > m_maxImageSize) || (raw.height > m_maxImageSize)) { return setError("input image is too large"); }
+    if (!m_rawDecoder.init()) { return setError("failed to initialize raw image decoder"); }
+    auto t0 = std::chrono::steady_clock::now();
+    if (!m_rawDecoder.decode(raw, m_srcTex)) { return setError("raw image upload failed"); }
+    m_lastUploadTime_ms = msSince(t0);
+    return true;
+}
+
+bool Context::downloadImage(GLuint tex, const ImageBuffer& image) {
+    if (!m_initialized) { return setError("context not initialized"); }
+    if (!isValidBuffer(image, true)) { return setError("invalid output image"); }
+    auto t0 = std::chrono::steady_clock::now();
+    size_t size = image.dataSize();
+
+    GLutil::clearError();
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_packPBO);
+    if (size > m_packPBOSize) {
+        glBufferData(GL_PIXEL_PACK_BUFFER, GLsizeiptr(size), nullptr, GL_STREAM_READ);
+        Memory::trackBuffer(MemCategory::Staging, m_packPBO, size);
+        m_packPBOSize = size;
+    }
+    GLenum texFormat, pixelFormat, dataType;
+    getGLFormat(image.format, texFormat, pixelFormat, dataType);
+    pixelFormat = getChannelFormat(image, pixelFormat);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glPixelStorei(GL_PACK_ROW_LENGTH, GLint(image.rowPitch() / size_t(image.pixelSize())));
+    glPixelStorei(GL_PACK_SWAP_BYTES, image.bigEndian ? GL_TRUE : GL_FALSE);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glGetTexImage(GL_TEXTURE_2D, 0, pixelFormat, dataType, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPixelStorei(GL_PACK_SWAP_BYTES, GL_FALSE);
+    glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+    const uint8_t* pbo = static_cast<const uint8_t*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, GLsizeiptr(size), GL_MAP_READ_BIT));
+    if (pbo) {
+        copyImage(image, static_cast<uint8_t*>(image.data), pbo, true);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (!pbo || GLutil::checkError("context texture readback")) { return setError("image retrieval failed"); }
+    m_lastDownloadTime_ms = msSince(t0);
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void Context::setLinearLight(bool enable) {
+    m_linearLight = enable;
+    for (auto& slot : m_pipelines) {
+        slot.second->pipeline.setLinearLight(enable);
+    }
+}
+
+bool Context::checkBudget(const Pipeline& pipeline, const ImageBuffer& input, const ImageBuffer& output, PixelFormat format) {
+    // everything the job needs on the GPU, in place of what's there already
+    // (the source texture and the pipeline's buffers are re-allocated,
+    // the transfer buffers only grow)
+    GLenum texFormat, pixelFormat, dataType;
+    getGLFormat(input.format, texFormat, pixelFormat, dataType);
+    uint64_t required = Memory::textureSize(input.width, input.height, texFormat)
+                      + pipeline.estimateMemoryUsage(input.width, input.height, format)
+                      + std::max(m_unpackPBOSize, input.dataSize())
+                      + std::max(m_packPBOSize, output.dataSize());
+    uint64_t replaced = Memory::trackedTextureSize(m_srcTex) + pipeline.memoryUsage()
+                      + m_unpackPBOSize + m_packPBOSize;
+    if (Memory::fitsGPU(required, replaced)) { return true; }
+    return setError("job needs " + std::to_string((required + 1048575u) >> 20) + " MiB of video memory, which exceeds the budget");
+}
+
+GLuint Context::render(const std::string& name, GLuint srcTex, int width, int height, PixelFormat format) {
+    PipelineSlot* slot = findSlot(name);
+    if (!slot) { setError("no such pipeline"); return 0; }
+    if (!Memory::fitsGPU(slot->pipeline.estimateMemoryUsage(width, height, format), slot->pipeline.memoryUsage())) {
+        setError("intermediate buffers would exceed the video memory budget");
+        return 0;
+    }
+    slot->pipeline.render(srcTex, width, height, format, slot->showIndex);
+    return slot->pipeline.resultTex();
+}
+
+bool Context::render(const std::string& name, const ImageBuffer& input, const ImageBuffer& output, PixelFormat format) {
+    return render(name, input, output, std::vector<TapImage>(), format);
+}
+
+bool Context::render(const std::string& name, const ImageBuffer& input, const ImageBuffer& output, const std::vector<TapImage>& taps, PixelFormat format) {
+    PipelineSlot* slot = findSlot(name);
+    if (!slot) { return setError("no such pipeline"); }
+    if ((output.width != input.width) || (output.height != input.height)) {
+        return setError("output image geometry doesn't match input image");
+    }
+    std::vector<int> tapNodes;
+    for (const auto& tap : taps) {
+        if ((tap.nodeIndex < 0) || (tap.nodeIndex >= slot->showIndex)) {
+            return setError("tap node " + std::to_string(tap.nodeIndex + 1) + " doesn't contribute to the output");
+        }
+        if (!isValidBuffer(tap.image, false) || tap.image.isPacked() || (tap.image.format != taps[0].image.format)) {
+            return setError("invalid tap image");
+        }
+        if ((tap.image.width != input.width) || (tap.image.height != input.height)) {
+            return setError("tap image geometry doesn't match input image");
+        }
+        tapNodes.push_back(tap.nodeIndex);
+    }
+    if (!tapNodes.empty() && !m_tapReader.begin(tapNodes, taps[0].image.format, m_linearLight)) {
+        return setError("unsupported tap image format");
+    }
+
+    // don't lose the input's precision if no format has been requested
+    if (format == PixelFormat::DontCare) {
+        format = combinePixelFormats(slot->pipeline.detectFormat(), getProcessingFormat(input.format));
+    }
+    if (!checkBudget(slot->pipeline, input, output, format)) { return false; }
+    if (!uploadImage(input)) { return false; }
+    slot->pipeline.render(m_srcTex, input.width, input.height, format, slot->showIndex,
+                          tapNodes.empty() ? NodeCallback() : m_tapReader.callback());
+    GLuint result = slot->pipeline.resultTex();
+    if (result) { result = slot->pipeline.expandResult(); }  // readback doesn't honor swizzles
+    if (result && m_linearLight && (output.format == PixelFormat::Int8)) {
+        result = slot->pipeline.encodeResult();
+    }
+    if (!result || !downloadImage(result, output)) { return false; }
+
+    // the taps' readbacks have been queued during the render already,
+    // so they should be complete by now
+    auto t0 = std::chrono::steady_clock::now();
+    for (const auto& tap : taps) {
+        int i = 0;
+        while ((i < m_tapReader.tapCount()) && (m_tapReader.nodeIndex(i) != tap.nodeIndex)) { ++i; }
+        if (!m_tapReader.read(i, tap.image)) {
+            return setError("failed to read back the output of node " + std::to_string(tap.nodeIndex + 1));
+        }
+    }
+    m_lastDownloadTime_ms += msSince(t0);
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+}  // namespace GIPS
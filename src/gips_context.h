@@ -0,0 +1,177 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+// Embedding API of the GIPS engine library (libgips).
+// This header, and everything it includes, is independent of GLFW, ImGui
+// and the GIPS application itself; it only requires an OpenGL 3.3 (core
+// profile) context that has been created and made current by the caller.
+
+#pragma once
+
+#include <cstddef>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+
+#include "gl_header.h"
+#include "file_util.h"
+
+#include "gips_core.h"
+#include "gips_raw.h"
+#include "gips_taps.h"
+
+namespace GIPS {
+
+///////////////////////////////////////////////////////////////////////////////
+
+//! description of an image in host memory; pixels are RGBA by default
+//! (or RGB for the packed formats without alpha, see pixelFormatHasAlpha()),
+//! but the formats with one sample per channel (Int8, Int16, Float16 and
+//! Float32) may also use fewer channels
+struct ImageBuffer {
+    void* data = nullptr;
+    int width = 0;
+    int height = 0;
+    PixelFormat format = PixelFormat::Int8;
+    size_t stride = 0;       //!< distance between rows in bytes; 0 = tightly packed
+    int channels = 4;        //!< 1 = gray, 2 = gray+alpha, 3 = RGB, 4 = RGBA; ignored for packed formats
+    bool bigEndian = false;  //!< byte order of 16- and 32-bit samples
+    bool bottomUp = false;   //!< rows are stored from bottom to top
+
+    inline bool   isPacked() const { return (format == PixelFormat::RGB10A2) || (format == PixelFormat::RGB9E5) || (format == PixelFormat::R11G11B10F); }
+    inline int    pixelSize() const { return isPacked() ? 4 : (getBytesPerPixel(format) / 4 * channels); }
+    inline size_t rowSize()  const { return size_t(width) * size_t(pixelSize()); }
+    inline size_t rowPitch() const { return stride ? stride : rowSize(); }
+    inline size_t dataSize() const { return (height > 0) ? (rowPitch() * size_t(height - 1) + rowSize()) : 0u; }
+
+    inline ImageBuffer() {}
+    inline ImageBuffer(void* data_, int width_, int height_, PixelFormat format_=PixelFormat::Int8, size_t stride_=0)
+        : data(data_), width(width_), height(height_), format(format_), stride(stride_) {}
+};
+
+//! host-memory image that receives the output of an intermediate node
+//! (0-based index) during a render
+struct TapImage {
+    int nodeIndex = 0;
+    ImageBuffer image;
+    inline TapImage() {}
+    inline TapImage(int nodeIndex_, const ImageBuffer& image_) : nodeIndex(nodeIndex_), image(image_) {}
+};
+
+//! function used to look up OpenGL entry points (e.g. glfwGetProcAddress,
+//! eglGetProcAddress or wglGetProcAddress, cast to this type)
+typedef void* (*GetProcAddressFunc)(const char* name);
+
+//! self-contained processing context: owns a set of named pipelines and
+//! the GL resources required to get images in and out of them
+class Context {
+private:
+    struct PipelineSlot {
+        Pipeline pipeline;
+        std::string filename;
+        FileUtil::FileFingerprint fp;
+        int showIndex = 0;
+    };
+    std::map<std::string, std::unique_ptr<PipelineSlot>> m_pipelines;
+    std::string m_error;
+    bool m_initialized = false;
+    bool m_lastLoadWarm = false;
+    bool m_linearLight = false;
+    int m_maxImageSize = 0;
+    GLuint m_srcTex = 0;
+    RawDecoder m_rawDecoder;
+    TapReader m_tapReader;
+    GLuint m_unpackPBO = 0;
+    GLuint m_packPBO = 0;
+    size_t m_unpackPBOSize = 0;
+    size_t m_packPBOSize = 0;
+    float m_lastUploadTime_ms = 0.0f;
+    float m_lastDownloadTime_ms = 0.0f;
+
+    inline bool setError(const char* msg) { m_error = msg; return false; }
+    inline bool setError(const std::string& msg) { m_error = msg; return false; }
+    PipelineSlot* findSlot(const std::string& name);
+    //! check whether a job fits into the video memory budget
+    bool checkBudget(const Pipeline& pipeline, const ImageBuffer& input, const ImageBuffer& output, PixelFormat format);
+
+public:
+    //! initialize the context; the caller's GL context must be current.
+    //! If getProcAddress is null, the GL functions are assumed to be loaded already.
+    bool init(GetProcAddressFunc getProcAddress=nullptr);
+    //! free all GL resources; the caller's GL context must still be current
+    void done();
+
+    inline bool        good()         const { return m_initialized; }
+    inline const char* error()        const { return m_error.c_str(); }
+    inline int         maxImageSize() const { return m_maxImageSize; }
+    inline int         pipelineCount() const { return int(m_pipelines.size()); }
+
+    //! load a pipeline file (.gips) or bundle (.gipsb) under a user-defined
+    //! name; if the same, unchanged file has been loaded under that name
+    //! before, only the modified shaders are reloaded (see lastLoadWasWarm())
+    bool loadPipeline(const std::string& name, const char* filename);
+    inline bool lastLoadWasWarm() const { return m_lastLoadWarm; }
+    bool unloadPipeline(const std::string& name);
+    //! save a loaded pipeline as a precompiled bundle (.gipsb)
+    bool saveBundle(const std::string& name, const char* filename);
+    //! direct access to a loaded pipeline; \returns nullptr if not found
+    Pipeline* pipeline(const std::string& name);
+    //! describe everything besides the input image and processing format
+    //! that determines the result of a pipeline (shown node, enabled
+    //! flags, exact parameter values, generated shader code, linear-light
+    //! mode) as a binary string, e.g. to key a result cache
+    //! \returns an empty string if the pipeline doesn't exist
+    std::string renderSignature(const std::string& name);
+
+    //! set a parameter of a node (0-based index) in a pipeline; missing
+    //! components keep their current value; the pseudo-parameter ".enabled"
+    //! turns the node on or off
+    bool setParameter(const std::string& name, int nodeIndex, const char* param, const float* values, int count);
+
+    //! enable or disable linear-light processing for all pipelines: 8-bit
+    //! images are treated as sRGB-encoded and decoded/encoded by the
+    //! texture hardware, so filters operate on linear values; images with
+    //! higher precision are assumed to be linear already
+    void setLinearLight(bool enable);
+    inline bool linearLight() const { return m_linearLight; }
+
+    //! process a host-memory image through a pipeline into another
+    //! host-memory image of the same size; if no processing format is
+    //! given, the pipeline runs in at least the input's precision
+    bool render(const std::string& name, const ImageBuffer& input, const ImageBuffer& output, PixelFormat format=PixelFormat::DontCare);
+    //! like above, but additionally export the outputs of some nodes before
+    //! the pipeline's output node ("taps") into further host-memory images
+    //! of the same size, all from a single render; the tap images must
+    //! share one unpacked pixel format, but may have any number of channels
+    bool render(const std::string& name, const ImageBuffer& input, const ImageBuffer& output, const std::vector<TapImage>& taps, PixelFormat format=PixelFormat::DontCare);
+    //! process a texture through a pipeline
+    //! \returns the result texture (owned by the pipeline), or 0 on failure;
+    //!          see Pipeline::resultChannels() for narrow results
+    GLuint render(const std::string& name, GLuint srcTex, int width, int height, PixelFormat format=PixelFormat::DontCare);
+
+    //! upload a host-memory image into the context's source texture
+    //! (via a pixel unpack buffer); images with less than four channels are
+    //! presented as RGBA (gray is replicated, missing alpha reads as 1.0)
+    bool uploadImage(const ImageBuffer& image);
+    //! upload raw single-channel sensor data (e.g. a Bayer mosaic) into
+    //! the context's source texture; packed samples are unpacked on the GPU
+    //! and the result is presented as a gray RGBA image
+    bool uploadRawImage(const RawImage& raw);
+    inline GLuint sourceTexture() const { return m_srcTex; }
+    //! read a texture back into a host-memory image (via a pixel pack buffer);
+    //! images with one or three channels receive red or RGB, respectively
+    bool downloadImage(GLuint tex, const ImageBuffer& image);
+
+    inline float lastUploadTime_ms()   const { return m_lastUploadTime_ms; }
+    inline float lastDownloadTime_ms() const { return m_lastDownloadTime_ms; }
+
+    inline Context() {}
+    Context(const Context&) = delete;
+    inline ~Context() { done(); }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+}  // namespace GIPS
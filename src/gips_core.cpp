@@ -17,8 +17,10 @@
 #include "gl_util.h"
 
 #include "file_util.h"
+#include "string_util.h"
 
 #include "gips_core.h"
+#include "gips_memory.h"
 
 namespace GIPS {
 
@@ -38,14 +40,81 @@ int getBytesPerPixel(PixelFormat fmt) {
 
 const char* pixelFormatName(PixelFormat fmt) {
     switch (fmt) {
-        case PixelFormat::DontCare: return "don't care";
-        case PixelFormat::Int16:    return "16-bit integer";
-        case PixelFormat::Float16:  return "16-bit floating point";
-        case PixelFormat::Float32:  return "32-bit floating point";
-        default:                    return "8-bit integer";
+        case PixelFormat::DontCare:   return "don't care";
+        case PixelFormat::RGB10A2:    return "10-bit integer (2-bit alpha)";
+        case PixelFormat::Int16:      return "16-bit integer";
+        case PixelFormat::RGB9E5:     return "9-bit shared exponent (no alpha)";
+        case PixelFormat::R11G11B10F: return "11/11/10-bit floating point (no alpha)";
+        case PixelFormat::Float16:    return "16-bit floating point";
+        case PixelFormat::Float32:    return "32-bit floating point";
+        default:                      return "8-bit integer";
     }
 }
 
+bool pixelFormatHasAlpha(PixelFormat fmt) {
+    return (fmt != PixelFormat::RGB9E5) && (fmt != PixelFormat::R11G11B10F);
+}
+
+PixelFormat getProcessingFormat(PixelFormat fmt) {
+    // RGB9E5 isn't color-renderable; R11G11B10F is the closest match
+    return (fmt == PixelFormat::RGB9E5) ? PixelFormat::R11G11B10F : fmt;
+}
+
+PixelFormat combinePixelFormats(PixelFormat a, PixelFormat b) {
+    if ((a == b) || (b == PixelFormat::DontCare)) { return a; }
+    if (a == PixelFormat::DontCare) { return b; }
+    if ((a == PixelFormat::Float32) || (b == PixelFormat::Float32)) { return PixelFormat::Float32; }
+    // two different integer formats: Int16 covers all of them (RGB10A2 has
+    // more color, but less alpha precision than Int8); anything involving
+    // floats (including the packed ones without alpha) needs Float16
+    auto isInt = [] (PixelFormat f) {
+        return (f == PixelFormat::Int8) || (f == PixelFormat::RGB10A2) || (f == PixelFormat::Int16);
+    };
+    return (isInt(a) && isInt(b)) ? PixelFormat::Int16 : PixelFormat::Float16;
+}
+
+//! get the internal texture format of a single- or dual-channel buffer
+//! with (at least) the precision of a pixel format
+static GLenum getNarrowGLFormat(PixelFormat fmt, int channels) {
+    bool one = (channels < 2);
+    switch (fmt) {
+        case PixelFormat::RGB10A2:
+        case PixelFormat::Int16:      return one ? GL_R16  : GL_RG16;
+        case PixelFormat::RGB9E5:
+        case PixelFormat::R11G11B10F:
+        case PixelFormat::Float16:    return one ? GL_R16F : GL_RG16F;
+        case PixelFormat::Float32:    return one ? GL_R32F : GL_RG32F;
+        default:                      return one ? GL_R8   : GL_RG8;
+    }
+}
+
+void getGLFormat(PixelFormat fmt, GLenum& texFormat, GLenum& pixelFormat, GLenum& dataType) {
+    pixelFormat = GL_RGBA;
+    switch (fmt) {
+        case PixelFormat::RGB10A2:    texFormat = GL_RGB10_A2;       dataType = GL_UNSIGNED_INT_2_10_10_10_REV; break;
+        case PixelFormat::Int16:      texFormat = GL_RGBA16;         dataType = GL_UNSIGNED_SHORT; break;
+        case PixelFormat::RGB9E5:     texFormat = GL_RGB9_E5;        dataType = GL_UNSIGNED_INT_5_9_9_9_REV;    pixelFormat = GL_RGB; break;
+        case PixelFormat::R11G11B10F: texFormat = GL_R11F_G11F_B10F; dataType = GL_UNSIGNED_INT_10F_11F_11F_REV; pixelFormat = GL_RGB; break;
+        case PixelFormat::Float16:    texFormat = GL_RGBA16F;        dataType = GL_HALF_FLOAT;     break;
+        case PixelFormat::Float32:    texFormat = GL_RGBA32F;        dataType = GL_FLOAT;          break;
+        default:                      texFormat = GL_RGBA8;          dataType = GL_UNSIGNED_BYTE;  break;
+    }
+}
+
+PixelFormat parsePixelFormat(const char* name) {
+    static const StringUtil::LookupEntry<PixelFormat> formatMap[] = {
+        { "int8",    PixelFormat::Int8 },    { "8",   PixelFormat::Int8 },    { "i8",   PixelFormat::Int8 },  { "u8", PixelFormat::Int8 },
+        { "int16",   PixelFormat::Int16 },   { "16",  PixelFormat::Int16 },   { "i16",  PixelFormat::Int16 }, { "u16", PixelFormat::Int16 },
+        { "float16", PixelFormat::Float16 }, { "116", PixelFormat::Float16 }, { "f16",  PixelFormat::Float16 }, { "fp16", PixelFormat::Float16 },
+        { "float32", PixelFormat::Float32 }, { "132", PixelFormat::Float32 }, { "f32",  PixelFormat::Float32 }, { "fp32", PixelFormat::Float32 },
+        { "rgb10a2", PixelFormat::RGB10A2 }, { "10",  PixelFormat::RGB10A2 }, { "int10", PixelFormat::RGB10A2 },
+        { "r11g11b10f", PixelFormat::R11G11B10F }, { "111", PixelFormat::R11G11B10F }, { "r11g11b10", PixelFormat::R11G11B10F }, { "float11", PixelFormat::R11G11B10F },
+        { "rgb9e5",  PixelFormat::RGB9E5 },  { "109", PixelFormat::RGB9E5 },
+        { nullptr,   PixelFormat::DontCare },
+    };
+    return StringUtil::lookup(formatMap, name);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 bool Parameter::changed() {
@@ -91,6 +160,7 @@ void Node::reset() {
 }
 
 bool Node::reload(const GLutil::Shader& vs, bool force) {
+    if (m_bundled) { return good(); }  // there's nothing to reload from
     FileUtil::FileFingerprint fp(m_filename.c_str());
     if (!force && (fp == m_fp)) {
         #ifndef NDEBUG
@@ -103,11 +173,39 @@ bool Node::reload(const GLutil::Shader& vs, bool force) {
 
 void Pipeline::reload(bool force) {
     m_pipelineChanged = true;
+    cancelRender();
     for (size_t i = 0;  i < m_nodes.size();  ++i) {
         m_nodes[i]->reload(m_vs, force);
     }
 }
 
+bool Parameter::isIdentity() const {
+    if (!m_hasIdentity) { return false; }
+    int n;
+    switch (m_type) {
+        case ParameterType::Value2: n = 2; break;
+        case ParameterType::Value3:
+        case ParameterType::RGB:    n = 3; break;
+        case ParameterType::Value4:
+        case ParameterType::RGBA:   n = 4; break;
+        default:                    n = 1; break;
+    }
+    for (int i = 0;  i < n;  ++i) {
+        if (m_value[i] != m_identityValue) { return false; }
+    }
+    return true;
+}
+
+bool Node::isIdentity() const {
+    bool haveIdentityParams = false;
+    for (const auto& p : m_params) {
+        if (!p.m_hasIdentity) { continue; }
+        if (!p.isIdentity()) { return false; }
+        haveIdentityParams = true;
+    }
+    return haveIdentityParams;
+}
+
 Parameter* Node::findParam(const char* name) {
     for (size_t i = 0;  i < m_params.size();  ++i) {
         if (!strcmp(name, m_params[i].m_name.c_str())) { return &m_params[i]; }
@@ -116,13 +214,11 @@ Parameter* Node::findParam(const char* name) {
 }
 
 PixelFormat Pipeline::detectFormat() const {
-    PixelFormat fmt = PixelFormat::Int8;
+    PixelFormat fmt = PixelFormat::DontCare;
     for (size_t i = 0;  i < m_nodes.size();  ++i) {
-        if (m_nodes[i]->m_preferredFormat > fmt) {
-            fmt = m_nodes[i]->m_preferredFormat;
-        }
+        fmt = combinePixelFormats(fmt, m_nodes[i]->m_preferredFormat);
     }
-    return fmt;
+    return (fmt == PixelFormat::DontCare) ? PixelFormat::Int8 : fmt;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -139,6 +235,7 @@ Node* Pipeline::addNode(int index) {
     }
     m_nodes[size_t(index)] = n;
     m_pipelineChanged = true;
+    cancelRender();
     return n;
 }
 
@@ -151,6 +248,7 @@ void Pipeline::removeNode(int index) {
     }
     m_nodes.pop_back();
     m_pipelineChanged = true;
+    cancelRender();
 }
 
 void Pipeline::moveNode(int fromIndex, int toIndex) {
@@ -163,6 +261,7 @@ void Pipeline::moveNode(int fromIndex, int toIndex) {
     while (fromIndex > toIndex) { m_nodes[size_t(fromIndex)] = m_nodes[size_t(fromIndex - 1)]; --fromIndex; }
     m_nodes[size_t(toIndex)] = n;
     m_pipelineChanged = true;
+    cancelRender();
 }
 
 void Pipeline::clear() {
@@ -171,16 +270,33 @@ void Pipeline::clear() {
     }
     m_nodes.clear();
     m_pipelineChanged = true;
+    cancelRender();
 }
 
 void Pipeline::free() {
     clear();
     m_fbo.free();
+    m_expandProg.free();
     m_vs.free();
-    if ((m_tex[0] || m_tex[1]) && GLutil::initialized) {
-        glDeleteTextures(2, m_tex);
-        m_tex[0] = m_tex[1] = 0;
+    if (m_tex[0][0] && GLutil::initialized) {
+        glDeleteTextures(BufferSets * 2, &m_tex[0][0]);
+    }
+    Memory::untrackTextures(BufferSets * 2, &m_tex[0][0]);
+    if (m_srgbTex && GLutil::initialized) {
+        glDeleteTextures(1, &m_srgbTex);
     }
+    Memory::untrackTexture(m_srgbTex);
+    m_srgbTex = 0;
+    m_srgbTexWidth = m_srgbTexHeight = 0;
+    for (int set = 0;  set < BufferSets;  ++set) {
+        m_tex[set][0] = m_tex[set][1] = 0;
+        m_texAllocated[set] = false;
+    }
+    // allow the pipeline to be initialized and used again
+    m_width = m_height = 0;
+    m_format = PixelFormat::DontCare;
+    m_resultTex = 0;
+    m_initialized = m_initOK = false;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -201,12 +317,36 @@ bool Pipeline::init() {
     "\n" "}"
     "\n");
 
+    // helper program to turn narrow results into RGBA (the swizzle does the work)
+    GLutil::Shader expandFS(GL_FRAGMENT_SHADER,
+         "#version 330 core"
+    "\n" "uniform sampler2D gips_tex;"
+    "\n" "out vec4 gips_frag;"
+    "\n" "void main() {"
+    "\n" "  gips_frag = texelFetch(gips_tex, ivec2(gl_FragCoord.xy), 0);"
+    "\n" "}"
+    "\n");
+    if (m_vs.good() && expandFS.good() && m_expandProg.link(m_vs, expandFS)) {
+        m_expandProg.use();
+        glUniform4f(m_expandProg.getUniformLocation("gips_pos2ndc"), -1.0f, -1.0f, 2.0f, 2.0f);
+        glUniform4f(m_expandProg.getUniformLocation("gips_rel2map"), 0.0f, 0.0f, 1.0f, 1.0f);
+        glUseProgram(0);
+    }
+
     m_fbo.init();
-    glGenTextures(2, m_tex);
-    for (int i = 0;  i < 2;  ++i) {
-        glBindTexture(GL_TEXTURE_2D, m_tex[i]);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glGenTextures(BufferSets * 2, &m_tex[0][0]);
+    static const GLint swizzle[BufferSets][4] = {
+        { GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA },
+        { GL_RED, GL_RED,   GL_RED,  GL_ONE },
+        { GL_RED, GL_RED,   GL_RED,  GL_GREEN },
+    };
+    for (int set = 0;  set < BufferSets;  ++set) {
+        for (int i = 0;  i < 2;  ++i) {
+            glBindTexture(GL_TEXTURE_2D, m_tex[set][i]);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle[set]);
+        }
     }
     glBindTexture(GL_TEXTURE_2D, 0);
 
@@ -215,132 +355,179 @@ bool Pipeline::init() {
     return m_initOK;
 }
 
-void Pipeline::render(GLuint srcTex, int width, int height, PixelFormat format, int maxNodes) {
-    GLutil::clearError();
-    if ((maxNodes < 0) || (maxNodes > nodeCount())) { maxNodes = nodeCount(); }
+int Pipeline::setupRender(int width, int height, PixelFormat format, int maxNodes) {
     if (format == PixelFormat::DontCare) { format = detectFormat(); }
+    format = getProcessingFormat(format);
     #ifndef NDEBUG
         fprintf(stderr, "render: %dx%d, fmt #%d, %d nodes\n", width, height, static_cast<int>(format), maxNodes);
     #endif
 
     // format change?
-    if ((width != m_width) || (height != m_height) || (format != m_format)) {
+    if ((width != m_width) || (height != m_height) || (format != m_format) || (m_linearLight != m_buffersLinear)) {
         #ifndef NDEBUG
             fprintf(stderr, "render format changed (was %dx%d, #%d)\n", m_width, m_height, static_cast<int>(m_format));
         #endif
-        for (int i = 0;  i < 2;  ++i) {
-            glBindTexture(GL_TEXTURE_2D, m_tex[i]);
-            GLint glfmt; GLenum dtype;
-            switch (format) {
-                case PixelFormat::Int16:   glfmt = GL_RGBA16;  dtype = GL_UNSIGNED_SHORT; break;
-                case PixelFormat::Float16: glfmt = GL_RGBA16F; dtype = GL_FLOAT;          break;
-                case PixelFormat::Float32: glfmt = GL_RGBA32F; dtype = GL_FLOAT;          break;
-                default:                   glfmt = GL_RGBA8;   dtype = GL_UNSIGNED_BYTE;  break;
+        // release all buffers; they will be re-allocated when needed
+        for (int set = 0;  set < BufferSets;  ++set) {
+            if (!m_texAllocated[set]) { continue; }
+            for (int i = 0;  i < 2;  ++i) {
+                glBindTexture(GL_TEXTURE_2D, m_tex[set][i]);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+                Memory::untrackTexture(m_tex[set][i]);
             }
-            glTexImage2D(GL_TEXTURE_2D, 0, glfmt, width, height, 0, GL_RGBA, dtype, nullptr);
+            m_texAllocated[set] = false;
         }
         glBindTexture(GL_TEXTURE_2D, 0);
-        GLutil::checkError("intermediate buffer allocation");
         m_width = width;
         m_height = height;
         m_format = format;
+        m_buffersLinear = m_linearLight;
     }
 
     // set viewport
     glViewport(0, 0, width, height);
     GLutil::checkError("processing viewport setup");
-    auto t0 = std::chrono::high_resolution_clock::now();
 
-    // iterate over the nodes and passes
-    m_resultTex = srcTex;
-    for (int nodeIndex = 0;  nodeIndex < maxNodes;  ++nodeIndex) {
+    // find the first node that actually contributes to the result:
+    // everything before the last active generator is overwritten anyway
+    int firstNode = 0;
+    for (int nodeIndex = maxNodes - 1;  nodeIndex >= 0;  --nodeIndex) {
         const auto& node = *m_nodes[size_t(nodeIndex)];
-        if (!node.enabled()) { continue; }
-        for (int passIndex = 0;  passIndex < node.passCount();  ++passIndex) {
-            const auto& pass = node.m_passes[passIndex];
-
-            // select output buffer to use
-            GLuint outTex = (m_resultTex == m_tex[0]) ? m_tex[1] : m_tex[0];
-
-            // prepare FBO, texture and program for rendering
-            GLutil::clearError();
-            if (!m_fbo.begin(outTex)) {
-                #ifndef NDEBUG
-                    fprintf(stderr, "Error: framebuffer isn't complete (status 0x%04X)\n", m_fbo.status);
-                #endif
-                continue;
-            }
-            glBindTexture(GL_TEXTURE_2D, m_resultTex);
-            pass.program.use();
-            GLutil::checkError("FBO/tex/shader setup");
-
-            // set up input texture
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, pass.texFilter ? GL_LINEAR : GL_NEAREST);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, pass.texFilter ? GL_LINEAR : GL_NEAREST);
-
-            // set up geometry
-            glUniform2f(pass.locImageSize, GLfloat(m_width), GLfloat(m_height));
-            double ox = 0.0, oy = 0.0, sx = 1.0, sy = 1.0;
-            switch (pass.coordMode) {
-                case CoordMapMode::Pixel:
-                    sx = m_width;
-                    sy = m_height;
-                    break;
-                case CoordMapMode::Relative:
-                    ox = -std::max(1.0, double(m_width) / double(m_height));
-                    oy = -std::max(1.0, double(m_height) / double(m_width));
-                    sx = -2.0 * ox;
-                    sy = -2.0 * oy;
-                    break;
-                default:  // None
-                    break;
-            }
-            glUniform4f(pass.locRel2Map, GLfloat(ox), GLfloat(oy), GLfloat(sx), GLfloat(sy));
-            if (pass.locMap2Tex >= 0) {
-                glUniform4f(pass.locMap2Tex, GLfloat(-ox / sx), GLfloat(-oy / sy), GLfloat(1.0 / sx), GLfloat(1.0 / sy));
-            }
+        if (node.enabled() && node.isGenerator() && !node.isIdentity()) {
+            firstNode = nodeIndex;
+            break;
+        }
+    }
+    #ifndef NDEBUG
+        if (firstNode) { fprintf(stderr, "render: skipping %d node(s) before generator '%s'\n", firstNode, m_nodes[size_t(firstNode)]->name()); }
+    #endif
+    return firstNode;
+}
 
-            // set up parameters
-            for (int paramIndex = 0;  paramIndex < node.paramCount();  ++paramIndex) {
-                const auto& param = node.m_params[size_t(paramIndex)];
-                GLint loc = param.m_location[passIndex];
-                switch (param.m_type) {
-                    case ParameterType::Value:
-                    case ParameterType::Toggle:
-                    case ParameterType::Angle:
-                        glUniform1f(loc, param.m_value[0]);
-                        break;
-                    case ParameterType::Value2:
-                        glUniform2fv(loc, 1, param.m_value);
-                        break;
-                    case ParameterType::Value3:
-                    case ParameterType::RGB:
-                        glUniform3fv(loc, 1, param.m_value);
-                        break;
-                    case ParameterType::Value4:
-                    case ParameterType::RGBA:
-                        glUniform4fv(loc, 1, param.m_value);
-                        break;
-                    // no default here; all enumerants are supposed to be handled
-                }
-            }
-            GLutil::checkError("uniform setup");
+bool Pipeline::renderPass(const Node& node, int passIndex, int channels, GLuint outTex, int y0, int y1) {
+    const auto& pass = node.m_passes[passIndex];
+
+    // prepare FBO, texture and program for rendering
+    GLutil::clearError();
+    if (!m_fbo.begin(outTex)) {
+        #ifndef NDEBUG
+            fprintf(stderr, "Error: framebuffer isn't complete (status 0x%04X)\n", m_fbo.status);
+        #endif
+        return false;
+    }
+    glBindTexture(GL_TEXTURE_2D, m_resultTex);
+    pass.program.use();
+    GLutil::checkError("FBO/tex/shader setup");
+
+    // set up input texture
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, pass.texFilter ? GL_LINEAR : GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, pass.texFilter ? GL_LINEAR : GL_NEAREST);
+
+    // set up geometry
+    glUniform2f(pass.locImageSize, GLfloat(m_width), GLfloat(m_height));
+    double ox = 0.0, oy = 0.0, sx = 1.0, sy = 1.0;
+    switch (pass.coordMode) {
+        case CoordMapMode::Pixel:
+            sx = m_width;
+            sy = m_height;
+            break;
+        case CoordMapMode::Relative:
+            ox = -std::max(1.0, double(m_width) / double(m_height));
+            oy = -std::max(1.0, double(m_height) / double(m_width));
+            sx = -2.0 * ox;
+            sy = -2.0 * oy;
+            break;
+        default:  // None
+            break;
+    }
+    glUniform4f(pass.locRel2Map, GLfloat(ox), GLfloat(oy), GLfloat(sx), GLfloat(sy));
+    if (pass.locMap2Tex >= 0) {
+        glUniform4f(pass.locMap2Tex, GLfloat(-ox / sx), GLfloat(-oy / sy), GLfloat(1.0 / sx), GLfloat(1.0 / sy));
+    }
+    glUniform1i(pass.locPackAlpha, (channels == 2) ? 1 : 0);
+
+    // set up parameters
+    for (int paramIndex = 0;  paramIndex < node.paramCount();  ++paramIndex) {
+        const auto& param = node.m_params[size_t(paramIndex)];
+        GLint loc = param.m_location[passIndex];
+        switch (param.m_type) {
+            case ParameterType::Value:
+            case ParameterType::Toggle:
+            case ParameterType::Angle:
+                glUniform1f(loc, param.m_value[0]);
+                break;
+            case ParameterType::Value2:
+                glUniform2fv(loc, 1, param.m_value);
+                break;
+            case ParameterType::Value3:
+            case ParameterType::RGB:
+                glUniform3fv(loc, 1, param.m_value);
+                break;
+            case ParameterType::Value4:
+            case ParameterType::RGBA:
+                glUniform4fv(loc, 1, param.m_value);
+                break;
+            // no default here; all enumerants are supposed to be handled
+        }
+    }
+    GLutil::checkError("uniform setup");
 
-            // now render!
-            glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-            GLutil::checkError("filter rendering");
+    // now render! (only a band of rows, if requested)
+    bool band = (y0 > 0) || (y1 < m_height);
+    if (band) {
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(0, y0, m_width, y1 - y0);
+    }
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    if (band) { glDisable(GL_SCISSOR_TEST); }
+    GLutil::checkError("filter rendering");
+
+    // "unprepare" everything
+    glUseProgram(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    m_fbo.end();
+    GLutil::checkError("FBO/tex/shader teardown");
+    return true;
+}
+
+void Pipeline::render(GLuint srcTex, int width, int height, PixelFormat format, int maxNodes, const NodeCallback& nodeCallback) {
+    cancelRender();
+    GLutil::clearError();
+    if ((maxNodes < 0) || (maxNodes > nodeCount())) { maxNodes = nodeCount(); }
+    int firstNode = setupRender(width, height, format, maxNodes);
+    if (nodeCallback) { firstNode = 0; }  // the caller wants to see every node
+    auto t0 = std::chrono::high_resolution_clock::now();
 
-            // "unprepare" everything
-            glUseProgram(0);
-            glBindTexture(GL_TEXTURE_2D, 0);
-            m_fbo.end();
-            GLutil::checkError("FBO/tex/shader teardown");
+    // in linear-light mode, let the hardware do the sRGB encoding when
+    // writing into 8-bit buffers
+    if (m_linearLight) { glEnable(GL_FRAMEBUFFER_SRGB); }
 
-            // set result to output buffer
-            m_resultTex = outTex;
+    // iterate over the nodes and passes
+    m_resultTex = srcTex;
+    m_resultChannels = 4;
+    for (int nodeIndex = firstNode;  nodeIndex < maxNodes;  ++nodeIndex) {
+        const auto& node = *m_nodes[size_t(nodeIndex)];
+        if (node.enabled() && !node.isIdentity()) {
+            int channels = node.m_channels ? node.m_channels : m_resultChannels;
+            for (int passIndex = 0;  passIndex < node.passCount();  ++passIndex) {
+                // select output buffer to use, render, and make it the result
+                GLuint outTex = getOutputTex(channels);
+                if (renderPass(node, passIndex, channels, outTex, 0, m_height)) {
+                    m_resultTex = outTex;
+                }
+            }   // END pass loop
+            m_resultChannels = channels;
+        }
 
-        }   // END pass loop
+        // let the caller inspect the node's result (which is just its input
+        // if it's disabled); it may have changed the GL state, so restore
+        // what we need
+        if (nodeCallback) {
+            nodeCallback(nodeIndex, m_resultTex);
+            glViewport(0, 0, width, height);
+        }
     }   // END node loop
+    if (m_linearLight) { glDisable(GL_FRAMEBUFFER_SRGB); }
 
     // force full pipeline flush to measure timing
     glBindTexture(GL_TEXTURE_2D, m_resultTex);
@@ -349,8 +536,224 @@ void Pipeline::render(GLuint srcTex, int width, int height, PixelFormat format,
     glBindTexture(GL_TEXTURE_2D, 0);
     auto t1 = std::chrono::high_resolution_clock::now();
     m_lastRenderTime_ms = std::chrono::duration<float, std::milli>(t1 - t0).count();
+    ++m_resultSerial;
 }   // END render()
 
 ///////////////////////////////////////////////////////////////////////////////
 
+void Pipeline::beginRender(GLuint srcTex, int width, int height, PixelFormat format, int maxNodes) {
+    cancelRender();
+    GLutil::clearError();
+    if ((maxNodes < 0) || (maxNodes > nodeCount())) { maxNodes = nodeCount(); }
+    int firstNode = setupRender(width, height, format, maxNodes);
+
+    m_slice = SlicedRender();
+    m_slice.nodeIndex = firstNode;
+    m_slice.maxNodes = maxNodes;
+    for (int nodeIndex = firstNode;  nodeIndex < maxNodes;  ++nodeIndex) {
+        const auto& node = *m_nodes[size_t(nodeIndex)];
+        if (node.enabled() && !node.isIdentity()) { m_slice.passesTotal += node.passCount(); }
+    }
+    m_slice.active = true;
+    m_resultTex = srcTex;
+    m_resultChannels = 4;
+    ++m_resultSerial;
+}
+
+bool Pipeline::continueRender(float budget_ms) {
+    if (!m_slice.active) { return true; }
+    using clock = std::chrono::high_resolution_clock;
+    auto t0 = clock::now();
+    glViewport(0, 0, m_width, m_height);
+    if (m_linearLight) { glEnable(GL_FRAMEBUFFER_SRGB); }
+
+    bool done = false, first = true;
+    for (;;) {
+        // advance to the next pass that needs to be rendered
+        if ((m_slice.nodeIndex >= m_slice.maxNodes) || (m_slice.nodeIndex >= nodeCount())) {
+            done = true;
+            break;
+        }
+        const auto& node = *m_nodes[size_t(m_slice.nodeIndex)];
+        if (!node.enabled() || node.isIdentity() || (m_slice.passIndex >= node.passCount())) {
+            if (m_slice.passIndex > 0) { m_resultChannels = m_slice.channels; }  // node finished
+            ++m_slice.nodeIndex;
+            m_slice.passIndex = 0;
+            continue;
+        }
+        if (!m_slice.bandY) {
+            // start of a pass: select output buffer, use a small probe band
+            if (!m_slice.passIndex) { m_slice.channels = node.m_channels ? node.m_channels : m_resultChannels; }
+            m_slice.outTex = getOutputTex(m_slice.channels);
+            m_slice.bandRows = 0;
+        }
+
+        // stop if the time budget is used up, but always make some progress
+        float elapsed = std::chrono::duration<float, std::milli>(clock::now() - t0).count();
+        if (!first && (budget_ms > 0.0f) && (elapsed >= budget_ms)) { break; }
+        first = false;
+
+        // size the band according to the throughput measured so far,
+        // aiming for about half the budget per band; grow carefully, as
+        // the cost of a pass isn't necessarily uniform across the image
+        int rows = m_height - m_slice.bandY;
+        if (budget_ms > 0.0f) {
+            int target = m_slice.bandRows
+                       ? std::min(int(m_slice.rowsPerMs * budget_ms * 0.5f), m_slice.bandRows * 4)
+                       : InitialBandRows;
+            rows = std::min(rows, std::max(target, 1));
+        }
+
+        // render and wait for the band to finish, to measure throughput
+        // and keep the GPU's command queue (and watchdog) at bay
+        auto tBand = clock::now();
+        bool ok = renderPass(node, m_slice.passIndex, m_slice.channels, m_slice.outTex, m_slice.bandY, m_slice.bandY + rows);
+        glFinish();
+        float bandTime = std::chrono::duration<float, std::milli>(clock::now() - tBand).count();
+        m_slice.rowsPerMs = float(rows) / std::max(bandTime, 0.01f);
+        m_slice.bandRows = rows;
+        m_slice.bandY += rows;
+        if (!ok || (m_slice.bandY >= m_height)) {
+            // pass finished (or failed, in which case it's skipped)
+            if (ok) { m_resultTex = m_slice.outTex;  ++m_resultSerial; }
+            ++m_slice.passIndex;
+            ++m_slice.passesDone;
+            m_slice.bandY = 0;
+        }
+    }
+    if (m_linearLight) { glDisable(GL_FRAMEBUFFER_SRGB); }
+
+    m_slice.time_ms += std::chrono::duration<float, std::milli>(clock::now() - t0).count();
+    if (done) {
+        m_slice.active = false;
+        m_lastRenderTime_ms = m_slice.time_ms;
+        #ifndef NDEBUG
+            fprintf(stderr, "time-sliced render finished in %.1f ms\n", m_slice.time_ms);
+        #endif
+    }
+    return done;
+}
+
+float Pipeline::renderProgress() const {
+    if (!m_slice.active) { return 1.0f; }
+    if (!m_slice.passesTotal || !m_height) { return 0.0f; }
+    return (float(m_slice.passesDone) + float(m_slice.bandY) / float(m_height)) / float(m_slice.passesTotal);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+uint64_t Pipeline::memoryUsage() const {
+    uint64_t total = Memory::trackedTextureSize(m_srgbTex);
+    for (int set = 0;  set < BufferSets;  ++set) {
+        for (int i = 0;  i < 2;  ++i) {
+            total += Memory::trackedTextureSize(m_tex[set][i]);
+        }
+    }
+    return total;
+}
+
+uint64_t Pipeline::estimateMemoryUsage(int width, int height, PixelFormat format) const {
+    // only the RGBA buffer pair (which every result goes through) is
+    // counted; the narrow ones are much smaller and not always needed
+    if (format == PixelFormat::DontCare) { format = detectFormat(); }
+    format = getProcessingFormat(format);
+    GLenum texFormat, pixelFormat, dataType;
+    getGLFormat(format, texFormat, pixelFormat, dataType);
+    uint64_t total = 2 * Memory::textureSize(width, height, texFormat);
+    if (m_linearLight && (format != PixelFormat::Int8)) {
+        total += Memory::textureSize(width, height, GL_SRGB8_ALPHA8);  // for encodeResult()
+    }
+    return total;
+}
+
+GLuint Pipeline::getOutputTex(int channels) {
+    int set = (channels == 1) ? 1 : (channels == 2) ? 2 : 0;
+    if (!m_texAllocated[set]) {
+        #ifndef NDEBUG
+            fprintf(stderr, "allocating %d-channel intermediate buffers\n", channels);
+        #endif
+        // linear data needs more than 8 bits; RGBA buffers can use
+        // sRGB encoding, but there are no single-/dual-channel sRGB formats
+        bool srgb = m_linearLight && (m_format == PixelFormat::Int8);
+        GLenum texFormat, pixelFormat, dataType;
+        getGLFormat(m_format, texFormat, pixelFormat, dataType);
+        if (srgb) { texFormat = GL_SRGB8_ALPHA8; }
+        if (set) {
+            texFormat = getNarrowGLFormat(srgb ? PixelFormat::Int16 : m_format, channels);
+            pixelFormat = (set == 1) ? GL_RED : GL_RG;
+            dataType = GL_UNSIGNED_BYTE;
+        }
+        for (int i = 0;  i < 2;  ++i) {
+            glBindTexture(GL_TEXTURE_2D, m_tex[set][i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GLint(texFormat), m_width, m_height, 0, pixelFormat, dataType, nullptr);
+            Memory::trackTexture(MemCategory::Intermediate, m_tex[set][i], m_width, m_height, texFormat);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        GLutil::checkError("intermediate buffer allocation");
+        m_texAllocated[set] = true;
+    }
+    return (m_resultTex == m_tex[set][0]) ? m_tex[set][1] : m_tex[set][0];
+}
+
+GLuint Pipeline::expandResult() {
+    if (m_resultChannels >= 4) { return m_resultTex; }
+    GLuint outTex = getOutputTex(4);
+    GLutil::clearError();
+    if (!m_fbo.begin(outTex)) { return m_resultTex; }
+    if (m_linearLight) { glEnable(GL_FRAMEBUFFER_SRGB); }
+    glViewport(0, 0, m_width, m_height);
+    glBindTexture(GL_TEXTURE_2D, m_resultTex);
+    m_expandProg.use();
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glUseProgram(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    if (m_linearLight) { glDisable(GL_FRAMEBUFFER_SRGB); }
+    m_fbo.end();
+    GLutil::checkError("result expansion");
+    m_resultTex = outTex;
+    ++m_resultSerial;
+    m_resultChannels = 4;
+    return m_resultTex;
+}
+
+GLuint Pipeline::encodeResult() {
+    if (!m_linearLight || !m_resultTex) { return m_resultTex; }
+
+    // already stored in 8-bit sRGB? (the normal case in 8-bit mode)
+    GLint texFormat = 0;
+    glBindTexture(GL_TEXTURE_2D, m_resultTex);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &texFormat);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    if (texFormat == GL_SRGB8_ALPHA8) { return m_resultTex; }
+
+    // otherwise, convert into the sRGB staging texture
+    GLutil::clearError();
+    if (!m_srgbTex) { glGenTextures(1, &m_srgbTex); }
+    glBindTexture(GL_TEXTURE_2D, m_srgbTex);
+    if ((m_srgbTexWidth != m_width) || (m_srgbTexHeight != m_height)) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8_ALPHA8, m_width, m_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        Memory::trackTexture(MemCategory::Intermediate, m_srgbTex, m_width, m_height, GL_SRGB8_ALPHA8);
+        m_srgbTexWidth = m_width;
+        m_srgbTexHeight = m_height;
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    if (!m_fbo.begin(m_srgbTex)) { return m_resultTex; }
+    glEnable(GL_FRAMEBUFFER_SRGB);
+    glViewport(0, 0, m_width, m_height);
+    glBindTexture(GL_TEXTURE_2D, m_resultTex);
+    m_expandProg.use();
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glUseProgram(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glDisable(GL_FRAMEBUFFER_SRGB);
+    m_fbo.end();
+    GLutil::checkError("result sRGB encoding");
+    m_resultTex = m_srgbTex;
+    ++m_resultSerial;
+    m_resultChannels = 4;
+    return m_resultTex;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
 }  // namespace GIPS
@@ -3,8 +3,11 @@
 
 #pragma once
 
+#include <cstdint>
+
 #include <string>
 #include <vector>
+#include <functional>
 #include <type_traits>
 
 #include "gl_header.h"
@@ -36,11 +39,14 @@ enum class CoordMapMode {
 
 
 enum class PixelFormat {
-    DontCare =   0,
-    Int8     =   8,
-    Int16    =  16,
-    Float16  = 116,
-    Float32  = 132,
+    DontCare   =   0,
+    Int8       =   8,
+    RGB10A2    =  10,  //!< 10-bit integer RGB, 2-bit alpha
+    Int16      =  16,
+    RGB9E5     = 109,  //!< shared-exponent float RGB, no alpha; input only
+    R11G11B10F = 111,  //!< packed float RGB, no alpha
+    Float16    = 116,
+    Float32    = 132,
 };
 inline bool operator< (const PixelFormat a, const PixelFormat b) {
     using ut = std::underlying_type<PixelFormat>::type;
@@ -49,6 +55,27 @@ inline bool operator< (const PixelFormat a, const PixelFormat b) {
 int getBytesPerPixel(PixelFormat fmt);
 const char* pixelFormatName(PixelFormat fmt);
 
+//! check whether a pixel format stores alpha (if not, alpha reads as 1.0)
+bool pixelFormatHasAlpha(PixelFormat fmt);
+
+//! get the format that is used for processing if the given format is
+//! requested (formats that can't be rendered into are replaced by the
+//! closest one that can)
+PixelFormat getProcessingFormat(PixelFormat fmt);
+
+//! get a format that is at least as precise as both given formats (the
+//! numeric order of the formats doesn't rank them by precision, as the
+//! packed formats trade channel precision and alpha for size)
+PixelFormat combinePixelFormats(PixelFormat a, PixelFormat b);
+
+//! get the OpenGL internal texture format, pixel data format and
+//! component data type for a pixel format
+void getGLFormat(PixelFormat fmt, GLenum& texFormat, GLenum& pixelFormat, GLenum& dataType);
+
+//! parse a pixel format name as used in '@format' tokens (e.g. "int8", "f16");
+//! \returns PixelFormat::DontCare if the name is not recognized
+PixelFormat parsePixelFormat(const char* name);
+
 
 class Parameter {
     friend class Node;
@@ -64,6 +91,8 @@ class Parameter {
     float m_oldValue[4]         = { 0.0f, };
     float m_defaultValue[4]     = { 0.0f, };
     GLint m_location[MaxPasses] = { 0, };
+    bool m_hasIdentity          = false;  //!< m_identityValue is valid
+    float m_identityValue       = 0.0f;   //!< value at which the parameter has no effect
 public:
     inline Parameter() {}
     bool changed();
@@ -76,6 +105,9 @@ public:
     inline       float*  value()          { return m_value; }
     inline       float   minValue() const { return m_minValue; }
     inline       float   maxValue() const { return m_maxValue; }
+    inline       bool    hasIdentity() const { return m_hasIdentity; }
+    //! check whether all components are at the parameter's identity value
+    bool isIdentity() const;
 };
 
 
@@ -84,6 +116,7 @@ class Node {
     std::string m_name;
     std::string m_filename;
     std::string m_errors;
+    size_t m_loadErrorsLength = 0;  //!< length of the part of m_errors that stems from loading the shader
     int m_passCount = 0;
     struct PassData {
         bool texFilter = true;
@@ -92,6 +125,8 @@ class Node {
         GLint locImageSize = -1;
         GLint locRel2Map = -1;
         GLint locMap2Tex = -1;
+        GLint locPackAlpha = -1;
+        std::string source;  //!< generated fragment shader code
         inline PassData() {}
     } m_passes[MaxPasses];
     std::vector<Parameter> m_params;
@@ -100,6 +135,12 @@ class Node {
     bool m_wasEnabled = false;
     FileUtil::FileFingerprint m_fp;
     PixelFormat m_preferredFormat = PixelFormat::DontCare;
+    int m_channels = 4;  //!< number of output channels (1 = luma, 2 = luma+alpha, 4 = RGBA; 0 = same as input)
+    bool m_bundled = false;  //!< loaded from a bundle (no source file available)
+    bool m_generator = false;  //!< output doesn't depend on the input image
+    bool m_exportTap = false;  //!< output is saved along with the result (not stored in pipeline files)
+
+    bool setupBundledPass(int passIndex, const GLutil::Shader& vs, bool coordInput, GLenum binaryFormat, const std::string& binary);
 
 public:
     bool load(const char* filename, const GLutil::Shader& vs, const FileUtil::FileFingerprint* fp=nullptr);
@@ -114,7 +155,13 @@ public:
     inline const char*      errors()     const { return m_errors.c_str(); }
     inline       bool       good()       const { return (m_passCount > 0); }
     inline       int        passCount()  const { return m_passCount; }
+    //! generated fragment shader code of a pass
+    inline const std::string& passSource(int i) const { return m_passes[i].source; }
     inline       bool       enabled()    const { return m_enabled; }
+    inline       bool       bundled()    const { return m_bundled; }
+    inline       bool       isGenerator() const { return m_generator; }
+    inline       int        channels()   const { return m_channels; }
+    inline       bool       exportTap()  const { return m_exportTap; }
     inline       int        paramCount() const { return int(m_params.size()); }
     inline const Parameter& param(int i) const { return m_params[size_t(i)]; }
     inline       Parameter& param(int i)       { return m_params[size_t(i)]; }
@@ -123,34 +170,97 @@ public:
     inline void enable()           { m_enabled = true; }
     inline void disable()          { m_enabled = false; }
     inline bool toggle()           { m_enabled = !m_enabled; return m_enabled; }
+    inline void setExportTap(bool t) { m_exportTap = t; }
 
     Parameter* findParam(const char* name);
 
+    //! check whether the node currently can't change its input at all,
+    //! i.e. it has at least one parameter with an '@identity' value,
+    //! and all such parameters are set to it
+    bool isIdentity() const;
+
     inline Node() {}
     inline Node(const char* filename, const GLutil::Shader& vs) { load(filename, vs); }
     Node(const Node&) = delete;
 };
 
 
+//! function called by Pipeline::render() after each node up to maxNodes,
+//! with the node's 0-based index and its output texture (which is the
+//! input texture for disabled nodes); if such a callback is given, nodes
+//! before a generator are rendered too
+typedef std::function<void(int nodeIndex, GLuint resultTex)> NodeCallback;
+
 class Pipeline {
     std::vector<Node*> m_nodes;
     int m_width = 0;
     int m_height = 0;
     PixelFormat m_format = PixelFormat::DontCare;
-    GLuint m_tex[2] = {0,0};
+    // intermediate buffers, in pairs for ping-pong rendering:
+    // [0] = RGBA, [1] = single-channel (luma), [2] = dual-channel (luma+alpha);
+    // the narrow ones are swizzled to RGBA when sampled from.
+    // Storage is only allocated once a set is actually used.
+    static constexpr int BufferSets = 3;
+    GLuint m_tex[BufferSets][2] = { {0,0}, {0,0}, {0,0} };
+    bool m_texAllocated[BufferSets] = { false, false, false };
+    int m_resultChannels = 4;
+    bool m_linearLight = false;    //!< linear-light mode requested
+    bool m_buffersLinear = false;  //!< linear-light mode the buffers are set up for
+    GLuint m_srgbTex = 0;          //!< 8-bit sRGB copy of the result (see encodeResult())
+    int m_srgbTexWidth = 0;
+    int m_srgbTexHeight = 0;
+    GLutil::Program m_expandProg;
     GLutil::FBO m_fbo;
     bool m_pipelineChanged = true;
     GLutil::Shader m_vs;
     GLuint m_resultTex = 0;
+    unsigned m_resultSerial = 0;
     bool m_initialized = false;
     bool m_initOK = false;
     float m_lastRenderTime_ms = 0.0f;
 
+    // state of a time-sliced render (see beginRender())
+    static constexpr int InitialBandRows = 16;
+    struct SlicedRender {
+        bool active = false;
+        int maxNodes = 0;
+        int nodeIndex = 0;
+        int passIndex = 0;
+        int channels = 4;        //!< output channels of the current node
+        GLuint outTex = 0;       //!< output buffer of the current pass
+        int bandY = 0;           //!< first row of the next band
+        int bandRows = 0;        //!< height of the previous band (0 = none yet in this pass)
+        float rowsPerMs = 0.0f;  //!< throughput measured with the previous band
+        int passesDone = 0;
+        int passesTotal = 0;
+        float time_ms = 0.0f;    //!< accumulated time spent in continueRender()
+    } m_slice;
+
+    //! get the buffer to render a node with the given number of channels
+    //! into (that isn't the current result)
+    GLuint getOutputTex(int channels);
+
+    //! (re-)allocate buffers and set the viewport for a render;
+    //! \returns the index of the first node that contributes to the result
+    int setupRender(int width, int height, PixelFormat format, int maxNodes);
+
+    //! render a pass of a node from the current result into a buffer,
+    //! optionally restricted to the rows y0 (inclusive) to y1 (exclusive)
+    //! \returns false if the framebuffer couldn't be set up
+    bool renderPass(const Node& node, int passIndex, int channels, GLuint outTex, int y0, int y1);
+
 public:
     bool init();
     inline const GLutil::Shader& vs()        const { return m_vs; }
     inline       bool            good()      const { return m_initOK; }
     inline       GLuint          resultTex() const { return m_resultTex; }
+    //! counter that changes whenever the contents of the result texture
+    //! (may) have changed, e.g. to maintain derived data like mipmaps
+    inline       unsigned     resultSerial() const { return m_resultSerial; }
+    //! number of channels in the result texture (1 or 2 if the last
+    //! nodes produced narrow output; such textures are swizzled so that
+    //! sampling from them yields RGBA, but readback doesn't)
+    inline       int        resultChannels() const { return m_resultChannels; }
     inline       PixelFormat     format()    const { return m_format; }
     inline       float lastRenderTime_ms()   const { return m_lastRenderTime_ms; }
     inline       int             nodeCount() const { return int(m_nodes.size()); }
@@ -162,22 +272,74 @@ public:
         if (n) { n->load(filename, m_vs); }
         return n;
     }
+    inline Node* addNode(const char* filename, const FileUtil::FileFingerprint* fp) {
+        Node* n = addNode();
+        if (n) { n->load(filename, m_vs, fp); }
+        return n;
+    }
     void removeNode(int index);
     void moveNode(int fromIndex, int toIndex);
 
     bool changed();
     inline void  markAsChanged() { m_pipelineChanged = true; }
 
+    //! enable or disable linear-light processing: the source texture is
+    //! expected to decode sRGB in the sampler (GL_SRGB8_ALPHA8), 8-bit
+    //! intermediate buffers store sRGB-encoded data, and nodes always see
+    //! linear values
+    inline void setLinearLight(bool enable) {
+        if (enable != m_linearLight) { m_linearLight = enable; m_pipelineChanged = true; }
+    }
+    inline bool linearLight() const { return m_linearLight; }
+
     void reload(bool force=false);
     void clear();
 
-    void render(GLuint srcTex, int width, int height, PixelFormat format=PixelFormat::DontCare, int maxNodes=-1);
+    void render(GLuint srcTex, int width, int height, PixelFormat format=PixelFormat::DontCare, int maxNodes=-1, const NodeCallback& nodeCallback=nullptr);
+
+    //! start a time-sliced render: each pass is split into horizontal bands
+    //! that are submitted by continueRender() calls (e.g. one per frame),
+    //! so heavy pipelines don't block the caller (or trip GPU watchdogs);
+    //! until the render is finished, resultTex() is the output of the last
+    //! completed pass. Any other render or change of the node list cancels it.
+    void beginRender(GLuint srcTex, int width, int height, PixelFormat format=PixelFormat::DontCare, int maxNodes=-1);
+    //! submit bands until the time budget is used up (but at least one);
+    //! a budget of zero or less submits everything that's left
+    //! \returns true if the render is finished (or none is in progress)
+    bool continueRender(float budget_ms);
+    inline void finishRender() { continueRender(0.0f); }
+    inline void cancelRender() { m_slice.active = false; }
+    inline bool renderInProgress() const { return m_slice.active; }
+    //! progress of a time-sliced render, from 0.0 to 1.0
+    float renderProgress() const;
 
     PixelFormat detectFormat() const;
 
+    //! size of the currently allocated intermediate buffers
+    uint64_t memoryUsage() const;
+    //! intermediate buffer size needed to render an image of the given
+    //! size (for budget checks before starting a job)
+    uint64_t estimateMemoryUsage(int width, int height, PixelFormat format=PixelFormat::DontCare) const;
+
+    //! convert a narrow result texture into an RGBA one, e.g. for readback
+    //! \returns the new result texture
+    GLuint expandResult();
+
+    //! make sure that the result is stored as 8-bit sRGB data (in
+    //! linear-light mode, this is what needs to be read back into 8-bit
+    //! images); \returns the new result texture
+    GLuint encodeResult();
+
     std::string serialize(int showIndex);
     int unserialize(char* data);
 
+    //! create a self-contained binary bundle (generated shader code,
+    //! parameters and, if supported, program binaries) of the pipeline
+    std::string serializeBundle(int showIndex);
+    //! load a pipeline bundle; \returns the show index or -1 on failure
+    int unserializeBundle(const char* data, size_t size);
+    static bool isBundle(const char* data, size_t size);
+
     inline Pipeline() {}
     Pipeline(const Pipeline&) = delete;
     void free();
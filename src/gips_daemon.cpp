@@ -0,0 +1,617 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+#include "file_util.h"
+#include "buffer_pool.h"
+#include "hash_util.h"
+#include "string_util.h"
+#include "image_util.h"
+
+#include "gips_paths.h"
+#include "gips_shm.h"
+#include "gips_context.h"
+#include "gips_memory.h"
+#include "gips_pnm.h"
+#include "gips_cli.h"
+#include "gips_daemon.h"
+
+namespace GIPS {
+
+///////////////////////////////////////////////////////////////////////////////
+
+static volatile sig_atomic_t terminationRequested = 0;
+
+static void handleTerminationSignal(int sig) {
+    (void)sig;
+    terminationRequested = 1;
+}
+
+static inline double msSince(const std::chrono::steady_clock::time_point& t0) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+//! split a request line into arguments; arguments may be double-quoted
+//! (with backslash escapes) to allow for whitespace in file names
+static std::vector<std::string> splitArgs(const char* line) {
+    std::vector<std::string> args;
+    while (*line) {
+        while (*line && isspace(*line)) { ++line; }
+        if (!*line) { break; }
+        std::string arg;
+        if (*line == '"') {
+            for (++line;  *line && (*line != '"');  ++line) {
+                if ((*line == '\\') && line[1]) { ++line; }
+                arg.push_back(*line);
+            }
+            if (*line) { ++line; }
+        } else {
+            while (*line && !isspace(*line)) { arg.push_back(*line++); }
+        }
+        args.push_back(arg);
+    }
+    return args;
+}
+
+//! shared-memory image segment (see gips_shm.h), mapped into our address space
+class SharedImage {
+    void* m_base = MAP_FAILED;
+    size_t m_size = 0;
+public:
+    const GIPSShmHeader* header = nullptr;
+    PixelFormat format = PixelFormat::DontCare;
+    int bytesPerPixel = 0;
+    size_t dataSize = 0;
+
+    //! map a segment and validate its header; \returns an error message or nullptr
+    const char* open(const std::string& name, bool writable);
+    inline uint8_t* data() const { return static_cast<uint8_t*>(m_base) + header->dataOffset; }
+    inline ImageBuffer buffer() const { return ImageBuffer(data(), header->width, header->height, format, header->stride); }
+
+    inline SharedImage() {}
+    SharedImage(const SharedImage&) = delete;
+    inline ~SharedImage() { if (m_base != MAP_FAILED) { munmap(m_base, m_size); } }
+};
+
+const char* SharedImage::open(const std::string& name, bool writable) {
+    std::string path((name[0] == '/') ? "" : "/");
+    path += name;
+    int fd = shm_open(path.c_str(), writable ? O_RDWR : O_RDONLY, 0);
+    if (fd < 0) { return "can't open shared memory segment"; }
+    struct stat st;
+    if (fstat(fd, &st) || (size_t(st.st_size) < sizeof(GIPSShmHeader))) {
+        close(fd);
+        return "shared memory segment is too small";
+    }
+    m_size = size_t(st.st_size);
+    m_base = mmap(nullptr, m_size, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m_base == MAP_FAILED) { return "can't map shared memory segment"; }
+
+    // validate header
+    header = static_cast<const GIPSShmHeader*>(m_base);
+    if ((header->magic != GIPS_SHM_MAGIC) || (header->version != GIPS_SHM_VERSION)) {
+        return "invalid shared memory segment header";
+    }
+    format = static_cast<PixelFormat>(header->format);
+    switch (format) {
+        case PixelFormat::Int8:
+        case PixelFormat::RGB10A2:
+        case PixelFormat::Int16:
+        case PixelFormat::RGB9E5:
+        case PixelFormat::R11G11B10F:
+        case PixelFormat::Float16:
+        case PixelFormat::Float32:
+            break;
+        default:
+            return "invalid pixel format in shared memory segment";
+    }
+    bytesPerPixel = getBytesPerPixel(format);
+    if ((header->width < 1) || (header->height < 1)
+    ||  (header->stride < uint32_t(header->width * bytesPerPixel))
+    ||  (header->stride % uint32_t(bytesPerPixel))) {
+        return "invalid image geometry in shared memory segment";
+    }
+    dataSize = size_t(header->stride) * size_t(header->height - 1) + size_t(header->width * bytesPerPixel);
+    if ((header->dataOffset < sizeof(GIPSShmHeader)) || (header->dataOffset > m_size) || (dataSize > (m_size - header->dataOffset))) {
+        return "shared memory segment is too small for the image";
+    }
+    return nullptr;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+int Daemon::run(int argc, char* argv[]) {
+    setupPaths(argv[0], m_appDir, m_appUIConfigFile);
+    ThreadPool::makeCurrent(&m_threadPool);
+    BufferPool::setHugePages(true);
+
+    // determine socket path
+    if ((argc > 2) && argv[2][0]) {
+        m_socketPath = argv[2];
+    } else {
+        const char* runtimeDir = getenv("XDG_RUNTIME_DIR");
+        if (runtimeDir && runtimeDir[0]) {
+            m_socketPath = std::string(runtimeDir) + "/gips.sock";
+        } else {
+            m_socketPath = "/tmp/gips-" + std::to_string(getuid()) + ".sock";
+        }
+    }
+
+    if (!m_ctx.initHeadless("GIPS Daemon")) { return 1; }
+    if (!startListening()) { return 1; }
+    fprintf(stderr, "GIPS daemon listening on '%s'\n", m_socketPath.c_str());
+
+    // main loop: serve one client connection at a time
+    while (m_active && !terminationRequested) {
+        int fd = accept(m_listenFD, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) { continue; }
+            perror("accept");
+            break;
+        }
+        serveClient(fd);
+        close(fd);
+    }
+
+    #ifndef NDEBUG
+        fprintf(stderr, "daemon shutting down ...\n");
+    #endif
+    stopListening();
+    m_ctx.doneHeadless();
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool Daemon::startListening() {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (m_socketPath.size() >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "socket path '%s' is too long\n", m_socketPath.c_str());
+        return false;
+    }
+    strcpy(addr.sun_path, m_socketPath.c_str());
+
+    // remove stale sockets from earlier runs (but nothing else!)
+    struct stat st;
+    if (!lstat(m_socketPath.c_str(), &st) && S_ISSOCK(st.st_mode)) {
+        unlink(m_socketPath.c_str());
+    }
+
+    m_listenFD = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_listenFD < 0) { perror("socket"); return false; }
+    if (bind(m_listenFD, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr))) {
+        perror("bind");
+        close(m_listenFD);  m_listenFD = -1;
+        return false;
+    }
+    chmod(m_socketPath.c_str(), 0600);  // only the owner may submit jobs
+    if (listen(m_listenFD, 8)) {
+        perror("listen");
+        stopListening();
+        return false;
+    }
+
+    // terminate gracefully on SIGINT/SIGTERM; don't die on disconnected clients
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handleTerminationSignal;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;  // no SA_RESTART -> accept() will be interrupted
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+    return true;
+}
+
+void Daemon::stopListening() {
+    if (m_listenFD >= 0) {
+        close(m_listenFD);
+        m_listenFD = -1;
+        unlink(m_socketPath.c_str());
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void Daemon::serveClient(int fd) {
+    constexpr size_t MaxLineLength = 65536;
+    std::string buffer;
+    char chunk[4096];
+    #ifndef NDEBUG
+        fprintf(stderr, "client connected\n");
+    #endif
+    while (m_active && !terminationRequested) {
+        // process all complete lines in the buffer
+        size_t eol;
+        while (m_active && ((eol = buffer.find('\n')) != std::string::npos)) {
+            std::string line(buffer, 0, eol);
+            buffer.erase(0, eol + 1);
+            if (!line.empty() && (line.back() == '\r')) { line.pop_back(); }
+            std::string response = handleRequest(line.c_str());
+            if (response.empty()) { continue; }
+            response.push_back('\n');
+            const char* p = response.data();
+            size_t remain = response.size();
+            while (remain) {
+                ssize_t res = write(fd, p, remain);
+                if ((res < 0) && (errno == EINTR)) { continue; }
+                if (res <= 0) { return; }  // client went away
+                p += res;
+                remain -= size_t(res);
+            }
+        }
+        if (buffer.size() > MaxLineLength) {
+            fprintf(stderr, "request line too long, dropping client\n");
+            return;
+        }
+
+        // receive more data
+        ssize_t res = read(fd, chunk, sizeof(chunk));
+        if ((res < 0) && (errno == EINTR)) { continue; }
+        if (res <= 0) { break; }
+        buffer.append(chunk, size_t(res));
+    }
+    #ifndef NDEBUG
+        fprintf(stderr, "client disconnected\n");
+    #endif
+}
+
+std::string Daemon::handleRequest(const char* line) {
+    std::vector<std::string> args = splitArgs(line);
+    if (args.empty() || (args[0][0] == '#')) { return ""; }  // empty line or comment
+    ++m_stats.requests;
+    #ifndef NDEBUG
+        fprintf(stderr, "request: %s\n", line);
+    #endif
+    const std::string& cmd = args[0];
+    std::string response;
+    if      (cmd == "load")   { response = cmdLoad(args); }
+    else if (cmd == "unload") { response = cmdUnload(args); }
+    else if (cmd == "set")    { response = cmdSet(args); }
+    else if (cmd == "render") { response = cmdRender(args); }
+    else if (cmd == "render_shm") { response = cmdRenderShm(args); }
+    else if (cmd == "stats")  { response = cmdStats(); }
+    else if (cmd == "cache")  { response = cmdCache(args); }
+    else if (cmd == "memory") { response = cmdMemory(args); }
+    else if (cmd == "quit")   { m_active = false; response = "OK bye"; }
+    else { response = "ERR unknown command '" + cmd + "'"; }
+    if (response.compare(0, 3, "ERR") == 0) { ++m_stats.errors; }
+    return response;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+std::string Daemon::cmdLoad(const std::vector<std::string>& args) {
+    if (args.size() != 3) { return "ERR usage: load <name> <pipeline.gips>"; }
+    auto t0 = std::chrono::steady_clock::now();
+    ++m_stats.loads;
+    if (!m_ctx.loadPipeline(args[1], args[2].c_str())) {
+        return std::string("ERR ") + m_ctx.error();
+    }
+    bool warm = m_ctx.lastLoadWasWarm();
+    if (warm) { ++m_stats.warmLoads; }
+
+    // count nodes with non-fatal errors
+    const Pipeline& pipeline = *m_ctx.pipeline(args[1]);
+    int warnings = 0;
+    for (int i = 0;  i < pipeline.nodeCount();  ++i) {
+        if (pipeline.node(i).hasErrors()) { ++warnings; }
+    }
+    m_stats.loadTime_ms += msSince(t0);
+    return "OK nodes=" + std::to_string(pipeline.nodeCount())
+        + " warm=" + (warm ? "1" : "0")
+        + " warnings=" + std::to_string(warnings);
+}
+
+std::string Daemon::cmdUnload(const std::vector<std::string>& args) {
+    if (args.size() != 2) { return "ERR usage: unload <name>"; }
+    if (!m_ctx.unloadPipeline(args[1])) { return std::string("ERR ") + m_ctx.error(); }
+    return "OK";
+}
+
+std::string Daemon::cmdSet(const std::vector<std::string>& args) {
+    if (args.size() < 5) { return "ERR usage: set <name> <node> <param> <value> [<value> ...]"; }
+    float values[4];
+    int count = 0;
+    for (size_t i = 4;  i < args.size();  ++i) {
+        if (count >= 4) { return "ERR too many values"; }
+        char* end = nullptr;
+        values[count] = strtof(args[i].c_str(), &end);
+        if (!end || *end) { return "ERR invalid value '" + args[i] + "'"; }
+        ++count;
+    }
+    if (!m_ctx.setParameter(args[1], atoi(args[2].c_str()) - 1, args[3].c_str(), values, count)) {
+        return std::string("ERR ") + m_ctx.error();
+    }
+    return "OK";
+}
+
+//! parse the optional format argument of the render commands
+static bool parseFormatArg(const std::vector<std::string>& args, PixelFormat& format) {
+    format = PixelFormat::DontCare;
+    if (args.size() > 4) {
+        format = parsePixelFormat(args[4].c_str());
+        return (format != PixelFormat::DontCare);
+    }
+    return true;
+}
+
+std::string Daemon::cmdRender(const std::vector<std::string>& args) {
+    if ((args.size() < 4) || (args.size() > 5)) { return "ERR usage: render <name> <input> <output> [<format>]"; }
+    PixelFormat format;
+    if (!parseFormatArg(args, format)) { return "ERR unrecognized pixel format '" + args[4] + "'"; }
+    if (!m_ctx.pipeline(args[1])) { return "ERR no such pipeline"; }
+    FileUtil::MappedFile inFile;
+
+    // with the result cache enabled, the input file (not its decoded
+    // pixels) is hashed, so that hits don't need to decode anything;
+    // the cached data is the output file, preceded by the image size
+    CacheKey key;
+    bool useCache = m_cache.enabled();
+    if (useCache) {
+        auto th = std::chrono::steady_clock::now();
+        if (!inFile.open(args[2].c_str())) { return "ERR failed to read input image"; }
+        key = makeFileRenderKey(inFile.data(), inFile.size(), m_ctx.renderSignature(args[1]), format, args[3].c_str());
+        double hashTime = msSince(th);
+        m_stats.hashTime_ms += hashTime;
+        const std::string* hit = m_cache.lookup(key);
+        if (hit && (hit->size() > 8)) {
+            int cachedWidth = 0, cachedHeight = 0;
+            if (!restoreFileRenderEntry(*hit, args[3].c_str(), cachedWidth, cachedHeight)) { return "ERR failed to write output image"; }
+            char times[64];
+            snprintf(times, sizeof(times), " hash_ms=%.2f", hashTime);
+            return "OK size=" + std::to_string(cachedWidth) + "x" + std::to_string(cachedHeight) + " cached=1" + times;
+        }
+    }
+
+    // load the input image; PNM-family files are used in place
+    // via a memory mapping, everything else is decoded into RGBA
+    auto t0 = std::chrono::steady_clock::now();
+    uint8_t* inData = nullptr;
+    ImageBuffer input;
+    if (!isPNMFile(args[2].c_str()) || !(inFile.good() || inFile.open(args[2].c_str())) || !parsePNM(inFile.data(), inFile.size(), input)) {
+        inFile.close();
+        int width = 0, height = 0;
+        inData = ImageUtil::load(args[2].c_str(), width, height);
+        if (!inData) { return "ERR failed to read input image"; }
+        input = ImageBuffer(inData, width, height);
+    }
+    double decodeTime = msSince(t0);
+    int width = input.width, height = input.height;
+
+    // set up the output image; for PNM-family files, the pixels are
+    // read back directly into a pre-sized mapping of the output file
+    FileUtil::MappedFile outFile;
+    uint8_t* outData = nullptr;
+    ImageBuffer output(nullptr, width, height, (format == PixelFormat::DontCare) ? input.format : combinePixelFormats(input.format, format));
+    std::string header = makePNMHeader(args[3].c_str(), output);
+    if (!header.empty()) {
+        if (!outFile.create(args[3].c_str(), header.size() + output.dataSize())) {
+            BufferPool::release(inData);
+            return "ERR failed to create output file";
+        }
+        uint8_t* fileData = static_cast<uint8_t*>(outFile.data());
+        memcpy(fileData, header.data(), header.size());
+        output.data = &fileData[header.size()];
+    } else {
+        size_t outSize = size_t(width) * size_t(height) * 4u;
+        if (!Memory::fitsHost(outSize)) { BufferPool::release(inData); return "ERR output image would exceed the host memory budget"; }
+        outData = static_cast<uint8_t*>(BufferPool::alloc(outSize));
+        if (!outData) { BufferPool::release(inData); return "ERR out of memory"; }
+        output = ImageBuffer(outData, width, height);
+    }
+
+    // process
+    bool ok = m_ctx.render(args[1], input, output, format);
+    BufferPool::release(inData);
+    inFile.close();
+    if (!ok) {
+        BufferPool::release(outData);
+        if (outFile.good()) { outFile.close(); unlink(args[3].c_str()); }
+        return std::string("ERR ") + m_ctx.error();
+    }
+    double renderTime = double(m_ctx.pipeline(args[1])->lastRenderTime_ms());
+
+    // save the result (or just unmap it)
+    auto t1 = std::chrono::steady_clock::now();
+    if (outData) {
+        ok = ImageUtil::save(args[3].c_str(), outData, width, height);
+        BufferPool::release(outData);
+        if (!ok) { return "ERR failed to write output image"; }
+        if (useCache) { outFile.open(args[3].c_str()); }
+    }
+    if (useCache && outFile.good()) {
+        std::string entry = makeFileRenderEntry(outFile.data(), outFile.size(), width, height);
+        m_cache.store(key, entry.data(), entry.size());
+    }
+    outFile.close();
+    double encodeTime = msSince(t1);
+
+    ++m_stats.renders;
+    m_stats.decodeTime_ms   += decodeTime;
+    m_stats.uploadTime_ms   += double(m_ctx.lastUploadTime_ms());
+    m_stats.renderTime_ms   += renderTime;
+    m_stats.downloadTime_ms += double(m_ctx.lastDownloadTime_ms());
+    m_stats.encodeTime_ms   += encodeTime;
+    char times[128];
+    snprintf(times, sizeof(times), " decode_ms=%.2f render_ms=%.2f encode_ms=%.2f", decodeTime, renderTime, encodeTime);
+    return "OK size=" + std::to_string(width) + "x" + std::to_string(height) + times;
+}
+
+std::string Daemon::cmdRenderShm(const std::vector<std::string>& args) {
+    if ((args.size() < 4) || (args.size() > 5)) { return "ERR usage: render_shm <name> <input-shm> <output-shm> [<format>]"; }
+    PixelFormat format;
+    if (!parseFormatArg(args, format)) { return "ERR unrecognized pixel format '" + args[4] + "'"; }
+
+    // map and validate the segments
+    SharedImage in, out;
+    const char* err = in.open(args[2], false);
+    if (err) { return std::string("ERR input: ") + err; }
+    err = out.open(args[3], true);
+    if (err) { return std::string("ERR output: ") + err; }
+    std::string size = std::to_string(in.header->width) + "x" + std::to_string(in.header->height);
+
+    // look up the result cache; the key covers both images' layouts
+    ImageBuffer output = out.buffer();
+    CacheKey key;
+    bool useCache = m_cache.enabled() && m_ctx.pipeline(args[1]);
+    if (useCache) {
+        auto th = std::chrono::steady_clock::now();
+        char layout[128];
+        snprintf(layout, sizeof(layout), "\nfmt=%d in=%dx%d/%d out=%dx%d/%d",
+                 static_cast<int>(format), in.header->width, in.header->height, static_cast<int>(in.format),
+                 output.width, output.height, static_cast<int>(output.format));
+        key.content = hashImage(in.buffer());
+        std::string setup = m_ctx.renderSignature(args[1]) + layout;
+        key.setup = HashUtil::hash64(setup.data(), setup.size());
+        double hashTime = msSince(th);
+        m_stats.hashTime_ms += hashTime;
+        const std::string* hit = m_cache.lookup(key);
+        if (hit && (hit->size() == (output.rowSize() * size_t(output.height)))) {
+            for (int y = 0;  y < output.height;  ++y) {
+                memcpy(static_cast<uint8_t*>(output.data) + size_t(y) * output.rowPitch(), &(*hit)[size_t(y) * output.rowSize()], output.rowSize());
+            }
+            char times[64];
+            snprintf(times, sizeof(times), " hash_ms=%.2f", hashTime);
+            return "OK size=" + size + " cached=1" + times;
+        }
+    }
+
+    // process (PBO upload -> pipeline -> PBO readback)
+    if (!m_ctx.render(args[1], in.buffer(), output, format)) {
+        return std::string("ERR ") + m_ctx.error();
+    }
+    if (useCache) {
+        std::string entry;
+        entry.reserve(output.rowSize() * size_t(output.height));
+        for (int y = 0;  y < output.height;  ++y) {
+            entry.append(static_cast<const char*>(output.data) + size_t(y) * output.rowPitch(), output.rowSize());
+        }
+        m_cache.store(key, entry.data(), entry.size());
+    }
+    double uploadTime   = double(m_ctx.lastUploadTime_ms());
+    double renderTime   = double(m_ctx.pipeline(args[1])->lastRenderTime_ms());
+    double readbackTime = double(m_ctx.lastDownloadTime_ms());
+
+    ++m_stats.renders;
+    m_stats.uploadTime_ms   += uploadTime;
+    m_stats.renderTime_ms   += renderTime;
+    m_stats.downloadTime_ms += readbackTime;
+    char times[128];
+    snprintf(times, sizeof(times), " upload_ms=%.2f render_ms=%.2f readback_ms=%.2f", uploadTime, renderTime, readbackTime);
+    return "OK size=" + size + times;
+}
+
+std::string Daemon::cmdStats() {
+    BufferPool::Stats pool = BufferPool::getStats();
+    Memory::Usage gpu = Memory::getGPUTotal(), host = Memory::getHostTotal();
+    char buf[1024];
+    snprintf(buf, sizeof(buf),
+        "OK pipelines=%d requests=%llu errors=%llu loads=%llu warm_loads=%llu renders=%llu"
+        " cache_hits=%llu cache_misses=%llu buffer_allocs=%llu buffer_reuses=%llu buffer_cached_mb=%.1f"
+        " gpu_mb=%.1f gpu_peak_mb=%.1f host_mb=%.1f host_peak_mb=%.1f"
+        " load_ms=%.1f decode_ms=%.1f upload_ms=%.1f render_ms=%.1f readback_ms=%.1f encode_ms=%.1f hash_ms=%.1f",
+        m_ctx.pipelineCount(),
+        static_cast<unsigned long long>(m_stats.requests),
+        static_cast<unsigned long long>(m_stats.errors),
+        static_cast<unsigned long long>(m_stats.loads),
+        static_cast<unsigned long long>(m_stats.warmLoads),
+        static_cast<unsigned long long>(m_stats.renders),
+        static_cast<unsigned long long>(m_cache.stats().hits + m_cache.stats().diskHits),
+        static_cast<unsigned long long>(m_cache.stats().misses),
+        static_cast<unsigned long long>(pool.allocs),
+        static_cast<unsigned long long>(pool.reuses),
+        double(pool.idleBytes) / 1048576.0,
+        double(gpu.current) / 1048576.0, double(gpu.peak) / 1048576.0,
+        double(host.current) / 1048576.0, double(host.peak) / 1048576.0,
+        m_stats.loadTime_ms, m_stats.decodeTime_ms, m_stats.uploadTime_ms,
+        m_stats.renderTime_ms, m_stats.downloadTime_ms, m_stats.encodeTime_ms, m_stats.hashTime_ms);
+    return buf;
+}
+
+std::string Daemon::cmdCache(const std::vector<std::string>& args) {
+    const char* usage = "ERR usage: cache [memory <MiB> | disk <dir> <MiB> | disk off | clear]";
+    if ((args.size() == 3) && (args[1] == "memory")) {
+        m_cache.setMemoryLimit(size_t(atol(args[2].c_str())) << 20);
+    } else if ((args.size() == 3) && (args[1] == "disk") && (args[2] == "off")) {
+        m_cache.setDiskTier(nullptr, 0);
+    } else if ((args.size() == 4) && (args[1] == "disk")) {
+        if (!m_cache.setDiskTier(args[2].c_str(), uint64_t(atoll(args[3].c_str())) << 20)) {
+            return "ERR can't open cache directory";
+        }
+    } else if ((args.size() == 2) && (args[1] == "clear")) {
+        m_cache.clear();
+    } else if (args.size() != 1) {
+        return usage;
+    }
+    const ResultCache::Stats& s = m_cache.stats();
+    char buf[512];
+    snprintf(buf, sizeof(buf),
+        "OK memory_entries=%d memory_bytes=%llu memory_limit=%llu disk_entries=%d disk_bytes=%llu disk_limit=%llu"
+        " hits=%llu disk_hits=%llu misses=%llu stores=%llu evictions=%llu",
+        m_cache.memoryEntries(),
+        static_cast<unsigned long long>(m_cache.memoryUsed()),
+        static_cast<unsigned long long>(m_cache.memoryLimit()),
+        m_cache.diskEntries(),
+        static_cast<unsigned long long>(m_cache.diskUsed()),
+        static_cast<unsigned long long>(m_cache.diskLimit()),
+        static_cast<unsigned long long>(s.hits),
+        static_cast<unsigned long long>(s.diskHits),
+        static_cast<unsigned long long>(s.misses),
+        static_cast<unsigned long long>(s.stores),
+        static_cast<unsigned long long>(s.evictions));
+    return buf;
+}
+
+std::string Daemon::cmdMemory(const std::vector<std::string>& args) {
+    if ((args.size() == 4) && (args[1] == "budget")) {
+        Memory::setBudget(uint64_t(atoll(args[2].c_str())) << 20, uint64_t(atoll(args[3].c_str())) << 20);
+    } else if ((args.size() == 2) && (args[1] == "reset")) {
+        Memory::resetPeaks();
+    } else if (args.size() != 1) {
+        return "ERR usage: memory [budget <gpu-MiB> <host-MiB> | reset]";
+    }
+    static const char* const keys[MemCategoryCount] = { "source", "intermediate", "staging", "image_buffers", "clipboard" };
+    std::string response("OK");
+    char buf[128];
+    auto addUsage = [&] (const char* key, const Memory::Usage& u) {
+        snprintf(buf, sizeof(buf), " %s_mb=%.1f %s_peak_mb=%.1f", key, double(u.current) / 1048576.0, key, double(u.peak) / 1048576.0);
+        response += buf;
+    };
+    for (int i = 0;  i < MemCategoryCount;  ++i) {
+        addUsage(keys[i], Memory::getUsage(static_cast<MemCategory>(i)));
+    }
+    addUsage("gpu", Memory::getGPUTotal());
+    addUsage("host", Memory::getHostTotal());
+    snprintf(buf, sizeof(buf), " gpu_budget_mb=%llu host_budget_mb=%llu",
+             static_cast<unsigned long long>(Memory::gpuBudget() >> 20), static_cast<unsigned long long>(Memory::hostBudget() >> 20));
+    response += buf;
+    return response;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+}  // namespace GIPS
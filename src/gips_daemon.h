@@ -0,0 +1,82 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstdint>
+
+#include <string>
+#include <vector>
+
+#include "thread_pool.h"
+
+#include "gips_core.h"
+#include "gips_context.h"
+#include "gips_cache.h"
+#include "gips_cli.h"
+
+namespace GIPS {
+
+///////////////////////////////////////////////////////////////////////////////
+
+//! persistent rendering server that listens on a Unix domain socket;
+//! keeps the GL context, compiled programs and loaded pipelines warm
+//! between requests (see the "Daemon Mode" section in README.md)
+class Daemon {
+private:
+    // paths
+    std::string m_appDir;
+    std::string m_appUIConfigFile;
+    std::string m_socketPath;
+    int m_listenFD = -1;
+    bool m_active = true;
+
+    // GL context and pipelines
+    HeadlessContext m_ctx;
+
+    // render result cache (disabled unless configured with the "cache" command)
+    ResultCache m_cache;
+
+    // worker threads for image encoding
+    ThreadPool m_threadPool;
+
+    // statistics
+    struct Stats {
+        uint64_t requests  = 0;
+        uint64_t errors    = 0;
+        uint64_t loads     = 0;
+        uint64_t warmLoads = 0;
+        uint64_t renders   = 0;
+        double loadTime_ms     = 0.0;
+        double decodeTime_ms   = 0.0;
+        double uploadTime_ms   = 0.0;
+        double renderTime_ms   = 0.0;
+        double downloadTime_ms = 0.0;
+        double encodeTime_ms   = 0.0;
+        double hashTime_ms     = 0.0;
+    } m_stats;
+
+    // initialization
+    bool startListening();
+    void stopListening();
+
+    // request handling
+    void serveClient(int fd);
+    std::string handleRequest(const char* line);
+    std::string cmdLoad(const std::vector<std::string>& args);
+    std::string cmdUnload(const std::vector<std::string>& args);
+    std::string cmdSet(const std::vector<std::string>& args);
+    std::string cmdRender(const std::vector<std::string>& args);
+    std::string cmdRenderShm(const std::vector<std::string>& args);
+    std::string cmdStats();
+    std::string cmdCache(const std::vector<std::string>& args);
+    std::string cmdMemory(const std::vector<std::string>& args);
+
+public:
+    inline Daemon() {}
+    int run(int argc, char* argv[]);
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+}  // namespace GIPS
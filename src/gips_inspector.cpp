@@ -0,0 +1,151 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+
+#include <algorithm>
+
+#include "gl_header.h"
+#include "gl_util.h"
+
+#include "gips_memory.h"
+#include "gips_inspector.h"
+
+namespace GIPS {
+
+///////////////////////////////////////////////////////////////////////////////
+
+static inline float decodeSRGB(float x) {
+    return (x <= 0.04045f) ? (x / 12.92f) : std::pow((x + 0.055f) / 1.055f, 2.4f);
+}
+
+static inline float applySwizzle(GLint sel, const float* rgba) {
+    switch (sel) {
+        case GL_RED:   return rgba[0];
+        case GL_GREEN: return rgba[1];
+        case GL_BLUE:  return rgba[2];
+        case GL_ALPHA: return rgba[3];
+        case GL_ONE:   return 1.0f;
+        default:       return 0.0f;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool PixelInspector::init() {
+    if (m_initialized) {
+        return m_initOK;
+    }
+    m_initialized = true;
+    GLutil::clearError();
+    m_fbo.init();
+    glGenBuffers(1, &m_pbo);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbo);
+    glBufferData(GL_PIXEL_PACK_BUFFER, GLsizeiptr(MaxSize * MaxSize * 4 * sizeof(float)), nullptr, GL_STREAM_READ);
+    Memory::trackBuffer(MemCategory::Staging, m_pbo, MaxSize * MaxSize * 4 * sizeof(float));
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    m_initOK = (GLutil::checkError("pixel inspector setup") == GL_NO_ERROR);
+    return m_initOK;
+}
+
+void PixelInspector::free() {
+    if (GLutil::initialized) {
+        if (m_fence) { glDeleteSync(m_fence); }
+        if (m_pbo) { glDeleteBuffers(1, &m_pbo); }
+    }
+    Memory::untrackBuffer(m_pbo);
+    m_fence = nullptr;
+    m_pbo = 0;
+    m_fbo.free();
+    m_haveResult = false;
+    m_initialized = m_initOK = false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool PixelInspector::request(GLuint tex, int texWidth, int texHeight, int x, int y, int size) {
+    if (m_fence || !tex || !init()) { return false; }
+    Region r;
+    r.cx = x;
+    r.cy = y;
+    r.size = std::min(std::max(size | 1, 1), MaxSize);
+    int radius = r.size >> 1;
+    r.x0 = std::max(x - radius, 0);
+    r.y0 = std::max(y - radius, 0);
+    r.w = std::min(x + radius + 1, texWidth)  - r.x0;
+    r.h = std::min(y + radius + 1, texHeight) - r.y0;
+    if ((r.w <= 0) || (r.h <= 0)) { return false; }
+
+    // readback ignores swizzles and doesn't decode sRGB,
+    // so find out what the texture would return when sampled
+    GLutil::clearError();
+    GLint texFormat = 0;
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, r.swizzle);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &texFormat);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    r.srgb = (texFormat == GL_SRGB8_ALPHA8) || (texFormat == GL_SRGB8);
+
+    // issue the readback into the PBO and put a fence behind it
+    if (!m_fbo.begin(tex)) { m_fbo.end(); return false; }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbo);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(r.x0, r.y0, r.w, r.h, GL_RGBA, GL_FLOAT, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    m_fbo.end();
+    if (GLutil::checkError("pixel inspector readback")) { return false; }
+    m_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_pending = r;
+    return (m_fence != nullptr);
+}
+
+bool PixelInspector::poll() {
+    if (!m_fence) { return false; }
+    GLenum res = glClientWaitSync(m_fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (res == GL_TIMEOUT_EXPIRED) { return false; }
+    glDeleteSync(m_fence);
+    m_fence = nullptr;
+    if (res == GL_WAIT_FAILED) { return false; }
+
+    // the data is there, so mapping the buffer won't stall
+    const Region& r = m_pending;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbo);
+    const float* data = static_cast<const float*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, GLsizeiptr(r.w * r.h * 4 * int(sizeof(float))), GL_MAP_READ_BIT));
+    if (data) {
+        int radius = r.size >> 1;
+        for (int i = 0;  i < r.size;  ++i) {
+            for (int j = 0;  j < r.size;  ++j) {
+                int x = r.cx - radius + j - r.x0;
+                int y = r.cy - radius + i - r.y0;
+                int idx = i * r.size + j;
+                m_inside[idx] = (x >= 0) && (y >= 0) && (x < r.w) && (y < r.h);
+                if (!m_inside[idx]) { continue; }
+                const float* src = &data[(y * r.w + x) * 4];
+                for (int c = 0;  c < 4;  ++c) {
+                    float v = applySwizzle(r.swizzle[c], src);
+                    m_pixels[idx][c] = (r.srgb && (c < 3)) ? decodeSRGB(v) : v;
+                }
+            }
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        m_result = r;
+        m_haveResult = true;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    GLutil::checkError("pixel inspector result mapping");
+    return (data != nullptr);
+}
+
+const float* PixelInspector::pixel(int dx, int dy) const {
+    if (!m_haveResult) { return nullptr; }
+    int radius = m_result.size >> 1;
+    if ((dx < -radius) || (dx > radius) || (dy < -radius) || (dy > radius)) { return nullptr; }
+    int idx = (dy + radius) * m_result.size + (dx + radius);
+    return m_inside[idx] ? m_pixels[idx] : nullptr;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+}  // namespace GIPS
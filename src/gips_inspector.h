@@ -0,0 +1,73 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+// Pixel inspector: reads back a small region of a texture as floating-point
+// RGBA values without stalling, using a pixel pack buffer and a fence that
+// is polled in later frames.
+
+#pragma once
+
+#include "gl_header.h"
+#include "gl_util.h"
+
+namespace GIPS {
+
+///////////////////////////////////////////////////////////////////////////////
+
+class PixelInspector {
+public:
+    static constexpr int MaxSize = 15;  //!< maximum edge length of the inspected region
+
+private:
+    struct Region {
+        int cx = 0, cy = 0;  //!< center of the region
+        int size = 0;        //!< edge length of the region (odd)
+        int x0 = 0, y0 = 0;  //!< first pixel that has actually been read
+        int w = 0, h = 0;    //!< size of the area that has actually been read
+        GLint swizzle[4] = { GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA };
+        bool srgb = false;   //!< values need to be decoded from sRGB
+    };
+    GLutil::FBO m_fbo;
+    GLuint m_pbo = 0;
+    GLsync m_fence = nullptr;
+    Region m_pending;
+    Region m_result;
+    bool m_haveResult = false;
+    float m_pixels[MaxSize * MaxSize][4];
+    bool m_inside[MaxSize * MaxSize];
+    bool m_initialized = false;
+    bool m_initOK = false;
+
+public:
+    bool init();
+    void free();
+    inline bool good() const { return m_initOK; }
+
+    //! start reading back a size x size pixel region centered around (x,y)
+    //! of a texture (with row 0 being the first row of the texture);
+    //! the texture's swizzle is honored, sRGB textures are decoded
+    //! \returns false if the region is outside of the texture, or the
+    //!          previous request hasn't finished yet
+    bool request(GLuint tex, int texWidth, int texHeight, int x, int y, int size);
+    inline bool pending() const { return (m_fence != nullptr); }
+
+    //! check whether a pending readback has finished, without blocking
+    //! \returns true if a new result is available
+    bool poll();
+
+    inline bool hasResult()  const { return m_haveResult; }
+    inline int  resultX()    const { return m_result.cx; }
+    inline int  resultY()    const { return m_result.cy; }
+    inline int  resultSize() const { return m_result.size; }
+    //! get a pixel of the result, relative to its center
+    //! \returns an RGBA value, or nullptr if the pixel is outside of the image
+    const float* pixel(int dx, int dy) const;
+
+    inline PixelInspector() {}
+    PixelInspector(const PixelInspector&) = delete;
+    inline ~PixelInspector() { free(); }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+}  // namespace GIPS
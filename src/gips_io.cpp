@@ -11,8 +11,10 @@
 #include <algorithm>
 #include <string>
 #include <sstream>
+#include <vector>
 
 #include "string_util.h"
+#include "file_util.h"
 #include "vfs.h"
 
 #include "gips_core.h"
@@ -122,6 +124,7 @@ int Pipeline::unserialize(char* data) {
     int showIndex = -1;
     float vnum[4];
     bool versionOK = false;
+    std::vector<Node*> oldNodes;  // previous nodes, candidates for reuse
     while (*data) {  // line loop
         // skip initial whitespace
         while ((*data == ' ') || (*data == '\t')) { ++data; }
@@ -155,7 +158,9 @@ int Pipeline::unserialize(char* data) {
             // special checks for first node
             if (!node) {
                 if (!versionOK) { return -1; }
-                clear();
+                // don't throw away the old nodes yet, they may be reused
+                oldNodes.swap(m_nodes);
+                m_pipelineChanged = true;
             }
 
             // resolve filename
@@ -172,8 +177,27 @@ int Pipeline::unserialize(char* data) {
                 }
             #endif
 
-            // load node
-            node = addNode(filename ? filename : line);
+            // reuse an identical old node, or load a new one
+            const char* path = filename ? filename : line;
+            FileUtil::FileFingerprint fp(path);
+            auto it = std::find_if(oldNodes.begin(), oldNodes.end(), [&] (const Node* n) -> bool {
+                return !n->m_bundled && n->good() && (n->m_filename == path) && (n->m_fp == fp);
+            });
+            if (it != oldNodes.end()) {
+                #ifndef NDEBUG
+                    fprintf(stderr, "reusing unchanged node '%s'\n", path);
+                #endif
+                node = *it;
+                oldNodes.erase(it);
+                node->reset();
+                node->m_enabled = true;
+                node->m_exportTap = false;
+                node->m_errors.resize(node->m_loadErrorsLength);
+                node->m_programChanged = true;
+                m_nodes.push_back(node);
+            } else {
+                node = addNode(path, fp.good() ? &fp : nullptr);
+            }
             ::free(filename);
             continue;
         }
@@ -279,6 +303,9 @@ int Pipeline::unserialize(char* data) {
             }
         }
     }
+
+    // delete old nodes that haven't been reused
+    for (Node* n : oldNodes) { delete n; }
     return (showIndex >= 0) ? showIndex : nodeCount();
 }
 
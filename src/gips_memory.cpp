@@ -0,0 +1,225 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#include <cstdio>
+#include <cstdint>
+
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+#include <mutex>
+
+#include "buffer_pool.h"
+
+#include "gips_memory.h"
+
+namespace GIPS {
+namespace Memory {
+
+///////////////////////////////////////////////////////////////////////////////
+
+// BufferPool usage classes of the host categories
+constexpr int ImageBufferClass = 0;
+constexpr int ClipboardClass   = 1;
+
+// textures and buffer objects have separate name spaces
+constexpr uint64_t BufferKey = uint64_t(1) << 32;
+
+struct Object {
+    MemCategory cat;
+    uint64_t size;
+};
+
+static std::mutex trackLock;
+static std::unordered_map<uint64_t, Object> objects;
+static Usage gpuUsage[MemCategoryCount];
+static Usage gpuTotal;
+static uint64_t gpuBudgetBytes = 0;
+static uint64_t hostBudgetBytes = 0;
+
+const char* categoryName(MemCategory cat) {
+    switch (cat) {
+        case MemCategory::SourceImage:  return "source image";
+        case MemCategory::Intermediate: return "intermediate buffers";
+        case MemCategory::Staging:      return "staging buffers";
+        case MemCategory::ImageBuffers: return "image buffers";
+        case MemCategory::Clipboard:    return "clipboard image";
+        default: return "???";
+    }
+}
+
+uint64_t textureSize(int width, int height, GLenum internalFormat) {
+    if ((width <= 0) || (height <= 0)) { return 0; }
+    int bpp;
+    switch (internalFormat) {
+        case GL_R8: case GL_R8UI:                       bpp =  1; break;
+        case GL_RG8: case GL_R16: case GL_R16F:
+        case GL_R16UI:                                  bpp =  2; break;
+        case GL_RGBA16: case GL_RGBA16F: case GL_RG32F: bpp =  8; break;
+        case GL_RGBA32F:                                bpp = 16; break;
+        default:  // includes RGB formats, which are padded to 32 bits anyway
+            bpp = 4; break;
+    }
+    return uint64_t(width) * uint64_t(height) * uint64_t(bpp);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+//! remove an object from the accounting; trackLock must be held
+static void removeObject(uint64_t key) {
+    auto it = objects.find(key);
+    if (it == objects.end()) { return; }
+    gpuUsage[static_cast<int>(it->second.cat)].current -= it->second.size;
+    gpuTotal.current -= it->second.size;
+    objects.erase(it);
+}
+
+static void setObject(uint64_t key, MemCategory cat, uint64_t size) {
+    std::lock_guard<std::mutex> lock(trackLock);
+    removeObject(key);
+    if (!size || !isGPU(cat)) { return; }
+    Object& obj = objects[key];
+    obj.cat = cat;
+    obj.size = size;
+    Usage& u = gpuUsage[static_cast<int>(cat)];
+    u.current += size;
+    u.peak = std::max(u.peak, u.current);
+    gpuTotal.current += size;
+    gpuTotal.peak = std::max(gpuTotal.peak, gpuTotal.current);
+}
+
+void trackTexture(MemCategory cat, GLuint tex, int width, int height, GLenum internalFormat) {
+    if (tex) { setObject(uint64_t(tex), cat, textureSize(width, height, internalFormat)); }
+}
+
+void untrackTexture(GLuint tex) {
+    std::lock_guard<std::mutex> lock(trackLock);
+    removeObject(uint64_t(tex));
+}
+
+void untrackTextures(int count, const GLuint* tex) {
+    std::lock_guard<std::mutex> lock(trackLock);
+    for (int i = 0;  i < count;  ++i) {
+        removeObject(uint64_t(tex[i]));
+    }
+}
+
+void trackBuffer(MemCategory cat, GLuint buf, size_t size) {
+    if (buf) { setObject(BufferKey | uint64_t(buf), cat, uint64_t(size)); }
+}
+
+void untrackBuffer(GLuint buf) {
+    std::lock_guard<std::mutex> lock(trackLock);
+    removeObject(BufferKey | uint64_t(buf));
+}
+
+uint64_t trackedTextureSize(GLuint tex) {
+    std::lock_guard<std::mutex> lock(trackLock);
+    auto it = objects.find(uint64_t(tex));
+    return (it != objects.end()) ? it->second.size : 0;
+}
+
+void tagClipboardBuffer(void* ptr) {
+    BufferPool::setUsageClass(ptr, ClipboardClass);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+Usage getUsage(MemCategory cat) {
+    Usage u;
+    if (isGPU(cat)) {
+        std::lock_guard<std::mutex> lock(trackLock);
+        u = gpuUsage[static_cast<int>(cat)];
+    } else if ((cat == MemCategory::ImageBuffers) || (cat == MemCategory::Clipboard)) {
+        int usageClass = (cat == MemCategory::Clipboard) ? ClipboardClass : ImageBufferClass;
+        BufferPool::Stats pool = BufferPool::getStats();
+        u.current = pool.classBytes[usageClass];
+        u.peak = pool.classPeakBytes[usageClass];
+    }
+    return u;
+}
+
+Usage getGPUTotal() {
+    std::lock_guard<std::mutex> lock(trackLock);
+    return gpuTotal;
+}
+
+Usage getHostTotal() {
+    BufferPool::Stats pool = BufferPool::getStats();
+    Usage u;
+    u.current = pool.liveBytes;
+    u.peak = pool.peakLiveBytes;
+    return u;
+}
+
+void resetPeaks() {
+    {
+        std::lock_guard<std::mutex> lock(trackLock);
+        for (auto& u : gpuUsage) { u.peak = u.current; }
+        gpuTotal.peak = gpuTotal.current;
+    }
+    BufferPool::resetPeaks();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void setBudget(uint64_t gpuBytes, uint64_t hostBytes) {
+    std::lock_guard<std::mutex> lock(trackLock);
+    gpuBudgetBytes = gpuBytes;
+    hostBudgetBytes = hostBytes;
+}
+
+uint64_t gpuBudget() {
+    std::lock_guard<std::mutex> lock(trackLock);
+    return gpuBudgetBytes;
+}
+
+uint64_t hostBudget() {
+    std::lock_guard<std::mutex> lock(trackLock);
+    return hostBudgetBytes;
+}
+
+static bool fits(uint64_t budget, uint64_t current, uint64_t required, uint64_t replaced) {
+    if (!budget) { return true; }
+    current -= std::min(current, replaced);
+    return (current + required) <= budget;
+}
+
+bool fitsGPU(uint64_t required, uint64_t replaced) {
+    std::lock_guard<std::mutex> lock(trackLock);
+    return fits(gpuBudgetBytes, gpuTotal.current, required, replaced);
+}
+
+bool fitsHost(uint64_t required, uint64_t replaced) {
+    uint64_t current = BufferPool::getStats().liveBytes;
+    return fits(hostBudget(), current, required, replaced);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+static void addReportLine(std::string& report, const char* name, const Usage& u, uint64_t budget=0) {
+    char line[160];
+    int len = snprintf(line, sizeof(line), "%-20s %8.1f MiB (peak %8.1f MiB)", name,
+                       double(u.current) / 1048576.0, double(u.peak) / 1048576.0);
+    if (budget && (len > 0) && (size_t(len) < sizeof(line))) {
+        snprintf(&line[len], sizeof(line) - size_t(len), ", budget %.0f MiB", double(budget) / 1048576.0);
+    }
+    report += line;
+    report += '\n';
+}
+
+std::string getReport() {
+    std::string report;
+    for (int i = 0;  i < MemCategoryCount;  ++i) {
+        MemCategory cat = static_cast<MemCategory>(i);
+        addReportLine(report, categoryName(cat), getUsage(cat));
+        if (cat == MemCategory::Staging) { addReportLine(report, "GPU total", getGPUTotal(), gpuBudget()); }
+    }
+    addReportLine(report, "host total", getHostTotal(), hostBudget());
+    return report;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+}  // namespace Memory
+}  // namespace GIPS
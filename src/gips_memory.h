@@ -0,0 +1,87 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+// Accounting of the large memory objects GIPS works with: the source image
+// texture, the pipeline's intermediate buffers, staging textures and
+// transfer buffers on the GPU side, and pooled image buffers (decoding,
+// encoding, clipboard) on the host side. Current and peak usage is tracked
+// per category, and a budget can be set for each side, so that jobs that
+// would exceed it can be refused (or scaled down) before anything is
+// allocated. GPU sizes are computed from texture geometry and format, so
+// they don't include driver overhead like alignment or mipmaps.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <string>
+
+#include "gl_header.h"
+
+namespace GIPS {
+
+///////////////////////////////////////////////////////////////////////////////
+
+enum class MemCategory : int {
+    // GPU memory
+    SourceImage = 0,  //!< input image textures
+    Intermediate,     //!< the pipelines' intermediate buffers
+    Staging,          //!< staging, snapshot and analysis textures; transfer buffers
+    // host memory
+    ImageBuffers,     //!< decoded and encoded image data
+    Clipboard,        //!< image imported from the clipboard
+    Count
+};
+constexpr int MemCategoryCount = static_cast<int>(MemCategory::Count);
+
+namespace Memory {
+
+const char* categoryName(MemCategory cat);
+inline bool isGPU(MemCategory cat) { return cat < MemCategory::ImageBuffers; }
+
+//! size of a texture level with the given internal format
+uint64_t textureSize(int width, int height, GLenum internalFormat);
+
+//! register a texture's storage (after glTexImage2D etc.); calling this
+//! again for the same texture replaces its previous size and category
+void trackTexture(MemCategory cat, GLuint tex, int width, int height, GLenum internalFormat);
+void untrackTexture(GLuint tex);
+void untrackTextures(int count, const GLuint* tex);
+//! register a buffer object's storage (after glBufferData)
+void trackBuffer(MemCategory cat, GLuint buf, size_t size);
+void untrackBuffer(GLuint buf);
+//! tracked size of a texture (0 if it's not tracked)
+uint64_t trackedTextureSize(GLuint tex);
+
+//! mark a BufferPool buffer as the clipboard image (host buffers are
+//! accounted as image buffers otherwise)
+void tagClipboardBuffer(void* ptr);
+
+struct Usage {
+    uint64_t current = 0;
+    uint64_t peak = 0;
+};
+Usage getUsage(MemCategory cat);
+Usage getGPUTotal();
+Usage getHostTotal();
+void resetPeaks();
+
+//! set the budgets in bytes (0 = unlimited)
+void setBudget(uint64_t gpuBytes, uint64_t hostBytes);
+uint64_t gpuBudget();
+uint64_t hostBudget();
+
+//! check whether allocating 'required' bytes (while releasing 'replaced'
+//! bytes that are currently tracked) stays within the budget
+bool fitsGPU(uint64_t required, uint64_t replaced=0);
+bool fitsHost(uint64_t required, uint64_t replaced=0);
+
+//! multi-line usage report (one "category: current / peak" line each)
+std::string getReport();
+
+}  // namespace Memory
+
+///////////////////////////////////////////////////////////////////////////////
+
+}  // namespace GIPS
@@ -21,6 +21,7 @@
 #include "string_util.h"
 #include "vfs.h"
 
+#include "gips_paths.h"
 #include "gips_app.h"
 
 // whether to use the system-wide shader directories even for portable installations
@@ -57,30 +58,30 @@ static char* getExecutablePath(const char* argv0) {
 
 ///////////////////////////////////////////////////////////////////////////////
 
-void GIPS::App::setPaths(const char* argv0) {
+void GIPS::setupPaths(const char* argv0, std::string& appDir, std::string& uiConfigFile) {
     // get app's base directory
     char* me = getExecutablePath(argv0);
     StringUtil::pathRemoveBaseName(me);
-    m_appDir = me;
+    appDir = me;
     ::free(me);
     #ifndef NDEBUG
-        fprintf(stderr, "application directory: '%s'\n", m_appDir.c_str());
+        fprintf(stderr, "application directory: '%s'\n", appDir.c_str());
     #endif
 
     // detect whether we have a "portable" installation
     #ifdef _WIN32
         // Win32: it's portable if the executable isn't located in "Program Files"
         // or "ProgramData" (the latter can happen if installed via a package manger)
-        bool portable = !StringUtil::pathContains(m_appDir.c_str(), "Program Files")
-                     && !StringUtil::pathContains(m_appDir.c_str(), "Program Files (x86)")
-                     && !StringUtil::pathContains(m_appDir.c_str(), "ProgramData")
-                     && !StringUtil::pathContains(m_appDir.c_str(), "PROGRA~1")
-                     && !StringUtil::pathContains(m_appDir.c_str(), "PROGRA~2")
-                     && !StringUtil::pathContains(m_appDir.c_str(), "PROGRA~3");
+        bool portable = !StringUtil::pathContains(appDir.c_str(), "Program Files")
+                     && !StringUtil::pathContains(appDir.c_str(), "Program Files (x86)")
+                     && !StringUtil::pathContains(appDir.c_str(), "ProgramData")
+                     && !StringUtil::pathContains(appDir.c_str(), "PROGRA~1")
+                     && !StringUtil::pathContains(appDir.c_str(), "PROGRA~2")
+                     && !StringUtil::pathContains(appDir.c_str(), "PROGRA~3");
     #else
         // POSIX: it's portable if the executable isn't located in /usr or /opt
-        bool portable = strncmp(m_appDir.c_str(), "/usr/", 5)
-                     && strncmp(m_appDir.c_str(), "/opt/", 5);
+        bool portable = strncmp(appDir.c_str(), "/usr/", 5)
+                     && strncmp(appDir.c_str(), "/opt/", 5);
     #endif
     #ifndef NDEBUG
         fprintf(stderr, "installation type: %s\n", portable ? "portable" : "system");
@@ -106,7 +107,7 @@ void GIPS::App::setPaths(const char* argv0) {
 
     // set configuration file location
     if (portable || userCfgDir.empty()) {
-        m_appUIConfigFile = m_appDir + StringUtil::defaultPathSep + "gips_ui.ini";
+        uiConfigFile = appDir + StringUtil::defaultPathSep + "gips_ui.ini";
     } else {
         // system-wide installation: ensure that the config directory exists
         #ifdef _WIN32
@@ -114,15 +115,15 @@ void GIPS::App::setPaths(const char* argv0) {
         #else
             mkdir(userCfgDir.c_str(), 0755);
         #endif
-        m_appUIConfigFile = userCfgDir + StringUtil::defaultPathSep + "gips_ui.ini";
+        uiConfigFile = userCfgDir + StringUtil::defaultPathSep + "gips_ui.ini";
     }
     #ifndef NDEBUG
-        fprintf(stderr, "UI config file: '%s'\n", m_appUIConfigFile.c_str());
+        fprintf(stderr, "UI config file: '%s'\n", uiConfigFile.c_str());
     #endif
 
     // set shader directories
     // - program directory (and that's the only one in true portable mode)
-    VFS::addRoot(m_appDir + StringUtil::defaultPathSep + "shaders");
+    VFS::addRoot(appDir + StringUtil::defaultPathSep + "shaders");
     if (!portable || allowSystemWideShaderDirsForPortableInstalls) {
         // - "shaders" subdirectory of user config directory
         if (!userCfgDir.empty()) {
@@ -140,3 +141,7 @@ void GIPS::App::setPaths(const char* argv0) {
         #endif
     }
 }
+
+void GIPS::App::setPaths(const char* argv0) {
+    setupPaths(argv0, m_appDir, m_appUIConfigFile);
+}
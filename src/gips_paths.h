@@ -0,0 +1,14 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <string>
+
+namespace GIPS {
+
+//! determine the application and configuration directories
+//! and register the shader directories as VFS roots
+void setupPaths(const char* argv0, std::string& appDir, std::string& uiConfigFile);
+
+}  // namespace GIPS
@@ -0,0 +1,185 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include <string>
+
+#include "string_util.h"
+
+#include "gips_pnm.h"
+
+namespace GIPS {
+
+///////////////////////////////////////////////////////////////////////////////
+
+static inline bool isPNMSpace(uint8_t c) {
+    return (c == ' ') || (c == '\t') || (c == '\n') || (c == '\r');
+}
+
+//! skip whitespace and comments before a header token
+//! \returns false if there was no whitespace at all
+static bool skipSpace(const uint8_t* &p, const uint8_t* end) {
+    bool haveSpace = false;
+    while (p < end) {
+        if (*p == '#') {
+            while ((p < end) && (*p != '\n') && (*p != '\r')) { ++p; }
+        } else if (isPNMSpace(*p)) {
+            ++p;
+        } else { break; }
+        haveSpace = true;
+    }
+    return haveSpace;
+}
+
+//! parse a whitespace-delimited token
+static std::string getToken(const uint8_t* &p, const uint8_t* end) {
+    std::string token;
+    while ((p < end) && !isPNMSpace(*p) && (token.size() < 64)) {
+        token.push_back(char(*p++));
+    }
+    return token;
+}
+
+//! parse a positive decimal number
+static int getNumber(const std::string& token) {
+    if (token.empty()) { return 0; }
+    int value = 0;
+    for (char c : token) {
+        if ((c < '0') || (c > '9')) { return 0; }
+        value = value * 10 + int(c - '0');
+        if (value > 0xFFFFFF) { return 0; }
+    }
+    return value;
+}
+
+static bool setMaxValue(ImageBuffer& image, int maxValue) {
+    if (maxValue == 255) {
+        image.format = PixelFormat::Int8;
+    } else if (maxValue == 65535) {
+        image.format = PixelFormat::Int16;
+        image.bigEndian = true;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+//! parse the line-based PAM header (after the "P7" magic)
+static bool parsePAMHeader(const uint8_t* &p, const uint8_t* end, ImageBuffer& image) {
+    int maxValue = 0;
+    for (;;) {
+        skipSpace(p, end);
+        if (p >= end) { return false; }
+        std::string key = getToken(p, end);
+        if (key == "ENDHDR") {
+            // the header ends with a single newline
+            if ((p >= end) || (*p != '\n')) { return false; }
+            ++p;
+            break;
+        }
+        while ((p < end) && ((*p == ' ') || (*p == '\t'))) { ++p; }
+        std::string value = getToken(p, end);
+        if      (key == "WIDTH")  { image.width    = getNumber(value); }
+        else if (key == "HEIGHT") { image.height   = getNumber(value); }
+        else if (key == "DEPTH")  { image.channels = getNumber(value); }
+        else if (key == "MAXVAL") { maxValue       = getNumber(value); }
+        // TUPLTYPE is implied by the depth and can be ignored
+        while ((p < end) && (*p != '\n')) { ++p; }
+    }
+    return (image.channels >= 1) && (image.channels <= 4) && setMaxValue(image, maxValue);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool isPNMFile(const char* filename) {
+    uint32_t extCode = StringUtil::extractExtCode(filename);
+    return (extCode == StringUtil::makeExtCode("pgm"))
+        || (extCode == StringUtil::makeExtCode("ppm"))
+        || (extCode == StringUtil::makeExtCode("pnm"))
+        || (extCode == StringUtil::makeExtCode("pam"))
+        || (extCode == StringUtil::makeExtCode("pfm"));
+}
+
+bool parsePNM(const void* fileData, size_t fileSize, ImageBuffer& image) {
+    const uint8_t* p = static_cast<const uint8_t*>(fileData);
+    const uint8_t* end = p + fileSize;
+    if (!p || (fileSize < 3) || (p[0] != 'P')) { return false; }
+    uint8_t type = p[1];
+    p += 2;
+    image = ImageBuffer();
+
+    if (type == '7') {
+        if (!parsePAMHeader(p, end, image)) { return false; }
+    } else {
+        if ((type != '5') && (type != '6') && (type != 'F') && (type != 'f')) { return false; }
+        std::string header[3];
+        for (int i = 0;  i < 3;  ++i) {
+            if (!skipSpace(p, end) || (p >= end)) { return false; }
+            header[i] = getToken(p, end);
+        }
+        // exactly one whitespace character separates the header from the data
+        if ((p >= end) || !isPNMSpace(*p)) { return false; }
+        ++p;
+        image.width  = getNumber(header[0]);
+        image.height = getNumber(header[1]);
+        if ((type == 'F') || (type == 'f')) {
+            // the sign of the scale factor indicates the byte order;
+            // rows are stored from bottom to top
+            char* scaleEnd = nullptr;
+            double scale = strtod(header[2].c_str(), &scaleEnd);
+            if (!scaleEnd || *scaleEnd || !(scale != 0.0)) { return false; }
+            image.format = PixelFormat::Float32;
+            image.channels = (type == 'F') ? 3 : 1;
+            image.bigEndian = (scale > 0.0);
+            image.bottomUp = true;
+        } else {
+            image.channels = (type == '6') ? 3 : 1;
+            if (!setMaxValue(image, getNumber(header[2]))) { return false; }
+        }
+    }
+
+    image.data = const_cast<uint8_t*>(p);
+    return (image.width > 0) && (image.height > 0) && (image.dataSize() <= size_t(end - p));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+std::string makePNMHeader(const char* filename, ImageBuffer& image) {
+    uint32_t extCode = StringUtil::extractExtCode(filename);
+    bool pfm = (extCode == StringUtil::makeExtCode("pfm"));
+    bool pam = (extCode == StringUtil::makeExtCode("pam"));
+    bool pgm = (extCode == StringUtil::makeExtCode("pgm"));
+    if (!pfm && !pam && !pgm && !isPNMFile(filename)) { return std::string(); }
+    std::string size = std::to_string(image.width) + " " + std::to_string(image.height);
+    image.stride = 0;
+    image.bottomUp = pfm;
+    image.bigEndian = false;
+
+    if (pfm) {
+        // PFM: negative scale = little-endian samples
+        image.format = PixelFormat::Float32;
+        image.channels = 3;
+        return "PF\n" + size + "\n-1.0\n";
+    }
+    if (image.format != PixelFormat::Int8) {
+        image.format = PixelFormat::Int16;
+        image.bigEndian = true;  // Netpbm's 16-bit samples are always big-endian
+    }
+    const char* maxValue = (image.format == PixelFormat::Int8) ? "255" : "65535";
+    if (pam) {
+        image.channels = 4;
+        return "P7\nWIDTH " + std::to_string(image.width)
+            + "\nHEIGHT " + std::to_string(image.height)
+            + "\nDEPTH 4\nMAXVAL " + maxValue
+            + "\nTUPLTYPE RGB_ALPHA\nENDHDR\n";
+    }
+    image.channels = pgm ? 1 : 3;
+    return std::string(pgm ? "P5\n" : "P6\n") + size + "\n" + maxValue + "\n";
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+}  // namespace GIPS
@@ -0,0 +1,41 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+// Binary Netpbm (PGM/PPM), PAM and PFM file support. These formats are
+// little more than a text header in front of uncompressed pixel data,
+// so they can be processed straight out of (and into) memory-mapped files.
+
+#pragma once
+
+#include <cstddef>
+
+#include <string>
+
+#include "gips_context.h"
+
+namespace GIPS {
+
+///////////////////////////////////////////////////////////////////////////////
+
+//! check whether a file name has one of the extensions handled here
+//! (.pgm, .ppm, .pnm, .pam, .pfm)
+bool isPNMFile(const char* filename);
+
+//! parse a binary PGM/PPM (P5, P6), PAM (P7) or PFM (PF, Pf) file that's
+//! already in memory; fills in an ImageBuffer that points into the file data
+//! \returns false if the data isn't a supported file (only maximum values
+//!          of 255 and 65535 are supported for the integer formats)
+bool parsePNM(const void* fileData, size_t fileSize, ImageBuffer& image);
+
+//! set up the layout of an output image for the file type indicated by the
+//! file name's extension: .pgm is gray, .ppm and .pnm are RGB, .pam is RGBA
+//! and .pfm is 32-bit float RGB; the integer formats use 8 bits if the
+//! image's format is Int8 and 16 bits otherwise.
+//! Width and height must already be set; data is not touched.
+//! \returns the file header that precedes the pixel data,
+//!          or an empty string if the extension isn't supported
+std::string makePNMHeader(const char* filename, ImageBuffer& image);
+
+///////////////////////////////////////////////////////////////////////////////
+
+}  // namespace GIPS
@@ -0,0 +1,274 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#include <cstdio>
+
+#include <algorithm>
+#include <vector>
+
+#include "gl_header.h"
+#include "gl_util.h"
+
+#include "gips_core.h"
+#include "gips_memory.h"
+#include "gips_precision.h"
+
+namespace GIPS {
+
+///////////////////////////////////////////////////////////////////////////////
+
+// The analysis works in two steps: a "statistics" shader computes the
+// maximum absolute difference to the reference image as well as the
+// minimum and maximum component values of 4x4 pixel blocks, then a
+// "reduction" shader repeatedly combines 4x4 blocks of those results until
+// only a single pixel is left, which is read back to the CPU.
+static constexpr int BlockSize = 4;
+
+static const char* vsSource =
+         "#version 330 core"
+    "\n" "void main() {"
+    "\n" "  vec2 pos = vec2(float(gl_VertexID & 1), float((gl_VertexID & 2) >> 1));"
+    "\n" "  gl_Position = vec4(pos * 2.0 - 1.0, 0., 1.);"
+    "\n" "}"
+    "\n";
+
+static const char* statsSource =
+         "#version 330 core"
+    "\n" "uniform sampler2D gips_tex;"  // image to analyze
+    "\n" "uniform sampler2D gips_ref;"  // reference image
+    "\n" "uniform ivec2 gips_size;"     // size of the images
+    "\n" "uniform int gips_compare;"    // compare against the reference?
+    "\n" "out vec4 gips_stats;"
+    "\n" "void main() {"
+    "\n" "  ivec2 base = ivec2(gl_FragCoord.xy) * 4;"
+    "\n" "  ivec2 end = min(base + 4, gips_size);"
+    "\n" "  float maxErr = 0.0, minV = 3.0e38, maxV = -3.0e38;"
+    "\n" "  for (int y = base.y;  y < end.y;  ++y) {"
+    "\n" "    for (int x = base.x;  x < end.x;  ++x) {"
+    "\n" "      vec4 c = texelFetch(gips_tex, ivec2(x, y), 0);"
+    "\n" "      minV = min(minV, min(min(c.r, c.g), min(c.b, c.a)));"
+    "\n" "      maxV = max(maxV, max(max(c.r, c.g), max(c.b, c.a)));"
+    "\n" "      if (gips_compare != 0) {"
+    "\n" "        vec4 d = abs(clamp(c, 0.0, 1.0) - clamp(texelFetch(gips_ref, ivec2(x, y), 0), 0.0, 1.0));"
+    "\n" "        maxErr = max(maxErr, max(max(d.r, d.g), max(d.b, d.a)));"
+    "\n" "      }"
+    "\n" "    }"
+    "\n" "  }"
+    "\n" "  gips_stats = vec4(maxErr, minV, maxV, 0.0);"
+    "\n" "}"
+    "\n";
+
+static const char* reduceSource =
+         "#version 330 core"
+    "\n" "uniform sampler2D gips_tex;"  // statistics to reduce
+    "\n" "uniform ivec2 gips_size;"     // size of the valid area of the input
+    "\n" "out vec4 gips_stats;"
+    "\n" "void main() {"
+    "\n" "  ivec2 base = ivec2(gl_FragCoord.xy) * 4;"
+    "\n" "  ivec2 end = min(base + 4, gips_size);"
+    "\n" "  vec4 r = texelFetch(gips_tex, base, 0);"
+    "\n" "  for (int y = base.y;  y < end.y;  ++y) {"
+    "\n" "    for (int x = base.x;  x < end.x;  ++x) {"
+    "\n" "      vec4 s = texelFetch(gips_tex, ivec2(x, y), 0);"
+    "\n" "      r = vec4(max(r.x, s.x), min(r.y, s.y), max(r.z, s.z), 0.0);"
+    "\n" "    }"
+    "\n" "  }"
+    "\n" "  gips_stats = r;"
+    "\n" "}"
+    "\n";
+
+static inline int reducedSize(int size) {
+    return (size + BlockSize - 1) / BlockSize;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool PrecisionReport::anyOutOfRange() const {
+    for (const auto& n : nodes) {
+        if (n.outOfRange()) { return true; }
+    }
+    return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool PrecisionAdvisor::init() {
+    if (m_initialized) {
+        return m_initOK;
+    }
+    m_initialized = true;
+    GLutil::clearError();
+
+    m_vs.compile(GL_VERTEX_SHADER, vsSource);
+    GLutil::Shader statsFS(GL_FRAGMENT_SHADER, statsSource);
+    GLutil::Shader reduceFS(GL_FRAGMENT_SHADER, reduceSource);
+    #ifndef NDEBUG
+        if (statsFS.haveLog())  { fprintf(stderr, "precision statistics shader log:\n%s\n", statsFS.getLog()); }
+        if (reduceFS.haveLog()) { fprintf(stderr, "precision reduction shader log:\n%s\n", reduceFS.getLog()); }
+    #endif
+    if (!m_vs.good() || !statsFS.good() || !reduceFS.good()
+    ||  !m_statsProg.link(m_vs, statsFS) || !m_reduceProg.link(m_vs, reduceFS)) {
+        return false;
+    }
+
+    m_statsProg.use();
+    glUniform1i(m_statsProg.getUniformLocation("gips_tex"), 0);
+    glUniform1i(m_statsProg.getUniformLocation("gips_ref"), 1);
+    m_statsSizeLoc = m_statsProg.getUniformLocation("gips_size");
+    m_statsCompareLoc = m_statsProg.getUniformLocation("gips_compare");
+    m_reduceProg.use();
+    glUniform1i(m_reduceProg.getUniformLocation("gips_tex"), 0);
+    m_reduceSizeLoc = m_reduceProg.getUniformLocation("gips_size");
+    glUseProgram(0);
+
+    m_fbo.init();
+    glGenTextures(1, &m_refTex);
+    glGenTextures(2, m_tmpTex);
+    for (GLuint tex : { m_refTex, m_tmpTex[0], m_tmpTex[1] }) {
+        glBindTexture(GL_TEXTURE_2D, tex);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    m_initOK = (GLutil::checkError("precision advisor setup") == GL_NO_ERROR);
+    return m_initOK;
+}
+
+void PrecisionAdvisor::free() {
+    m_fbo.free();
+    m_statsProg.free();
+    m_reduceProg.free();
+    m_vs.free();
+    if (GLutil::initialized) {
+        if (m_refTex) { glDeleteTextures(1, &m_refTex); }
+        if (m_tmpTex[0] || m_tmpTex[1]) { glDeleteTextures(2, m_tmpTex); }
+    }
+    Memory::untrackTexture(m_refTex);
+    Memory::untrackTextures(2, m_tmpTex);
+    m_refTex = m_tmpTex[0] = m_tmpTex[1] = 0;
+    m_width = m_height = 0;
+    m_initialized = m_initOK = false;
+}
+
+void PrecisionAdvisor::resize(int width, int height) {
+    if ((width == m_width) && (height == m_height)) { return; }
+    glBindTexture(GL_TEXTURE_2D, m_refTex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+    Memory::trackTexture(MemCategory::Staging, m_refTex, width, height, GL_RGBA32F);
+    for (int i = 0;  i < 2;  ++i) {
+        glBindTexture(GL_TEXTURE_2D, m_tmpTex[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, reducedSize(width), reducedSize(height), 0, GL_RGBA, GL_FLOAT, nullptr);
+        Memory::trackTexture(MemCategory::Staging, m_tmpTex[i], reducedSize(width), reducedSize(height), GL_RGBA32F);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    GLutil::checkError("precision advisor buffer allocation");
+    m_width = width;
+    m_height = height;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool PrecisionAdvisor::measure(GLuint tex, GLuint refTex, float& maxError, float& minValue, float& maxValue) {
+    GLutil::clearError();
+    int w = reducedSize(m_width), h = reducedSize(m_height);
+    int current = 0;
+
+    // first step: per-block statistics of the full-resolution image
+    if (!m_fbo.begin(m_tmpTex[current])) { return false; }
+    glViewport(0, 0, w, h);
+    m_statsProg.use();
+    glUniform2i(m_statsSizeLoc, m_width, m_height);
+    glUniform1i(m_statsCompareLoc, refTex ? 1 : 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, refTex);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+
+    // further steps: reduce until there's only one pixel left
+    m_reduceProg.use();
+    while ((w > 1) || (h > 1)) {
+        if (!m_fbo.begin(m_tmpTex[current ^ 1])) { break; }
+        glViewport(0, 0, reducedSize(w), reducedSize(h));
+        glUniform2i(m_reduceSizeLoc, w, h);
+        glBindTexture(GL_TEXTURE_2D, m_tmpTex[current]);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        current ^= 1;
+        w = reducedSize(w);
+        h = reducedSize(h);
+    }
+
+    // read back the final result
+    float result[4] = { 0.0f, };
+    glReadPixels(0, 0, 1, 1, GL_RGBA, GL_FLOAT, result);
+    glUseProgram(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    m_fbo.end();
+    maxError = result[0];
+    minValue = result[1];
+    maxValue = result[2];
+    return (GLutil::checkError("precision measurement") == GL_NO_ERROR) && (w <= 1) && (h <= 1);
+}
+
+bool PrecisionAdvisor::analyze(Pipeline& pipeline, GLuint srcTex, int width, int height, int maxNodes, float tolerance, PrecisionReport& report) {
+    report = PrecisionReport();
+    report.tolerance = tolerance;
+    if (!init() || !pipeline.good() || !srcTex || (width < 1) || (height < 1)) { return false; }
+    if ((maxNodes < 0) || (maxNodes > pipeline.nodeCount())) { maxNodes = pipeline.nodeCount(); }
+    resize(width, height);
+    report.nodes.resize(size_t(maxNodes));
+
+    // reference run in the highest precision, measuring each node's range
+    pipeline.render(srcTex, width, height, PixelFormat::Float32, maxNodes,
+        [&] (int nodeIndex, GLuint tex) {
+            auto& n = report.nodes[size_t(nodeIndex)];
+            float dummy;
+            n.measured = measure(tex, 0, dummy, n.minValue, n.maxValue);
+        });
+    if (!m_fbo.begin(pipeline.expandResult())) { return false; }
+    glBindTexture(GL_TEXTURE_2D, m_refTex);
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    m_fbo.end();
+    if (GLutil::checkError("precision reference copy") != GL_NO_ERROR) { return false; }
+
+    // render in all formats and compare against the reference;
+    // Float32 is rendered again to get timing without the range measurements
+    for (PixelFormat fmt : { PixelFormat::Int8, PixelFormat::RGB10A2, PixelFormat::Int16, PixelFormat::R11G11B10F, PixelFormat::Float16, PixelFormat::Float32 }) {
+        PrecisionReport::FormatResult r;
+        r.format = fmt;
+        pipeline.render(srcTex, width, height, fmt, maxNodes);
+        r.renderTime_ms = pipeline.lastRenderTime_ms();
+        float minValue, maxValue;
+        if (!measure(pipeline.resultTex(), m_refTex, r.maxError, minValue, maxValue)) { return false; }
+        r.acceptable = (r.maxError <= tolerance);
+        report.formats.push_back(r);
+    }
+    pipeline.markAsChanged();
+
+    // pick the format with the least memory traffic; among formats with the
+    // same size, prefer the more accurate one
+    const PrecisionReport::FormatResult* best = nullptr;
+    for (const auto& r : report.formats) {
+        if (!r.acceptable) { continue; }
+        if (!best
+        ||  (getBytesPerPixel(r.format) < getBytesPerPixel(best->format))
+        || ((getBytesPerPixel(r.format) == getBytesPerPixel(best->format)) && (r.maxError < best->maxError))) {
+            best = &r;
+        }
+    }
+    report.recommended = best ? best->format : PixelFormat::Float32;
+    #ifndef NDEBUG
+        fprintf(stderr, "precision advisor: recommending %s (tolerance %g)\n", pixelFormatName(report.recommended), tolerance);
+    #endif
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+}  // namespace GIPS
@@ -0,0 +1,81 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+// Precision advisor: renders a pipeline in all supported pixel formats,
+// compares the results against a 32-bit floating point reference on the
+// GPU, and recommends the cheapest format that stays within a given
+// error tolerance.
+
+#pragma once
+
+#include <vector>
+
+#include "gl_header.h"
+#include "gl_util.h"
+
+#include "gips_core.h"
+
+namespace GIPS {
+
+///////////////////////////////////////////////////////////////////////////////
+
+struct PrecisionReport {
+    struct FormatResult {
+        PixelFormat format = PixelFormat::DontCare;
+        float maxError = 0.0f;       //!< maximum absolute difference to the reference
+        float renderTime_ms = 0.0f;
+        bool acceptable = false;     //!< maxError is within the tolerance
+    };
+    struct NodeRange {
+        bool measured = false;       //!< false if the node has been skipped
+        float minValue = 0.0f;       //!< smallest component value in the node's output
+        float maxValue = 0.0f;       //!< largest component value in the node's output
+        inline bool outOfRange() const { return measured && ((minValue < 0.0f) || (maxValue > 1.0f)); }
+    };
+    float tolerance = 0.0f;
+    std::vector<FormatResult> formats;  //!< one entry per analyzed format
+    std::vector<NodeRange> nodes;       //!< one entry per node, taken from the reference run
+    PixelFormat recommended = PixelFormat::Float32;
+
+    //! check whether any intermediate result exceeds the 0...1 range
+    //! (which integer formats can't represent)
+    bool anyOutOfRange() const;
+};
+
+class PrecisionAdvisor {
+    GLutil::Shader m_vs;
+    GLutil::Program m_statsProg;
+    GLutil::Program m_reduceProg;
+    GLint m_statsSizeLoc = -1;
+    GLint m_statsCompareLoc = -1;
+    GLint m_reduceSizeLoc = -1;
+    GLutil::FBO m_fbo;
+    GLuint m_refTex = 0;
+    GLuint m_tmpTex[2] = {0,0};
+    int m_width = 0;
+    int m_height = 0;
+    bool m_initialized = false;
+    bool m_initOK = false;
+
+    void resize(int width, int height);
+    bool measure(GLuint tex, GLuint refTex, float& maxError, float& minValue, float& maxValue);
+
+public:
+    bool init();
+    void free();
+    inline bool good() const { return m_initOK; }
+
+    //! analyze the first maxNodes nodes of a pipeline with the given
+    //! source texture; the error tolerance is specified in normalized
+    //! units (i.e. 1.0/255 = one 8-bit step). The pipeline's result texture
+    //! is undefined afterwards and needs to be re-rendered by the caller.
+    bool analyze(Pipeline& pipeline, GLuint srcTex, int width, int height, int maxNodes, float tolerance, PrecisionReport& report);
+
+    inline PrecisionAdvisor() {}
+    PrecisionAdvisor(const PrecisionAdvisor&) = delete;
+    inline ~PrecisionAdvisor() { free(); }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+}  // namespace GIPS
@@ -0,0 +1,233 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#include <cstdio>
+#include <cstdint>
+
+#include "gl_header.h"
+#include "gl_util.h"
+
+#include "gips_memory.h"
+#include "gips_raw.h"
+
+namespace GIPS {
+
+///////////////////////////////////////////////////////////////////////////////
+
+static const char* vsSource =
+         "#version 330 core"
+    "\n" "void main() {"
+    "\n" "  vec2 pos = vec2(float(gl_VertexID & 1), float((gl_VertexID & 2) >> 1));"
+    "\n" "  gl_Position = vec4(pos * 2.0 - 1.0, 0., 1.);"
+    "\n" "}"
+    "\n";
+
+// The staging texture contains the file's bytes (R8UI) for packed data and
+// 8-bit samples, or the 16-bit containers (R16UI) for wider unpacked data.
+// Samples are normalized by the white level, which isn't necessarily a
+// power of two minus one (e.g. PGM files with a maximum value of 1000).
+static const char* unpackSource =
+         "#version 330 core"
+    "\n" "uniform usampler2D gips_raw;"
+    "\n" "uniform int gips_mode;"     // 0 = 16-bit containers, 8 = bytes, 10 = RAW10, 12 = RAW12
+    "\n" "uniform float gips_scale;"  // 1 / white level
+    "\n" "out vec4 gips_frag;"
+    "\n" "void main() {"
+    "\n" "  ivec2 pos = ivec2(gl_FragCoord.xy);"
+    "\n" "  uint v;"
+    "\n" "  if (gips_mode == 10) {"
+    "\n" "    int base = (pos.x >> 2) * 5, sub = pos.x & 3;"
+    "\n" "    uint hi = texelFetch(gips_raw, ivec2(base + sub, pos.y), 0).r;"
+    "\n" "    uint lo = texelFetch(gips_raw, ivec2(base + 4,   pos.y), 0).r;"
+    "\n" "    v = (hi << 2u) | ((lo >> uint(sub * 2)) & 3u);"
+    "\n" "  } else if (gips_mode == 12) {"
+    "\n" "    int base = (pos.x >> 1) * 3, sub = pos.x & 1;"
+    "\n" "    uint hi = texelFetch(gips_raw, ivec2(base + sub, pos.y), 0).r;"
+    "\n" "    uint lo = texelFetch(gips_raw, ivec2(base + 2,   pos.y), 0).r;"
+    "\n" "    v = (hi << 4u) | ((lo >> uint(sub * 4)) & 15u);"
+    "\n" "  } else {"
+    "\n" "    v = texelFetch(gips_raw, pos, 0).r;"
+    "\n" "  }"
+    "\n" "  gips_frag = vec4(float(v) * gips_scale);"
+    "\n" "}"
+    "\n";
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool RawImage::valid() const {
+    if ((width <= 0) || (height <= 0) || (bits < 8) || (bits > 16)) { return false; }
+    if ((maxValue < 0) || (maxValue >= (1 << bits))) { return false; }
+    switch (packing) {
+        case RawPacking::None: return true;
+        case RawPacking::MIPI: return (bits == 10) || (bits == 12);
+        default: return false;
+    }
+}
+
+size_t RawImage::rowSize() const {
+    if (packing == RawPacking::MIPI) {
+        return (bits == 10) ? (size_t((width + 3) >> 2) * 5u)
+                            : (size_t((width + 1) >> 1) * 3u);
+    }
+    return size_t(width) * ((bits > 8) ? 2u : 1u);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool parsePGM(const void* fileData, size_t fileSize, RawImage& raw) {
+    const uint8_t* p = static_cast<const uint8_t*>(fileData);
+    const uint8_t* end = p + fileSize;
+    if (!p || (fileSize < 3) || (p[0] != 'P') || (p[1] != '5')) { return false; }
+    p += 2;
+
+    // parse width, height and maximum value; each of them is preceded by
+    // whitespace and possibly comments
+    int header[3];
+    for (int i = 0;  i < 3;  ++i) {
+        bool haveSpace = false;
+        while (p < end) {
+            if (*p == '#') {
+                while ((p < end) && (*p != '\n') && (*p != '\r')) { ++p; }
+            } else if ((*p == ' ') || (*p == '\t') || (*p == '\n') || (*p == '\r')) {
+                ++p;
+            } else { break; }
+            haveSpace = true;
+        }
+        if (!haveSpace || (p >= end) || (*p < '0') || (*p > '9')) { return false; }
+        int value = 0;
+        while ((p < end) && (*p >= '0') && (*p <= '9')) {
+            value = value * 10 + int(*p++ - '0');
+            if (value > 0xFFFFFF) { return false; }
+        }
+        header[i] = value;
+    }
+    // exactly one whitespace character separates the header from the data
+    if ((p >= end) || ((*p != ' ') && (*p != '\t') && (*p != '\n') && (*p != '\r'))) { return false; }
+    ++p;
+
+    int maxValue = header[2];
+    if ((maxValue < 1) || (maxValue > 65535)) { return false; }
+    raw.width = header[0];
+    raw.height = header[1];
+    raw.bits = 8;
+    while ((1 << raw.bits) <= maxValue) { ++raw.bits; }
+    raw.packing = RawPacking::None;
+    raw.bigEndian = true;
+    raw.stride = 0;
+    raw.maxValue = maxValue;
+    raw.data = p;
+    return raw.valid() && (raw.dataSize() <= size_t(end - p));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool RawDecoder::init() {
+    if (m_initialized) {
+        return m_initOK;
+    }
+    m_initialized = true;
+    GLutil::clearError();
+
+    m_vs.compile(GL_VERTEX_SHADER, vsSource);
+    GLutil::Shader fs(GL_FRAGMENT_SHADER, unpackSource);
+    #ifndef NDEBUG
+        if (fs.haveLog()) { fprintf(stderr, "raw unpacking shader log:\n%s\n", fs.getLog()); }
+    #endif
+    if (!m_vs.good() || !fs.good() || !m_prog.link(m_vs, fs)) {
+        return false;
+    }
+    m_prog.use();
+    glUniform1i(m_prog.getUniformLocation("gips_raw"), 0);
+    m_modeLoc = m_prog.getUniformLocation("gips_mode");
+    m_scaleLoc = m_prog.getUniformLocation("gips_scale");
+    glUseProgram(0);
+
+    m_fbo.init();
+    glGenTextures(1, &m_stageTex);
+    glBindTexture(GL_TEXTURE_2D, m_stageTex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    m_initOK = (GLutil::checkError("raw decoder setup") == GL_NO_ERROR);
+    return m_initOK;
+}
+
+void RawDecoder::free() {
+    m_fbo.free();
+    m_prog.free();
+    m_vs.free();
+    if (GLutil::initialized && m_stageTex) {
+        glDeleteTextures(1, &m_stageTex);
+    }
+    Memory::untrackTexture(m_stageTex);
+    m_stageTex = 0;
+    m_initialized = m_initOK = false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool RawDecoder::decode(const RawImage& raw, GLuint destTex) {
+    if (!raw.data || !raw.valid() || !destTex || !init()) { return false; }
+    GLutil::clearError();
+    bool wide = (raw.bits > 8) && (raw.packing == RawPacking::None);
+    bool direct = (raw.packing == RawPacking::None) && ((raw.bits == 8) || (raw.bits == 16))
+               && (raw.whiteLevel() == ((1 << raw.bits) - 1));
+    #ifndef NDEBUG
+        fprintf(stderr, "decoding %dx%d raw image with %d bits/sample (%s)\n",
+                raw.width, raw.height, raw.bits,
+                direct ? "direct upload" : wide ? "16-bit containers" : (raw.packing == RawPacking::MIPI) ? "MIPI packed" : "bytes");
+    #endif
+
+    // upload the data; all supported hosts are little-endian
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_SWAP_BYTES, (wide && raw.bigEndian) ? GL_TRUE : GL_FALSE);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, GLint(raw.rowPitch() / (wide ? 2u : 1u)));
+    glBindTexture(GL_TEXTURE_2D, destTex);
+    if (direct) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R16, raw.width, raw.height, 0, GL_RED, wide ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE, raw.data);
+        Memory::trackTexture(MemCategory::SourceImage, destTex, raw.width, raw.height, GL_R16);
+    } else {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R16, raw.width, raw.height, 0, GL_RED, GL_UNSIGNED_SHORT, nullptr);
+        glBindTexture(GL_TEXTURE_2D, m_stageTex);
+        if (wide) {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R16UI, raw.width, raw.height, 0, GL_RED_INTEGER, GL_UNSIGNED_SHORT, raw.data);
+            Memory::trackTexture(MemCategory::Staging, m_stageTex, raw.width, raw.height, GL_R16UI);
+        } else {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, GLsizei(raw.rowSize()), raw.height, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, raw.data);
+            Memory::trackTexture(MemCategory::Staging, m_stageTex, int(raw.rowSize()), raw.height, GL_R8UI);
+        }
+        Memory::trackTexture(MemCategory::SourceImage, destTex, raw.width, raw.height, GL_R16);
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_SWAP_BYTES, GL_FALSE);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    // present the single channel as an opaque gray RGBA image
+    static const GLint swizzle[4] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+    glBindTexture(GL_TEXTURE_2D, destTex);
+    glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    if (GLutil::checkError("raw image upload")) { return false; }
+
+    // unpack and normalize into the destination texture
+    if (!direct) {
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        if (!m_fbo.begin(destTex)) { return false; }
+        glViewport(0, 0, raw.width, raw.height);
+        m_prog.use();
+        glUniform1i(m_modeLoc, wide ? 0 : raw.bits);
+        glUniform1f(m_scaleLoc, 1.0f / float(raw.whiteLevel()));
+        glBindTexture(GL_TEXTURE_2D, m_stageTex);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glUseProgram(0);
+        m_fbo.end();
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    }
+    return (GLutil::checkError("raw image unpacking") == GL_NO_ERROR);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+}  // namespace GIPS
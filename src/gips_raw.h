@@ -0,0 +1,80 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+// Raw sensor data input: uploads single-channel (e.g. Bayer CFA mosaic)
+// images with 8 to 16 bits per sample into a 16-bit texture, unpacking
+// packed sample formats on the GPU.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "gl_header.h"
+#include "gl_util.h"
+
+namespace GIPS {
+
+///////////////////////////////////////////////////////////////////////////////
+
+enum class RawPacking : int {
+    None = 0,  //!< one byte per sample (8 bits) or 16-bit containers (9-16 bits)
+    MIPI = 1,  //!< MIPI CSI-2 RAW10 (4 samples in 5 bytes) or RAW12 (2 samples in 3 bytes)
+};
+
+//! description of a raw single-channel image in host memory
+struct RawImage {
+    const void* data = nullptr;
+    int width = 0;
+    int height = 0;
+    int bits = 8;                           //!< significant bits per sample (8...16)
+    RawPacking packing = RawPacking::None;
+    bool bigEndian = false;                 //!< byte order of 16-bit containers
+    size_t stride = 0;                      //!< distance between rows in bytes; 0 = tightly packed
+    int maxValue = 0;                       //!< sample value that means white; 0 = 2^bits-1
+
+    inline int whiteLevel() const { return maxValue ? maxValue : ((1 << bits) - 1); }
+
+    //! check whether the combination of bit depth and packing is supported
+    bool valid() const;
+    size_t rowSize() const;
+    inline size_t rowPitch() const { return stride ? stride : rowSize(); }
+    inline size_t dataSize() const { return (height > 0) ? (rowPitch() * size_t(height - 1) + rowSize()) : 0u; }
+};
+
+//! parse a binary PGM (P5) file that's already in memory; fills everything
+//! in the RawImage except the packing (which is always None), including
+//! the file's maximum value
+//! \returns false if the data isn't a valid binary PGM file
+bool parsePGM(const void* fileData, size_t fileSize, RawImage& raw);
+
+class RawDecoder {
+    GLutil::Shader m_vs;
+    GLutil::Program m_prog;
+    GLint m_modeLoc = -1;
+    GLint m_scaleLoc = -1;
+    GLutil::FBO m_fbo;
+    GLuint m_stageTex = 0;
+    bool m_initialized = false;
+    bool m_initOK = false;
+
+public:
+    bool init();
+    void free();
+    inline bool good() const { return m_initOK; }
+
+    //! upload a raw image into a texture, which is (re-)allocated as GL_R16
+    //! and swizzled so that all color channels contain the sample value and
+    //! alpha is 1.0; plain 8-bit and 16-bit data with a white level of
+    //! 2^bits-1 is uploaded directly, everything else is unpacked and
+    //! normalized by a shader
+    bool decode(const RawImage& raw, GLuint destTex);
+
+    inline RawDecoder() {}
+    RawDecoder(const RawDecoder&) = delete;
+    inline ~RawDecoder() { free(); }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+}  // namespace GIPS
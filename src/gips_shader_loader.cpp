@@ -90,6 +90,7 @@ bool Node::load(const char* filename, const GLutil::Shader& vs, const FileUtil::
     PassInput inputs[MaxPasses];
     PassOutput outputs[MaxPasses];
     bool texFilter = true;
+    bool readsInput = false;
     CoordMapMode coordMode = CoordMapMode::None;
     static constexpr int GLSLTokenHistorySize = 4;
     GLSLToken tt[GLSLTokenHistorySize] = { GLSLToken::Other, };
@@ -110,6 +111,9 @@ bool Node::load(const char* filename, const GLutil::Shader& vs, const FileUtil::
         m_name = std::string(basename, size_t(StringUtil::pathExtStartIndex(basename)));
     }
     m_preferredFormat = PixelFormat::DontCare;
+    m_channels = 4;
+    m_bundled = false;
+    m_generator = false;
 
     // load the file
     code = StringUtil::loadTextFile(filename);
@@ -211,6 +215,7 @@ bool Node::load(const char* filename, const GLutil::Shader& vs, const FileUtil::
                 else if (isKey("digits") && needParam() && needNum()) { param->m_digits = int(fval + 0.5f); }
                 else if (isKey("int") && needParam()) { param->m_digits = 0; }
                 else if (isKey("unit") && needParam() && needValue()) { param->m_format = value; }
+                else if (isKey("identity") && needParam() && needNum()) { param->m_hasIdentity = true; param->m_identityValue = fval; }
                 else if ((isKey("toggle") || isKey("switch")) && needParam()) {
                     setParamType(GLSLToken::Float, ParameterType::Toggle, true);
                 } else if ((isKey("angle")) && needParam()) {
@@ -224,11 +229,16 @@ bool Node::load(const char* filename, const GLutil::Shader& vs, const FileUtil::
                     else if (isValue("relative") || isValue("rel")) { coordMode = CoordMapMode::Relative; }
                     else { err << "(GIPS) unrecognized coordinate mapping mode '" << value << "'\n"; }
                 } else if ((isKey("format") || isKey("fmt")) && needGlobal() && needValue()) {
-                         if (isValue("int8") || isValue("8") || isValue("i8") || isValue("u8")) { m_preferredFormat = PixelFormat::Int8; }
-                    else if (isValue("int16") || isValue("16") || isValue("i16") || isValue("u16")) { m_preferredFormat = PixelFormat::Int16; }
-                    else if (isValue("float16") || isValue("116") || isValue("f16") || isValue("fp16")) { m_preferredFormat = PixelFormat::Float16; }
-                    else if (isValue("float32") || isValue("132") || isValue("f32") || isValue("fp32")) { m_preferredFormat = PixelFormat::Float32; }
+                    PixelFormat fmt = parsePixelFormat(value);
+                    if (fmt != getProcessingFormat(fmt)) { err << "(GIPS) pixel format '" << value << "' can only be used for input images\n"; }
+                    else if (fmt != PixelFormat::DontCare) { m_preferredFormat = fmt; }
                     else { err << "(GIPS) unrecognized pixel format '" << value << "'\n"; }
+                } else if ((isKey("channels") || isKey("chan")) && needGlobal() && needValue()) {
+                         if (isValue("1") || isValue("luma") || isValue("gray") || isValue("grey")) { m_channels = 1; }
+                    else if (isValue("2") || isValue("la")) { m_channels = 2; }
+                    else if (isValue("4") || isValue("rgba")) { m_channels = 4; }
+                    else if (isValue("keep") || isValue("same")) { m_channels = 0; }
+                    else { err << "(GIPS) unrecognized channel count '" << value << "'\n"; }
                 } else if ((isKey("filter") || isKey("filt")) && needGlobal() && needValue()) {
                          if (isValue("1") || isValue("on")  || isValue("linear")  || isValue("bilinear")) { texFilter = true; }
                     else if (isValue("0") || isValue("off") || isValue("nearest") || isValue("point"))    { texFilter = false; }
@@ -259,6 +269,11 @@ bool Node::load(const char* filename, const GLutil::Shader& vs, const FileUtil::
             continue;
         }   // END of comment handling
 
+        // any reference to the input texture makes the filter input-dependent
+        if (tok.isToken("pixel") || tok.isToken("gips_tex")) {
+            readsInput = true;
+        }
+
         // add token type to history
         GLSLToken newTT = StringUtil::lookup(tokenMap,tok.token());
         if (newTT == GLSLToken::Ignored) {
@@ -403,7 +418,8 @@ bool Node::load(const char* filename, const GLutil::Shader& vs, const FileUtil::
                   "in vec2 gips_pos;\n"
                   "out vec4 gips_frag;\n"
                   "uniform sampler2D gips_tex;\n"
-                  "uniform vec2 gips_image_size;\n";
+                  "uniform vec2 gips_image_size;\n"
+                  "uniform bool gips_pack_alpha;\n";
         if (input == PassInput::Coord) {
             shader << "uniform vec4 gips_map2tex;\n"
                       "vec4 pixel(in vec2 pos) {\n"
@@ -442,14 +458,17 @@ bool Node::load(const char* filename, const GLutil::Shader& vs, const FileUtil::
                 shader << ", color.a)";  // RGB(A)->RGB case: keep source alpha
             }
         }
-        shader << ";\n}\n";
+        shader << ";\n";
+        // dual-channel (luma+alpha) output buffers store alpha in green
+        shader << "  if (gips_pack_alpha) { gips_frag.g = gips_frag.a; }\n}\n";
 
         // compile shader and link program
-        fs.compile(GL_FRAGMENT_SHADER, shader.str().c_str());
+        pass.source = shader.str();
+        fs.compile(GL_FRAGMENT_SHADER, pass.source.c_str());
         if (fs.haveLog()) { err << fs.getLog() << "\n"; }
         if (!fs.good()) {
             #ifndef NDEBUG
-                fprintf(stderr, "----- failed shader source code -----\n%s\n----- end of failed shader code -----\n", shader.str().c_str());
+                fprintf(stderr, "----- failed shader source code -----\n%s\n----- end of failed shader code -----\n", pass.source.c_str());
             #endif
             goto load_finalize;
         }
@@ -466,6 +485,7 @@ bool Node::load(const char* filename, const GLutil::Shader& vs, const FileUtil::
         pass.locImageSize = prog->getUniformLocation("gips_image_size");
         pass.locRel2Map = prog->getUniformLocation("gips_rel2map");
         pass.locMap2Tex = (input == PassInput::Coord) ? prog->getUniformLocation("gips_map2tex") : (-1);
+        pass.locPackAlpha = prog->getUniformLocation("gips_pack_alpha");
         for (auto& p : newParams) {
             p.m_location[currentPass] = prog->getUniformLocation(p.m_name.c_str());
         }
@@ -482,10 +502,15 @@ bool Node::load(const char* filename, const GLutil::Shader& vs, const FileUtil::
 
     // setup done, proclaim success
     m_passCount = currentPass;
+    m_generator = (inputs[0] == PassInput::Coord) && !readsInput;
+    #ifndef NDEBUG
+        if (m_generator) { printf("shader '%s' doesn't depend on its input\n", filename); }
+    #endif
 
 load_finalize:
     ::free(code);
     m_errors = err.str();
+    m_loadErrorsLength = m_errors.size();
     m_params = newParams;
     return (m_passCount > 0);
 }
@@ -0,0 +1,45 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+// Layout of the shared-memory image segments used by the daemon's
+// 'render_shm' command. This header is self-contained (plain C, no other
+// GIPS headers required) so that it can be copied into client programs.
+//
+// A segment starts with a GIPSShmHeader, followed by the pixel data at
+// 'dataOffset' bytes from the start of the segment. Pixels are RGBA (RGB for
+// the packed formats without alpha); the component type is defined by
+// 'format', which uses the numeric values of GIPS::PixelFormat:
+//     8 = 8-bit unsigned normalized    (4 bytes per pixel)
+//    10 = packed 10/10/10/2-bit unsigned normalized RGBA
+//         (4 bytes per pixel, GL_UNSIGNED_INT_2_10_10_10_REV layout)
+//    16 = 16-bit unsigned normalized   (8 bytes per pixel)
+//   109 = packed shared-exponent RGB, input only
+//         (4 bytes per pixel, GL_UNSIGNED_INT_5_9_9_9_REV layout)
+//   111 = packed 11/11/10-bit float RGB
+//         (4 bytes per pixel, GL_UNSIGNED_INT_10F_11F_11F_REV layout)
+//   116 = 16-bit half float            (8 bytes per pixel)
+//   132 = 32-bit float                 (16 bytes per pixel)
+// Rows are stored top-down, 'stride' bytes apart; the stride must be
+// a multiple of the pixel size.
+//
+// The client creates both segments (e.g. with shm_open() + ftruncate() +
+// mmap()) and fills in the complete header of each. For the output segment,
+// width and height must match the input image; 'format' and 'stride'
+// define the layout GIPS shall write the result in.
+
+#pragma once
+
+#include <stdint.h>
+
+#define GIPS_SHM_MAGIC   0x4D485347u  // 'GSHM' in little-endian byte order
+#define GIPS_SHM_VERSION 1u
+
+typedef struct GIPSShmHeader {
+    uint32_t magic;        //!< must be GIPS_SHM_MAGIC
+    uint32_t version;      //!< must be GIPS_SHM_VERSION
+    int32_t  width;        //!< image width in pixels
+    int32_t  height;       //!< image height in pixels
+    uint32_t format;       //!< pixel format (see above)
+    uint32_t stride;       //!< distance between rows in bytes
+    uint64_t dataOffset;   //!< offset of the first pixel from the segment start
+} GIPSShmHeader;
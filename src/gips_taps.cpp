@@ -0,0 +1,250 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "gl_header.h"
+#include "gl_util.h"
+#include "string_util.h"
+
+#include "gips_core.h"
+#include "gips_context.h"
+#include "gips_memory.h"
+#include "gips_taps.h"
+
+namespace GIPS {
+
+///////////////////////////////////////////////////////////////////////////////
+
+//! RGBA components that make up an image with 1 to 4 channels
+static const int channelMap[5][4] = {
+    { 0, 0, 0, 0 },
+    { 0, 0, 0, 0 },  // gray
+    { 0, 3, 0, 0 },  // gray+alpha
+    { 0, 1, 2, 0 },  // RGB
+    { 0, 1, 2, 3 },  // RGBA
+};
+
+template <typename T>
+static inline T applySwizzle(GLint sel, const T* px, int channels, T one) {
+    switch (sel) {
+        case GL_RED:   return px[0];
+        case GL_GREEN: return (channels > 1) ? px[1] : T(0);
+        case GL_BLUE:  return (channels > 2) ? px[2] : T(0);
+        case GL_ALPHA: return (channels > 3) ? px[3] : one;
+        case GL_ONE:   return one;
+        default:       return T(0);
+    }
+}
+
+//! convert a row of read-back samples into the caller's channel layout;
+//! color and alpha are converted into the destination type separately
+template <typename S, typename D, typename ColorFunc, typename AlphaFunc>
+static void convertRow(const S* src, int srcChannels, const GLint* swizzle, S one,
+                       D* dest, int destChannels, int width,
+                       const ColorFunc& color, const AlphaFunc& alpha) {
+    const int* map = channelMap[destChannels];
+    for (int x = 0;  x < width;  ++x) {
+        S rgba[4];
+        for (int c = 0;  c < 4;  ++c) {
+            rgba[c] = applySwizzle(swizzle[c], src, srcChannels, one);
+        }
+        for (int c = 0;  c < destChannels;  ++c) {
+            *dest++ = (map[c] < 3) ? color(rgba[map[c]]) : alpha(rgba[map[c]]);
+        }
+        src += srcChannels;
+    }
+}
+
+template <typename T>
+static inline T identity(T x) { return x; }
+
+static void swapBytes(uint8_t* data, size_t count, int sampleSize) {
+    for (size_t i = 0;  i < count;  ++i, data += sampleSize) {
+        std::reverse(data, data + sampleSize);
+    }
+}
+
+//! table to sRGB-encode 16-bit linear values into 8 bits
+//! (built on first use; the initialization of a function-local static is
+//! thread-safe, so concurrent readers don't race on it)
+static const uint8_t* getEncodeTable() {
+    static const std::vector<uint8_t> table = [] {
+        std::vector<uint8_t> t(65536);
+        for (int i = 0;  i < 65536;  ++i) {
+            double x = double(i) / 65535.0;
+            x = (x <= 0.0031308) ? (x * 12.92) : (1.055 * std::pow(x, 1.0 / 2.4) - 0.055);
+            t[size_t(i)] = uint8_t(std::min(std::max(x * 255.0 + 0.5, 0.0), 255.0));
+        }
+        return t;
+    }();
+    return table.data();
+}
+
+static int getSampleSize(PixelFormat format) {
+    return getBytesPerPixel(format) / 4;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+std::string makeTapFilename(const char* filename, int nodeIndex) {
+    size_t extPos = size_t(StringUtil::pathExtStartIndex(filename));
+    return std::string(filename, extPos) + ".tap" + std::to_string(nodeIndex + 1) + std::string(&filename[extPos]);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool TapReader::begin(const std::vector<int>& nodeIndices, PixelFormat format, bool linearLight) {
+    if ((format != PixelFormat::Int8) && (format != PixelFormat::Int16)
+    &&  (format != PixelFormat::Float16) && (format != PixelFormat::Float32)) {
+        return false;
+    }
+    m_format = format;
+    m_linearLight = linearLight;
+
+    std::vector<int> nodes(nodeIndices);
+    std::sort(nodes.begin(), nodes.end());
+    nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+
+    // keep the buffers of the previous taps around for reuse
+    for (size_t i = nodes.size();  i < m_taps.size();  ++i) {
+        if (GLutil::initialized && m_taps[i].pbo) { glDeleteBuffers(1, &m_taps[i].pbo); }
+        Memory::untrackBuffer(m_taps[i].pbo);
+    }
+    m_taps.resize(nodes.size());
+    for (size_t i = 0;  i < nodes.size();  ++i) {
+        m_taps[i].nodeIndex = nodes[i];
+        m_taps[i].captured = false;
+    }
+    return true;
+}
+
+void TapReader::free() {
+    if (GLutil::initialized) {
+        for (auto& tap : m_taps) {
+            if (tap.pbo) { glDeleteBuffers(1, &tap.pbo); }
+        }
+    }
+    for (const auto& tap : m_taps) { Memory::untrackBuffer(tap.pbo); }
+    m_taps.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void TapReader::capture(int nodeIndex, GLuint tex) {
+    for (auto& tap : m_taps) {
+        if ((tap.nodeIndex != nodeIndex) || tap.captured || !tex) { continue; }
+        GLutil::clearError();
+
+        // readback ignores swizzles, so find out what the texture contains
+        // and what it would return when sampled
+        GLint width = 0, height = 0, texFormat = 0, greenBits = 0, blueBits = 0;
+        glBindTexture(GL_TEXTURE_2D, tex);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &texFormat);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_GREEN_SIZE, &greenBits);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_BLUE_SIZE, &blueBits);
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, tap.swizzle);
+        tap.width = width;
+        tap.height = height;
+        tap.channels = blueBits ? 4 : greenBits ? 2 : 1;
+
+        // 8-bit sRGB buffers are read as-is; anything else that's linear
+        // is read with 16 bits and encoded on the CPU
+        tap.encode = m_linearLight && (m_format == PixelFormat::Int8) && (texFormat != GL_SRGB8_ALPHA8);
+        PixelFormat readFormat = tap.encode ? PixelFormat::Int16 : m_format;
+        GLenum dummyFormat, pixelFormat, dataType;
+        getGLFormat(readFormat, dummyFormat, pixelFormat, dataType);
+        pixelFormat = (tap.channels == 1) ? GL_RED : (tap.channels == 2) ? GL_RG : GL_RGBA;
+
+        // start the readback into the tap's own buffer
+        size_t size = size_t(width) * size_t(height) * size_t(tap.channels * getSampleSize(readFormat));
+        if (!tap.pbo) { glGenBuffers(1, &tap.pbo); }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, tap.pbo);
+        if (size > tap.pboSize) {
+            glBufferData(GL_PIXEL_PACK_BUFFER, GLsizeiptr(size), nullptr, GL_STREAM_READ);
+            Memory::trackBuffer(MemCategory::Staging, tap.pbo, size);
+            tap.pboSize = size;
+        }
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glGetTexImage(GL_TEXTURE_2D, 0, pixelFormat, dataType, nullptr);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        tap.captured = (GLutil::checkError("tap readback") == GL_NO_ERROR);
+        #ifndef NDEBUG
+            fprintf(stderr, "tap: reading back output of node %d (%dx%d, %d channel(s)%s)\n",
+                    nodeIndex + 1, width, height, tap.channels, tap.encode ? ", sRGB-encoded" : "");
+        #endif
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool TapReader::read(int i, const ImageBuffer& image) {
+    if ((i < 0) || (i >= tapCount())) { return false; }
+    const Tap& tap = m_taps[size_t(i)];
+    if (!tap.captured || !image.data || (image.width != tap.width) || (image.height != tap.height)
+    || (image.format != m_format) || (image.channels < 1) || (image.channels > 4)) {
+        return false;
+    }
+    int sampleSize = getSampleSize(tap.encode ? PixelFormat::Int16 : m_format);
+    size_t srcPitch = size_t(tap.width) * size_t(tap.channels * sampleSize);
+    size_t size = srcPitch * size_t(tap.height);
+
+    // mapping the buffer waits for the readback to finish
+    GLutil::clearError();
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, tap.pbo);
+    const uint8_t* data = static_cast<const uint8_t*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, GLsizeiptr(size), GL_MAP_READ_BIT));
+    if (data) {
+        const uint8_t* encodeTable = tap.encode ? getEncodeTable() : nullptr;
+        for (int y = 0;  y < tap.height;  ++y) {
+            const uint8_t* src = &data[size_t(y) * srcPitch];
+            uint8_t* dest = static_cast<uint8_t*>(image.data) + size_t(image.bottomUp ? (tap.height - 1 - y) : y) * image.rowPitch();
+            if (tap.encode) {
+                convertRow(reinterpret_cast<const uint16_t*>(src), tap.channels, tap.swizzle, uint16_t(65535u),
+                           dest, image.channels, tap.width,
+                           [encodeTable] (uint16_t v) { return encodeTable[v]; },
+                           [] (uint16_t v) { return uint8_t((unsigned(v) * 255u + 32767u) / 65535u); });
+                continue;
+            }
+            switch (m_format) {
+                case PixelFormat::Int16:
+                case PixelFormat::Float16: {
+                    uint16_t one = (m_format == PixelFormat::Float16) ? uint16_t(0x3C00u) : uint16_t(65535u);
+                    convertRow(reinterpret_cast<const uint16_t*>(src), tap.channels, tap.swizzle, one,
+                               reinterpret_cast<uint16_t*>(dest), image.channels, tap.width,
+                               identity<uint16_t>, identity<uint16_t>);
+                    break; }
+                case PixelFormat::Float32:
+                    convertRow(reinterpret_cast<const float*>(src), tap.channels, tap.swizzle, 1.0f,
+                               reinterpret_cast<float*>(dest), image.channels, tap.width,
+                               identity<float>, identity<float>);
+                    break;
+                default:
+                    convertRow(src, tap.channels, tap.swizzle, uint8_t(255u),
+                               dest, image.channels, tap.width,
+                               identity<uint8_t>, identity<uint8_t>);
+                    break;
+            }
+            if (image.bigEndian && (sampleSize > 1)) {
+                swapBytes(dest, size_t(tap.width) * size_t(image.channels), sampleSize);
+            }
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return data && (GLutil::checkError("tap mapping") == GL_NO_ERROR);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+}  // namespace GIPS
@@ -0,0 +1,81 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+// Pipeline taps: outputs of intermediate nodes that are read back while
+// the pipeline is rendered, so that several stages can be exported from a
+// single render. The readbacks go into pixel pack buffers, so rendering
+// isn't stalled; the data is only waited for when it's actually needed.
+
+#pragma once
+
+#include <cstddef>
+
+#include <string>
+#include <vector>
+
+#include "gl_header.h"
+#include "gl_util.h"
+
+#include "gips_core.h"
+
+namespace GIPS {
+
+struct ImageBuffer;
+
+///////////////////////////////////////////////////////////////////////////////
+
+//! derive the file name of a tap from the main output file's name
+//! (e.g. "result.png" -> "result.tap3.png" for the third node)
+std::string makeTapFilename(const char* filename, int nodeIndex);
+
+class TapReader {
+    struct Tap {
+        int nodeIndex = 0;
+        GLuint pbo = 0;
+        size_t pboSize = 0;
+        int width = 0;
+        int height = 0;
+        int channels = 4;    //!< number of channels that have been read (1, 2 or 4)
+        GLint swizzle[4] = { GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA };
+        bool encode = false; //!< data is 16-bit linear and needs to be sRGB-encoded into 8 bits
+        bool captured = false;
+    };
+    std::vector<Tap> m_taps;
+    PixelFormat m_format = PixelFormat::Int8;
+    bool m_linearLight = false;
+
+public:
+    //! prepare reading back the outputs of some nodes (0-based indices) into
+    //! host images of a given format (Int8, Int16, Float16 or Float32);
+    //! in linear-light mode, data that's read into 8-bit images is
+    //! sRGB-encoded, like Context::render() does with the final result
+    //! \returns false if the format isn't supported
+    bool begin(const std::vector<int>& nodeIndices, PixelFormat format, bool linearLight);
+
+    //! start the readback of a node's output if the node is a tap;
+    //! to be called from a NodeCallback during Pipeline::render()
+    void capture(int nodeIndex, GLuint tex);
+    inline NodeCallback callback() {
+        return [this] (int nodeIndex, GLuint tex) { capture(nodeIndex, tex); };
+    }
+
+    inline int  tapCount()       const { return int(m_taps.size()); }
+    inline int  nodeIndex(int i) const { return m_taps[size_t(i)].nodeIndex; }
+    inline bool captured(int i)  const { return m_taps[size_t(i)].captured; }
+
+    //! wait for a tap's readback to finish and convert the data into a host
+    //! image of the same size; narrow (or swizzled) outputs are expanded
+    //! into the image's channels like the texture would be sampled
+    //! \returns false if the tap hasn't been captured or the image doesn't match
+    bool read(int i, const ImageBuffer& image);
+
+    void free();
+
+    inline TapReader() {}
+    TapReader(const TapReader&) = delete;
+    inline ~TapReader() { free(); }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+}  // namespace GIPS
@@ -1,6 +1,8 @@
 // SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
 // SPDX-License-Identifier: MIT
 
+#include <cmath>
+
 #include <algorithm>
 
 #include "imgui.h"
@@ -11,9 +13,11 @@
 #include "string_util.h"
 #include "vfs.h"
 #include "clipboard.h"
+#include "buffer_pool.h"
 #include "patterns.h"
 
 #include "gips_app.h"
+#include "gips_memory.h"
 
 #include "gips_version.h"
 extern "C" const char* git_rev;
@@ -73,6 +77,19 @@ struct ButtonColorOverride {
 
 ///////////////////////////////////////////////////////////////////////////////
 
+//! convert a pixel value into an opaque display color for the loupe
+static ImU32 LoupeColor(const float* rgba, bool linear) {
+    int c[3];
+    for (int i = 0;  i < 3;  ++i) {
+        float v = std::min(std::max(rgba[i], 0.0f), 1.0f);
+        if (linear) { v = (v <= 0.0031308f) ? (v * 12.92f) : (1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f); }
+        c[i] = int(v * 255.0f + 0.5f);
+    }
+    return IM_COL32(c[0], c[1], c[2], 255);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
 static void ShaderBrowserMenu(GIPS::App& app, int nodeIndex, const char* dir) {
     const auto& list = VFS::getCachedDirList(dir);
     for (const auto& item : list.items) {
@@ -144,6 +161,10 @@ static bool TreeNodeForGIPSNode(GIPS::App& app, int nodeIndex=0, GIPS::Node* nod
         if (ImGui::Selectable("restore defaults")) {
             node->reset();
         }
+        bool exportTap = node->exportTap();
+        if (ImGui::MenuItem("save output along with result", nullptr, &exportTap)) {
+            node->setExportTap(exportTap);
+        }
         if (ImGui::Selectable("reload")) {
             app.requestReloadNode(nodeIndex);
         }
@@ -213,6 +234,30 @@ void GIPS::App::drawUI() {
         }
     }
 
+    // A/B comparison status
+    if ((m_abMode != ABMode::Off) && haveSnapshot()) {
+        if (m_abMode == ABMode::Split) {
+            float x = float(m_imgX0) + m_imgZoom * float(m_imgWidth) * m_abSplit;
+            float y0 = float(m_imgY0), y1 = y0 + m_imgZoom * float(m_imgHeight);
+            ImGui::GetBackgroundDrawList()->AddLine(ImVec2(x, y0), ImVec2(x, y1), IM_COL32(255, 255, 255, 160));
+        }
+        StatusWindow _("A/B##abStatus", 1.0f, 0.0f);
+        ImGui::TextUnformatted((m_abMode == ABMode::Split) ? "A: snapshot | B: live"
+                             : abShowsSnapshot()           ? "A: snapshot"
+                                                           : "B: live");
+    }
+
+    // progress of a time-sliced render
+    if (m_pipeline.renderInProgress()) {
+        StatusWindow _("Processing##progress", 0.5f, 0.0f);
+        ImGui::ProgressBar(m_pipeline.renderProgress(), ImVec2(160.0f, 0.0f));
+        ImGui::SameLine();
+        if (ImGui::Button("Cancel")) {
+            m_pipeline.cancelRender();
+            m_renderCancelled = true;
+        }
+    }
+
     // main window begin
     ImGui::SetNextWindowPos(ImGui::GetMainViewport()->WorkPos, ImGuiCond_FirstUseEver);
     ImGui::SetNextWindowSize(ImVec2(320.0f, 480.0f), ImGuiCond_FirstUseEver);
@@ -259,13 +304,102 @@ void GIPS::App::drawUI() {
                         }
                     };
                     handlePixelFormat(GIPS::PixelFormat::Int8);
+                    handlePixelFormat(GIPS::PixelFormat::RGB10A2);
                     handlePixelFormat(GIPS::PixelFormat::Int16);
+                    handlePixelFormat(GIPS::PixelFormat::R11G11B10F);
                     handlePixelFormat(GIPS::PixelFormat::Float16);
                     handlePixelFormat(GIPS::PixelFormat::Float32);
+                    ImGui::Separator();
+                    ImGui::MenuItem("Precision Advisor ...", nullptr, &m_showPrecision);
+                    ImGui::EndMenu();
+                }
+                bool linear = m_linearLight;
+                if (ImGui::MenuItem("Linear-Light Processing", nullptr, &linear)) {
+                    setLinearLight(linear);
+                }
+                if (ImGui::BeginMenu("Time-Sliced Rendering")) {
+                    auto handleBudget = [this] (float budget, const char* name) {
+                        bool sel = (m_renderBudget_ms == budget);
+                        if (ImGui::MenuItem(name, nullptr, &sel)) {
+                            m_renderBudget_ms = budget;
+                            m_pipeline.markAsChanged();
+                        }
+                    };
+                    handleBudget(0.0f,  "off (render everything at once)");
+                    handleBudget(8.0f,  "8 ms per frame");
+                    handleBudget(16.0f, "16 ms per frame");
+                    handleBudget(33.0f, "33 ms per frame");
+                    ImGui::EndMenu();
+                }
+                if (ImGui::BeginMenu("JPEG Export")) {
+                    ImGui::SliderInt("quality", &m_jpegQuality, 1, 100);
+                    auto handleSubsampling = [this] (JPEGUtil::Subsampling sub, const char* name) {
+                        bool sel = (m_jpegSubsampling == sub);
+                        if (ImGui::MenuItem(name, nullptr, &sel)) { m_jpegSubsampling = sub; }
+                    };
+                    handleSubsampling(JPEGUtil::Subsampling::Auto, "automatic chroma subsampling");
+                    handleSubsampling(JPEGUtil::Subsampling::S444, "4:4:4 (no chroma subsampling)");
+                    handleSubsampling(JPEGUtil::Subsampling::S422, "4:2:2 chroma subsampling");
+                    handleSubsampling(JPEGUtil::Subsampling::S420, "4:2:0 chroma subsampling");
+                    ImGui::EndMenu();
+                }
+                if (ImGui::BeginMenu("CPU Threads")) {
+                    int cores = ThreadPool::defaultThreadCount();
+                    auto handleThreads = [this] (int threads, const char* name) {
+                        bool sel = (m_threadPool.threadCount() == threads);
+                        if (ImGui::MenuItem(name, nullptr, &sel)) { m_threadPool.setThreadCount(threads); }
+                    };
+                    handleThreads(cores, ("all cores (" + std::to_string(cores) + ")").c_str());
+                    for (int threads = 1;  threads < cores;  threads <<= 1) {
+                        handleThreads(threads, std::to_string(threads).c_str());
+                    }
+                    ImGui::EndMenu();
+                }
+                if (ImGui::BeginMenu("Memory Budget")) {
+                    static const int budgets_MiB[] = { 0, 256, 512, 1024, 2048, 4096, 8192 };
+                    auto handleBudget = [] (bool gpu, int budget_MiB) {
+                        uint64_t budget = uint64_t(budget_MiB) << 20;
+                        uint64_t gpuBudget = Memory::gpuBudget(), hostBudget = Memory::hostBudget();
+                        bool sel = ((gpu ? gpuBudget : hostBudget) == budget);
+                        std::string name = !budget_MiB ? std::string("unlimited")
+                                         : (budget_MiB < 1024) ? (std::to_string(budget_MiB) + " MiB")
+                                         : (std::to_string(budget_MiB >> 10) + " GiB");
+                        if (ImGui::MenuItem(name.c_str(), nullptr, &sel)) {
+                            Memory::setBudget(gpu ? budget : gpuBudget, gpu ? hostBudget : budget);
+                        }
+                    };
+                    ImGui::TextUnformatted("Video Memory:");
+                    for (int b : budgets_MiB) { handleBudget(true, b); }
+                    ImGui::Separator();
+                    ImGui::TextUnformatted("Host Image Buffers:");
+                    for (int b : budgets_MiB) { handleBudget(false, b); }
                     ImGui::EndMenu();
                 }
                 ImGui::Separator();
                 ImGui::MenuItem("Show Coordinates", nullptr, &m_showWidgets);
+                ImGui::MenuItem("Pixel Inspector", nullptr, &m_showInspector);
+                if (ImGui::BeginMenu("A/B Comparison")) {
+                    if (ImGui::MenuItem("Take Snapshot of Current Result")) {
+                        m_abSnapshotRequested = true;
+                    }
+                    if (ImGui::MenuItem("Discard Snapshot", nullptr, false, !m_abState.empty())) {
+                        discardSnapshot();
+                        m_abMode = ABMode::Off;
+                    }
+                    ImGui::Separator();
+                    auto handleMode = [this] (ABMode mode, const char* name) {
+                        bool sel = (m_abMode == mode);
+                        if (ImGui::MenuItem(name, nullptr, &sel, (mode == ABMode::Off) || !m_abState.empty())) {
+                            m_abMode = mode;
+                        }
+                    };
+                    handleMode(ABMode::Off,     "off");
+                    handleMode(ABMode::Split,   "split view (snapshot left, live right)");
+                    handleMode(ABMode::Flicker, "flicker between snapshot and live");
+                    ImGui::SliderFloat("split position", &m_abSplit, 0.0f, 1.0f, "%.2f");
+                    ImGui::SliderFloat("flicker interval", &m_abFlickerInterval, 0.1f, 2.0f, "%.1f s");
+                    ImGui::EndMenu();
+                }
                 ImGui::MenuItem("Show Alpha Checkerboard", nullptr, &m_showAlpha);
                 if (m_showDebug) {
                     ImGui::Separator();
@@ -309,6 +443,22 @@ void GIPS::App::drawUI() {
                 if (ImGui::Checkbox("resize to target size if larger", &m_imgResize)) {
                     requestUpdateSource();
                 }
+                if (!m_clipboardImage && (StringUtil::extractExtCode(m_imgFilename.c_str()) == StringUtil::makeExtCode("raw"))) {
+                    // layout of headerless raw sensor data
+                    bool changed = false;
+                    ImGui::PushItemWidth(80.0f);
+                    changed |= ImGui::InputInt("width##raw", &m_rawWidth, 0);
+                    ImGui::SameLine();
+                    changed |= ImGui::InputInt("height##raw", &m_rawHeight, 0);
+                    changed |= ImGui::SliderInt("bits/sample", &m_rawBits, 8, 16);
+                    ImGui::SameLine();
+                    changed |= ImGui::InputInt("header bytes", &m_rawHeaderSize, 0);
+                    ImGui::PopItemWidth();
+                    changed |= ImGui::Checkbox("MIPI packed (10/12 bits)", &m_rawPacked);
+                    ImGui::SameLine();
+                    changed |= ImGui::Checkbox("big-endian", &m_rawBigEndian);
+                    if (changed) { requestUpdateSource(); }
+                }
             }
 
             // color source
@@ -497,22 +647,127 @@ void GIPS::App::drawUI() {
         ImGui::Separator();
         ImGui::Text("pipeline format: %dx%d, %s",
             m_imgWidth, m_imgHeight, GIPS::pixelFormatName(m_pipeline.format()));
-        // video memory estimator:
-        // - 1x 8-bit RGBA input image buffer
-        // - 1x 8-bit RGBA export buffer (if not running in 8-bit mode)
-        // - 2x variable-format processing buffers
-        // - 2x 8-bit RGBA buffers for the display screen
-        uint64_t area = uint64_t(m_imgWidth * m_imgHeight);
-        uint64_t mem = area * 4ull  // input
-                     + 2ull * area * getBytesPerPixel(m_pipeline.format())  // processing
-                     + 2ull * uint64_t(m_io->DisplaySize.x * m_io->DisplaySize.y) * 4ull;  // display
-        if (m_pipeline.format() != GIPS::PixelFormat::Int8) {
-            mem += area * 4ull;  // export
+        // tracked memory usage, plus the two 8-bit RGBA buffers of the
+        // display screen, which are owned by the windowing system
+        ImGui::Separator();
+        if (ImGui::BeginTable("memory", 3, ImGuiTableFlags_RowBg)) {
+            auto addRow = [] (const char* name, const Memory::Usage& u, uint64_t budget) {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();  ImGui::TextUnformatted(name);
+                ImGui::TableNextColumn();  ImGui::Text("%.1f MiB", double(u.current) / 1048576.0);
+                ImGui::TableNextColumn();
+                if (budget) { ImGui::Text("peak %.1f MiB (of %.0f)", double(u.peak) / 1048576.0, double(budget) / 1048576.0); }
+                else        { ImGui::Text("peak %.1f MiB", double(u.peak) / 1048576.0); }
+            };
+            for (int i = 0;  i < MemCategoryCount;  ++i) {
+                MemCategory cat = static_cast<MemCategory>(i);
+                addRow(Memory::categoryName(cat), Memory::getUsage(cat), 0);
+                if (cat == MemCategory::Staging) {
+                    addRow("= video memory", Memory::getGPUTotal(), Memory::gpuBudget());
+                }
+            }
+            addRow("= host memory", Memory::getHostTotal(), Memory::hostBudget());
+            ImGui::EndTable();
         }
-        ImGui::Text("estimated video memory usage: %.1f MiB", double(mem) / 1048576.0);
+        uint64_t display = 2ull * uint64_t(m_io->DisplaySize.x * m_io->DisplaySize.y) * 4ull;
+        ImGui::Text("(plus %.1f MiB video memory for the display)", double(display) / 1048576.0);
+        BufferPool::Stats pool = BufferPool::getStats();
+        ImGui::Text("host buffer cache: %.1f MiB, %llu of %llu allocations reused", double(pool.idleBytes) / 1048576.0,
+            static_cast<unsigned long long>(pool.reuses), static_cast<unsigned long long>(pool.allocs));
+        if (ImGui::Button("Reset Peaks")) { Memory::resetPeaks(); }
+        ImGui::Separator();
         ImGui::Text("processing time: %.1f ms", m_pipeline.lastRenderTime_ms());
         ImGui::End();
     }   // END info window
+
+    // pixel inspector window
+    if (m_showInspector) {
+        ImGui::Begin("Pixel Inspector", &m_showInspector,
+                     ImGuiWindowFlags_NoCollapse |
+                     ImGuiWindowFlags_AlwaysAutoResize |
+                     ImGuiWindowFlags_NoFocusOnAppearing);
+        if (!m_inspector.hasResult()) {
+            ImGui::TextUnformatted("move the mouse over the image");
+        } else {
+            ImGui::Text("position: %d,%d", m_inspector.resultX(), m_inspector.resultY());
+            ImGui::Text("format: %s%s", GIPS::pixelFormatName(m_pipeline.format()), m_linearLight ? " (linear)" : "");
+            const float* p = m_inspector.pixel(0, 0);
+            if (p) {
+                ImGui::Text("R: %11.6f", p[0]);
+                ImGui::Text("G: %11.6f", p[1]);
+                ImGui::Text("B: %11.6f", p[2]);
+                ImGui::Text("A: %11.6f", p[3]);
+            }
+
+            // loupe, with the center pixel outlined
+            const float cell = 10.0f;
+            int size = m_inspector.resultSize(), radius = size >> 1;
+            ImDrawList* dl = ImGui::GetWindowDrawList();
+            ImVec2 pos = ImGui::GetCursorScreenPos();
+            for (int dy = -radius;  dy <= radius;  ++dy) {
+                for (int dx = -radius;  dx <= radius;  ++dx) {
+                    const float* px = m_inspector.pixel(dx, dy);
+                    ImVec2 a(pos.x + cell * float(dx + radius), pos.y + cell * float(dy + radius));
+                    dl->AddRectFilled(a, ImVec2(a.x + cell, a.y + cell), px ? LoupeColor(px, m_linearLight) : IM_COL32(32, 32, 32, 255));
+                }
+            }
+            ImVec2 c(pos.x + cell * float(radius), pos.y + cell * float(radius));
+            dl->AddRect(ImVec2(c.x - 1.0f, c.y - 1.0f), ImVec2(c.x + cell + 1.0f, c.y + cell + 1.0f), IM_COL32(0, 0, 0, 255));
+            dl->AddRect(c, ImVec2(c.x + cell, c.y + cell), IM_COL32(255, 255, 255, 255));
+            ImGui::Dummy(ImVec2(cell * float(size), cell * float(size)));
+        }
+        if (ImGui::SliderInt("loupe size", &m_inspectorSize, 3, GIPS::PixelInspector::MaxSize)) {
+            m_inspectorSize |= 1;
+        }
+        ImGui::End();
+    }
+
+    // precision advisor window
+    if (m_showPrecision) {
+        ImGui::SetNextWindowSize(ImVec2(400.0f, 0.0f), ImGuiCond_FirstUseEver);
+        ImGui::Begin("Precision Advisor", &m_showPrecision, ImGuiWindowFlags_NoCollapse);
+        ImGui::TextWrapped("Renders the pipeline (up to the currently shown filter) in all pixel formats and compares the results against the 32-bit floating point version.");
+        ImGui::SliderFloat("tolerance", &m_precisionTolerance, 0.0f, 16.0f, "%.1f 8-bit steps");
+        ImGui::Checkbox("apply recommendation automatically", &m_precisionAutoApply);
+        if (ImGui::Button("Analyze")) {
+            m_precisionRequested = true;
+            requestFrames(1);
+        }
+        if (m_precisionValid) {
+            const auto& r = m_precisionReport;
+            ImGui::SameLine();
+            if (ImGui::Button("Apply") && (m_requestedFormat != r.recommended)) {
+                m_requestedFormat = r.recommended;
+                m_pipeline.markAsChanged();
+            }
+            ImGui::Separator();
+            if (ImGui::BeginTable("formats", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+                ImGui::TableSetupColumn("format");
+                ImGui::TableSetupColumn("max. error");
+                ImGui::TableSetupColumn("time");
+                ImGui::TableSetupColumn("");
+                ImGui::TableHeadersRow();
+                for (const auto& f : r.formats) {
+                    ImGui::TableNextRow();
+                    ImGui::TableNextColumn(); ImGui::TextUnformatted(GIPS::pixelFormatName(f.format));
+                    ImGui::TableNextColumn(); ImGui::Text("%.2f steps", f.maxError * 255.0f);
+                    ImGui::TableNextColumn(); ImGui::Text("%.1f ms", f.renderTime_ms);
+                    ImGui::TableNextColumn(); ImGui::TextUnformatted((f.format == r.recommended) ? "recommended" : f.acceptable ? "OK" : "");
+                }
+                ImGui::EndTable();
+            }
+            if (r.anyOutOfRange()) {
+                ImGui::TextWrapped("These filters produce values outside of the 0...1 range, which integer formats can't represent:");
+                for (int i = 0;  i < int(r.nodes.size()) && (i < m_pipeline.nodeCount());  ++i) {
+                    const auto& n = r.nodes[size_t(i)];
+                    if (n.outOfRange()) {
+                        ImGui::BulletText("%s: %.3g ... %.3g", m_pipeline.node(i).name(), n.minValue, n.maxValue);
+                    }
+                }
+            }
+        }
+        ImGui::End();
+    }   // END precision advisor window
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -520,7 +775,7 @@ void GIPS::App::drawUI() {
 void GIPS::App::showLoadUI(bool imagesOnly) {
     std::vector<std::string> filters;
     static const std::string extP("*gips");
-    static const std::string extI("*.jpg *.jpeg *.png *.bmp *.tga *.pgm *.ppm *.gif *.psd");
+    static const std::string extI("*.jpg *.jpeg *.png *.qoi *.bmp *.tga *.pgm *.ppm *.pnm *.pam *.pfm *.gif *.psd *.raw");
     static const std::string extS("*.glsl *.frag *.fs");
     if (!imagesOnly) {
         filters.push_back("All Supported Files");
@@ -550,7 +805,7 @@ void GIPS::App::showSaveUI(bool useLastPath) {
         pfd_save_file_wrapper(
             "Save Pipeline or Result Image", m_lastSaveFilename,
             { "GIPS Pipelines (*.gips)", "*.gips",
-            "Image Files (*.jpg *.png *.bmp *.tga)", "*.jpg *.png *.bmp *.tga",
+            "Image Files (*.jpg *.png *.qoi *.bmp *.tga *.pgm *.ppm *.pnm *.pam *.pfm)", "*.jpg *.png *.qoi *.bmp *.tga *.pgm *.ppm *.pnm *.pam *.pfm",
             "All Files", "*" }
         ));
     if (!path.empty()) {
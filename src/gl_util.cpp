@@ -6,6 +6,8 @@
 #include <cstring>
 #include <cctype>
 
+#include <algorithm>
+
 #include "string_util.h"
 
 #include "gl_header.h"
@@ -120,6 +122,13 @@ void enableDebugMessages() {
 #endif
 }
 
+bool haveProgramBinaries() {
+    if (!initialized || !GLAD_GL_ARB_get_program_binary) { return false; }
+    GLint numFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+    return (numFormats > 0);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 bool Shader::init(GLuint type_) {
@@ -192,7 +201,7 @@ void Program::free() {
     logAlloc = 0;
 }
 
-bool Program::link(GLuint vs, GLuint fs) {
+bool Program::link(GLuint vs, GLuint fs, bool retrievable) {
     if (!id && initialized) {
         id = glCreateProgram();
     }
@@ -203,7 +212,40 @@ bool Program::link(GLuint vs, GLuint fs) {
     }
     glAttachShader(id, vs);
     glAttachShader(id, fs);
+    if (retrievable && GLAD_GL_ARB_get_program_binary) {
+        glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
     glLinkProgram(id);
+    return finishLink(vs, fs);
+}
+
+bool Program::loadBinary(GLenum format, const void* data, int size) {
+    if (!haveProgramBinaries() || !data || (size <= 0)) { ok = false; return false; }
+    if (!id) { id = glCreateProgram(); }
+    if (!id) { ok = false; return false; }
+    GLutil::clearError();
+    glProgramBinary(id, format, data, GLsizei(size));
+    GLint status = 0;
+    glGetProgramiv(id, GL_LINK_STATUS, &status);
+    ok = (status == GL_TRUE) && !glGetError();
+    if (log) { log[0] = '\0'; }
+    return ok;
+}
+
+bool Program::getBinary(GLenum& format, std::string& data) const {
+    data.clear();
+    if (!haveProgramBinaries() || !good()) { return false; }
+    GLint size = 0;
+    glGetProgramiv(id, GL_PROGRAM_BINARY_LENGTH, &size);
+    if (size <= 0) { return false; }
+    data.resize(size_t(size));
+    GLsizei length = 0;
+    glGetProgramBinary(id, size, &length, &format, &data[0]);
+    data.resize(size_t(std::max(length, 0)));
+    return !data.empty();
+}
+
+bool Program::finishLink(GLuint vs, GLuint fs) {
     GLint logLen = 0;
     glGetProgramiv(id, GL_INFO_LOG_LENGTH, &logLen);
     if (logLen > logAlloc) {
@@ -3,6 +3,8 @@
 
 #pragma once
 
+#include <string>
+
 #include "gl_header.h"
 
 namespace GLutil {
@@ -23,6 +25,9 @@ GLenum checkError(const char* prefix=nullptr);
 
 void enableDebugMessages();
 
+//! check whether program binaries can be saved and loaded
+bool haveProgramBinaries();
+
 class Shader {
 private:
     int logAlloc = 0;
@@ -48,6 +53,7 @@ public:
 class Program {
 private:
     int logAlloc = 0;
+    bool finishLink(GLuint vs, GLuint fs);
 public:
     GLuint id = 0;
     char* log = nullptr;
@@ -56,7 +62,11 @@ public:
     bool ok = false;
     inline bool good() const { return initialized && ok; }
     bool init();
-    bool link(GLuint vs, GLuint fs);
+    bool link(GLuint vs, GLuint fs, bool retrievable=false);
+    //! load a driver-specific program binary (GL_ARB_get_program_binary)
+    bool loadBinary(GLenum format, const void* data, int size);
+    //! retrieve the program binary; \returns false if unsupported
+    bool getBinary(GLenum& format, std::string& data) const;
     void free();
     inline bool use() const { if (initialized && ok) { glUseProgram(id); return true; } else { return false; } }
     inline GLint getUniformLocation(const char* name) const { return initialized ? glGetUniformLocation(id, name) : -1; }
@@ -0,0 +1,168 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+// The hash is structured like XXH3's long-input path: 64-byte stripes are
+// accumulated into eight 64-bit lanes (a 32x32->64 bit multiply of the
+// data mixed with a per-stripe key, plus the neighboring lane's data),
+// and the lanes are scrambled after each block of 16 stripes.
+// The per-stripe key offset makes the result depend on the stripes' order.
+// All supported hosts are little-endian.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+    #include <emmintrin.h>
+    #define HASH_USE_SSE2
+#endif
+
+#include "hash_util.h"
+
+namespace HashUtil {
+
+///////////////////////////////////////////////////////////////////////////////
+
+constexpr int Lanes = 8;
+constexpr size_t StripeSize = Lanes * 8;
+constexpr int StripesPerBlock = 16;
+constexpr size_t BlockSize = StripeSize * StripesPerBlock;
+constexpr int KeyWords = Lanes + StripesPerBlock;
+
+constexpr uint64_t Prime32   = 0x9E3779B1u;
+constexpr uint64_t Prime64_1 = 0x9E3779B185EBCA87ull;
+constexpr uint64_t Prime64_2 = 0xC2B2AE3D27D4EB4Full;
+constexpr uint64_t Prime64_3 = 0x165667B19E3779F9ull;
+
+struct HashKey {
+    uint64_t w[KeyWords];
+    HashKey() {
+        // splitmix64 sequence
+        uint64_t x = Prime64_3;
+        for (int i = 0;  i < KeyWords;  ++i) {
+            uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            w[i] = z ^ (z >> 31);
+        }
+    }
+};
+static const HashKey key;
+
+static inline uint64_t read64(const uint8_t* p) {
+    uint64_t x;
+    memcpy(&x, p, 8);
+    return x;
+}
+
+static inline uint64_t rotl64(uint64_t x, int n) {
+    return (x << n) | (x >> (64 - n));
+}
+
+static inline uint64_t avalanche(uint64_t h) {
+    h ^= h >> 33;  h *= Prime64_2;
+    h ^= h >> 29;  h *= Prime64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+#ifdef HASH_USE_SSE2
+
+static inline void accumulate(__m128i* acc, const uint8_t* stripe, const uint64_t* k) {
+    for (int i = 0;  i < (Lanes / 2);  ++i) {
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&stripe[i * 16]));
+        __m128i dk = _mm_xor_si128(d, _mm_loadu_si128(reinterpret_cast<const __m128i*>(&k[i * 2])));
+        __m128i prod = _mm_mul_epu32(dk, _mm_srli_epi64(dk, 32));
+        __m128i swapped = _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+        acc[i] = _mm_add_epi64(acc[i], _mm_add_epi64(prod, swapped));
+    }
+}
+
+static inline void scramble(__m128i* acc) {
+    const __m128i prime = _mm_set1_epi32(int(Prime32));
+    for (int i = 0;  i < (Lanes / 2);  ++i) {
+        __m128i a = _mm_xor_si128(acc[i], _mm_srli_epi64(acc[i], 47));
+        a = _mm_xor_si128(a, _mm_loadu_si128(reinterpret_cast<const __m128i*>(&key.w[KeyWords - Lanes + i * 2])));
+        __m128i lo = _mm_mul_epu32(a, prime);
+        __m128i hi = _mm_slli_epi64(_mm_mul_epu32(_mm_srli_epi64(a, 32), prime), 32);
+        acc[i] = _mm_add_epi64(lo, hi);
+    }
+}
+
+static void processBulk(uint64_t* accOut, const uint8_t* p, size_t stripes) {
+    __m128i acc[Lanes / 2];
+    for (int i = 0;  i < (Lanes / 2);  ++i) {
+        acc[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&accOut[i * 2]));
+    }
+    for (size_t s = 0;  s < stripes;  ++s, p += StripeSize) {
+        accumulate(acc, p, &key.w[s % StripesPerBlock]);
+        if ((s % StripesPerBlock) == (StripesPerBlock - 1)) { scramble(acc); }
+    }
+    for (int i = 0;  i < (Lanes / 2);  ++i) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&accOut[i * 2]), acc[i]);
+    }
+}
+
+#else  // scalar version with identical results
+
+static void processBulk(uint64_t* acc, const uint8_t* p, size_t stripes) {
+    for (size_t s = 0;  s < stripes;  ++s, p += StripeSize) {
+        const uint64_t* k = &key.w[s % StripesPerBlock];
+        for (int i = 0;  i < Lanes;  ++i) {
+            uint64_t d = read64(&p[i * 8]);
+            uint64_t dk = d ^ k[i];
+            acc[i] += (dk & 0xFFFFFFFFu) * (dk >> 32);
+            acc[i ^ 1] += d;
+        }
+        if ((s % StripesPerBlock) == (StripesPerBlock - 1)) {
+            for (int i = 0;  i < Lanes;  ++i) {
+                uint64_t a = acc[i] ^ (acc[i] >> 47);
+                a ^= key.w[KeyWords - Lanes + i];
+                acc[i] = a * Prime32;
+            }
+        }
+    }
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+
+uint64_t hash64(const void* data, size_t size, uint64_t seed) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    uint64_t acc[Lanes];
+    for (int i = 0;  i < Lanes;  ++i) {
+        acc[i] = key.w[i] ^ (seed + uint64_t(i) * Prime64_1);
+    }
+
+    // bulk: whole stripes; the last (partial) stripe is zero-padded
+    size_t stripes = size / StripeSize;
+    if (stripes) { processBulk(acc, p, stripes); }
+    size_t rest = size % StripeSize;
+    if (rest) {
+        uint8_t last[StripeSize];
+        memset(last, 0, sizeof(last));
+        memcpy(last, &p[stripes * StripeSize], rest);
+        // the padded stripe gets a key offset of its own, so it doesn't
+        // collide with a full stripe ending in zeros
+        uint64_t tail[Lanes];
+        for (int i = 0;  i < Lanes;  ++i) {
+            tail[i] = read64(&last[i * 8]) ^ key.w[(i + 3) % KeyWords];
+            acc[i] += (tail[i] & 0xFFFFFFFFu) * (tail[i] >> 32) + read64(&last[(i ^ 1) * 8]);
+        }
+    }
+
+    // merge the lanes
+    uint64_t h = uint64_t(size) * Prime64_1 ^ seed;
+    for (int i = 0;  i < Lanes;  i += 2) {
+        h += avalanche(acc[i] * Prime64_2) ^ rotl64(acc[i + 1] * Prime64_3, 31);
+        h = rotl64(h, 27) * Prime64_1;
+    }
+    return avalanche(h);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+}  // namespace HashUtil
@@ -0,0 +1,28 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace HashUtil {
+
+///////////////////////////////////////////////////////////////////////////////
+
+//! fast non-cryptographic 64-bit hash, meant for large buffers (e.g. image
+//! data); the bulk of the data is processed in eight independent lanes,
+//! using SSE2 where available. The result is the same on all platforms
+//! (with the same byte order), so it can be used for data stored on disk.
+uint64_t hash64(const void* data, size_t size, uint64_t seed=0);
+
+//! hash a string
+inline uint64_t hash64(const char* str, uint64_t seed=0) {
+    size_t len = 0;
+    while (str && str[len]) { ++len; }
+    return hash64(str, len, seed);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+}  // namespace HashUtil
@@ -0,0 +1,66 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "stb_image.h"
+#include "stb_image_write.h"
+
+#include "string_util.h"
+#include "jpeg_util.h"
+#include "qoi_util.h"
+
+#include "image_util.h"
+
+namespace ImageUtil {
+
+///////////////////////////////////////////////////////////////////////////////
+
+uint8_t* load(const char* filename, int &width, int &height, int* channels) {
+    width = height = 0;
+    if (!filename || !filename[0]) { return nullptr; }
+    if (StringUtil::extractExtCode(filename) == StringUtil::makeExtCode("qoi")) {
+        return QOIUtil::load(filename, width, height, channels);
+    }
+    if (channels) {
+        *channels = 0;
+        return stbi_load(filename, &width, &height, channels, 0);
+    }
+    return stbi_load(filename, &width, &height, nullptr, 4);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool save(const char* filename, const uint8_t* data, int width, int height, int jpegQuality, JPEGUtil::Subsampling jpegSubsampling) {
+    if (!filename || !filename[0] || !data) { return false; }
+    int res;
+    switch (StringUtil::extractExtCode(filename)) {
+        case StringUtil::makeExtCode("jpg"):
+        case StringUtil::makeExtCode("jpeg"):
+        case StringUtil::makeExtCode("jpe"):
+            if (JPEGUtil::isAvailable()) {
+                return JPEGUtil::save(filename, data, width, height, jpegQuality, jpegSubsampling);
+            }
+            res = stbi_write_jpg(filename, width, height, 4, data, jpegQuality);
+            break;
+        case StringUtil::makeExtCode("png"):
+            res = stbi_write_png(filename, width, height, 4, data, 0);
+            break;
+        case StringUtil::makeExtCode("qoi"):
+            return QOIUtil::save(filename, data, width, height);
+        case StringUtil::makeExtCode("tga"):
+            res = stbi_write_tga(filename, width, height, 4, data);
+            break;
+        case StringUtil::makeExtCode("bmp"):
+            res = stbi_write_bmp(filename, width, height, 4, data);
+            break;
+        default:
+            return false;
+    }
+    return (res != 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+}  // namespace ImageUtil
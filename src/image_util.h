@@ -0,0 +1,30 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstdint>
+
+#include "jpeg_util.h"
+
+namespace ImageUtil {
+
+///////////////////////////////////////////////////////////////////////////////
+
+//! load an image file as 32-bit (8-bit per channel) RGBA; if channels is
+//! non-null, the file's native channel count is kept instead and stored
+//! there (1 = gray, 2 = gray+alpha, 3 = RGB, 4 = RGBA)
+//! \returns pointer to the image, allocated from the buffer pool, to be
+//!          freed by the caller with BufferPool::release(); or nullptr on failure
+uint8_t* load(const char* filename, int &width, int &height, int* channels=nullptr);
+
+//! save a 32-bit (8-bit per channel) RGBA image into a file;
+//! the file format is determined by the file name's extension;
+//! JPEG files are written with the parallel encoder if it's available
+//! \returns true on success, false on failure
+bool save(const char* filename, const uint8_t* data, int width, int height,
+          int jpegQuality=98, JPEGUtil::Subsampling jpegSubsampling=JPEGUtil::Subsampling::Auto);
+
+///////////////////////////////////////////////////////////////////////////////
+
+}  // namespace ImageUtil
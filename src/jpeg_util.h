@@ -0,0 +1,42 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstdint>
+
+namespace JPEGUtil {
+
+///////////////////////////////////////////////////////////////////////////////
+
+enum class Subsampling : int {
+    Auto = 0,  //!< 4:4:4 for quality > 90, 4:2:0 otherwise
+    S444 = 1,  //!< no chroma subsampling
+    S422 = 2,  //!< horizontal chroma subsampling
+    S420 = 3,  //!< horizontal and vertical chroma subsampling
+};
+
+//! check whether the accelerated (libjpeg-based) JPEG code is available
+//! in this build; if not, all other functions fail
+bool isAvailable();
+
+//! load a JPEG file that will be shown fit into a maxWidth x maxHeight box;
+//! if the image is larger than that, it's decoded at 1/2, 1/4 or 1/8 scale
+//! right in the DCT domain, as long as the result doesn't become smaller
+//! than the final size. The native number of channels (1 = gray, 3 = RGB)
+//! is kept and stored in channels.
+//! \returns pointer to the image, allocated from the buffer pool, to be
+//!          freed by the caller with BufferPool::release(); or nullptr on failure
+uint8_t* loadScaled(const char* filename, int maxWidth, int maxHeight, int &width, int &height, int &channels);
+
+//! save a 32-bit (8-bit per channel) RGBA image as a JPEG file (alpha is
+//! ignored); the image is split into horizontal stripes that are encoded
+//! in parallel and joined using restart markers
+//! \param threads  maximum number of threads to use (0 = all threads of the current pool)
+//! \returns true on success, false on failure
+bool save(const char* filename, const uint8_t* data, int width, int height,
+          int quality=98, Subsampling subsampling=Subsampling::Auto, int threads=0);
+
+///////////////////////////////////////////////////////////////////////////////
+
+}  // namespace JPEGUtil
@@ -0,0 +1,21 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#include <cstdint>
+
+#include "jpeg_util.h"
+
+bool JPEGUtil::isAvailable() {
+    return false;
+}
+
+uint8_t* JPEGUtil::loadScaled(const char* filename, int maxWidth, int maxHeight, int &width, int &height, int &channels) {
+    (void)filename, (void)maxWidth, (void)maxHeight;
+    width = height = channels = 0;
+    return nullptr;
+}
+
+bool JPEGUtil::save(const char* filename, const uint8_t* data, int width, int height, int quality, Subsampling subsampling, int threads) {
+    (void)filename, (void)data, (void)width, (void)height, (void)quality, (void)subsampling, (void)threads;
+    return false;
+}
@@ -0,0 +1,301 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <csetjmp>
+#include <cstring>
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include <jpeglib.h>
+
+#include "buffer_pool.h"
+#include "thread_pool.h"
+#include "jpeg_util.h"
+
+namespace JPEGUtil {
+
+///////////////////////////////////////////////////////////////////////////////
+
+// libjpeg reports fatal errors through a callback that must not return,
+// so we jump back into the calling function
+struct ErrorManager {
+    jpeg_error_mgr pub;
+    jmp_buf jump;
+};
+
+static void errorExit(j_common_ptr cinfo) {
+    longjmp(reinterpret_cast<ErrorManager*>(cinfo->err)->jump, 1);
+}
+
+static void outputMessage(j_common_ptr cinfo) {
+    (void)cinfo;  // warnings are not interesting here
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool isAvailable() {
+    return true;
+}
+
+uint8_t* loadScaled(const char* filename, int maxWidth, int maxHeight, int &width, int &height, int &channels) {
+    width = height = channels = 0;
+    if (!filename || !filename[0]) { return nullptr; }
+    FILE* f = fopen(filename, "rb");
+    if (!f) { return nullptr; }
+
+    jpeg_decompress_struct cinfo;
+    ErrorManager err;
+    uint8_t* volatile data = nullptr;
+    cinfo.err = jpeg_std_error(&err.pub);
+    err.pub.error_exit = errorExit;
+    err.pub.output_message = outputMessage;
+    if (setjmp(err.jump)) {
+        jpeg_destroy_decompress(&cinfo);
+        fclose(f);
+        BufferPool::release(data);
+        return nullptr;
+    }
+    jpeg_create_decompress(&cinfo);
+    jpeg_stdio_src(&cinfo, f);
+    jpeg_read_header(&cinfo, TRUE);
+
+    // CMYK/YCCK can't be converted to RGB by libjpeg; leave those to stb_image
+    if ((cinfo.jpeg_color_space == JCS_CMYK) || (cinfo.jpeg_color_space == JCS_YCCK)) {
+        jpeg_destroy_decompress(&cinfo);
+        fclose(f);
+        return nullptr;
+    }
+    cinfo.out_color_space = (cinfo.num_components == 1) ? JCS_GRAYSCALE : JCS_RGB;
+
+    // find the largest DCT scaling factor that keeps the image larger
+    // than the size it will be shown at (same rounding as App::loadImage)
+    int imgWidth = int(cinfo.image_width), imgHeight = int(cinfo.image_height);
+    unsigned denom = 1;
+    if ((imgWidth > maxWidth) || (imgHeight > maxHeight)) {
+        int fitWidth  = maxWidth;
+        int fitHeight = (imgHeight * fitWidth + (imgWidth / 2)) / imgWidth;
+        if (fitHeight > maxHeight) {
+            fitHeight = maxHeight;
+            fitWidth = (imgWidth * fitHeight + (imgHeight / 2)) / imgHeight;
+        }
+        while ((denom < 8u)
+           && ((imgWidth  / int(denom * 2u)) >= fitWidth)
+           && ((imgHeight / int(denom * 2u)) >= fitHeight)) {
+            denom *= 2u;
+        }
+    }
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = denom;
+
+    jpeg_start_decompress(&cinfo);
+    size_t stride = size_t(cinfo.output_width) * size_t(cinfo.output_components);
+    data = static_cast<uint8_t*>(BufferPool::alloc(stride * size_t(cinfo.output_height)));
+    if (!data) {
+        jpeg_destroy_decompress(&cinfo);
+        fclose(f);
+        return nullptr;
+    }
+    #ifndef NDEBUG
+        fprintf(stderr, "decoding %dx%d JPEG at 1/%u scale -> %ux%u\n", imgWidth, imgHeight, denom, cinfo.output_width, cinfo.output_height);
+    #endif
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW row = data + size_t(cinfo.output_scanline) * stride;
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    width = int(cinfo.output_width);
+    height = int(cinfo.output_height);
+    channels = cinfo.output_components;
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    fclose(f);
+    return data;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Parallel encoding: the image is split into stripes of whole MCU rows,
+// each of which is encoded into a complete JPEG file in memory, with a
+// restart interval of one MCU row. As all stripes use the same (standard)
+// tables, the final file can be assembled from the headers of the first
+// stripe (with the image height patched) and the entropy-coded data of all
+// stripes, separated by additional restart markers. The restart markers
+// inside the stripes need to be renumbered, as they must cycle through
+// RST0...RST7 across the whole image.
+
+struct Stripe {
+    int y0 = 0;
+    int height = 0;
+    unsigned char* buf = nullptr;
+    unsigned long size = 0;
+    size_t scanStart = 0;     //!< offset of the entropy-coded data
+    size_t heightPos = 0;     //!< offset of the height field in the SOF header
+    bool ok = false;
+};
+
+static void encodeStripe(const uint8_t* data, int width, int quality, int hSamp, int vSamp, bool restarts, Stripe& s) {
+    jpeg_compress_struct cinfo;
+    ErrorManager err;
+    uint8_t* volatile rowBuf = nullptr;
+    cinfo.err = jpeg_std_error(&err.pub);
+    err.pub.error_exit = errorExit;
+    err.pub.output_message = outputMessage;
+    if (setjmp(err.jump)) {
+        jpeg_destroy_compress(&cinfo);
+        ::free(rowBuf);
+        ::free(s.buf);
+        s.buf = nullptr;
+        s.size = 0;
+        s.ok = false;
+        return;
+    }
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, &s.buf, &s.size);
+    cinfo.image_width = JDIMENSION(width);
+    cinfo.image_height = JDIMENSION(s.height);
+    #ifdef JCS_EXTENSIONS
+        // libjpeg-turbo can read RGBA directly (with SIMD color conversion)
+        cinfo.input_components = 4;
+        cinfo.in_color_space = JCS_EXT_RGBA;
+    #else
+        cinfo.input_components = 3;
+        cinfo.in_color_space = JCS_RGB;
+        rowBuf = static_cast<uint8_t*>(malloc(size_t(width) * 3u));
+        if (!rowBuf) {
+            jpeg_destroy_compress(&cinfo);
+            ::free(s.buf);
+            s.buf = nullptr;
+            s.size = 0;
+            return;
+        }
+    #endif
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+    cinfo.comp_info[0].h_samp_factor = hSamp;
+    cinfo.comp_info[0].v_samp_factor = vSamp;
+    if (restarts) { cinfo.restart_in_rows = 1; }
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        const uint8_t* src = &data[(size_t(s.y0) + size_t(cinfo.next_scanline)) * size_t(width) * 4u];
+        #ifdef JCS_EXTENSIONS
+            JSAMPROW row = const_cast<JSAMPROW>(src);
+        #else
+            JSAMPROW row = rowBuf;
+            for (int x = 0;  x < width;  ++x) {
+                row[x * 3 + 0] = src[x * 4 + 0];
+                row[x * 3 + 1] = src[x * 4 + 1];
+                row[x * 3 + 2] = src[x * 4 + 2];
+            }
+        #endif
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    ::free(rowBuf);
+    s.ok = true;
+}
+
+//! locate the SOF height field and the start of the entropy-coded data
+static bool parseStripe(Stripe& s) {
+    const uint8_t* p = s.buf;
+    size_t size = size_t(s.size);
+    if (!p || (size < 4) || (p[0] != 0xFF) || (p[1] != 0xD8) || (p[size - 2] != 0xFF) || (p[size - 1] != 0xD9)) {
+        return false;
+    }
+    size_t pos = 2;
+    while ((pos + 4) <= size) {
+        if (p[pos] != 0xFF) { return false; }
+        uint8_t marker = p[pos + 1];
+        size_t len = (size_t(p[pos + 2]) << 8) | size_t(p[pos + 3]);
+        if ((marker >= 0xC0) && (marker <= 0xC2)) { s.heightPos = pos + 5; }
+        pos += 2 + len;
+        if (marker == 0xDA) {
+            s.scanStart = pos;
+            return s.heightPos && (pos <= (size - 2));
+        }
+    }
+    return false;
+}
+
+bool save(const char* filename, const uint8_t* data, int width, int height, int quality, Subsampling subsampling, int threads) {
+    if (!filename || !filename[0] || !data || (width <= 0) || (height <= 0) || (height > 65535) || (width > 65535)) {
+        return false;
+    }
+    quality = std::min(std::max(quality, 1), 100);
+    if (subsampling == Subsampling::Auto) {
+        subsampling = (quality > 90) ? Subsampling::S444 : Subsampling::S420;
+    }
+    int hSamp = (subsampling == Subsampling::S444) ? 1 : 2;
+    int vSamp = (subsampling == Subsampling::S420) ? 2 : 1;
+
+    // split into stripes of whole MCU rows
+    if (threads <= 0) { threads = currentThreadCount(); }
+    int mcuHeight = 8 * vSamp;
+    int mcuRows = (height + mcuHeight - 1) / mcuHeight;
+    int stripeCount = std::max(1, std::min(threads, mcuRows));
+    std::vector<Stripe> stripes(static_cast<size_t>(stripeCount));
+    for (int i = 0;  i < stripeCount;  ++i) {
+        Stripe& s = stripes[size_t(i)];
+        s.y0 = (mcuRows * i / stripeCount) * mcuHeight;
+        s.height = std::min((mcuRows * (i + 1) / stripeCount) * mcuHeight, height) - s.y0;
+    }
+    #ifndef NDEBUG
+        fprintf(stderr, "encoding %dx%d JPEG (quality %d, %d:%d:%d) in %d stripe(s)\n",
+                width, height, quality, 4, 4 / hSamp, (vSamp > 1) ? 0 : (4 / hSamp), stripeCount);
+    #endif
+
+    // encode all stripes in parallel
+    bool restarts = (stripeCount > 1);
+    parallelFor(0, stripeCount, 1, [&] (int begin, int end) {
+        for (int i = begin;  i < end;  ++i) {
+            encodeStripe(data, width, quality, hSamp, vSamp, restarts, stripes[size_t(i)]);
+        }
+    });
+
+    bool ok = true;
+    for (auto& s : stripes) {
+        ok = ok && s.ok && parseStripe(s);
+    }
+    FILE* f = ok ? fopen(filename, "wb") : nullptr;
+    if (f) {
+        // headers of the first stripe, with the full image height
+        Stripe& first = stripes[0];
+        first.buf[first.heightPos]     = uint8_t(height >> 8);
+        first.buf[first.heightPos + 1] = uint8_t(height);
+        ok = (fwrite(first.buf, 1, first.scanStart, f) == first.scanStart);
+
+        // entropy-coded data with renumbered restart markers
+        int restartIndex = 0;
+        for (size_t i = 0;  ok && (i < stripes.size());  ++i) {
+            Stripe& s = stripes[i];
+            if (i) {
+                uint8_t rst[2] = { 0xFF, uint8_t(0xD0 + (restartIndex++ & 7)) };
+                ok = (fwrite(rst, 1, 2, f) == 2);
+            }
+            uint8_t* p = &s.buf[s.scanStart];
+            uint8_t* end = &s.buf[s.size - 2];
+            for (uint8_t* q = p;  (q + 1) < end;  ++q) {
+                if ((q[0] == 0xFF) && ((q[1] & 0xF8) == 0xD0)) {
+                    q[1] = uint8_t(0xD0 + (restartIndex++ & 7));
+                }
+            }
+            size_t len = size_t(end - p);
+            ok = ok && (fwrite(p, 1, len, f) == len);
+        }
+        static const uint8_t eoi[2] = { 0xFF, 0xD9 };
+        ok = ok && (fwrite(eoi, 1, 2, f) == 2);
+        ok = (fclose(f) == 0) && ok;
+    } else {
+        ok = false;
+    }
+    for (auto& s : stripes) { ::free(s.buf); }
+    return ok;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+}  // namespace JPEGUtil
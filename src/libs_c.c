@@ -1,9 +1,21 @@
+// all image-sized allocations of the stb libraries go through the buffer
+// pool; everything that's allocated here can be freed with BufferPool::release()
+#include "buffer_pool.h"
+
+#define STBI_MALLOC(sz)         BufferPool_alloc(sz)
+#define STBI_REALLOC(p,newsz)   BufferPool_resize(p, newsz)
+#define STBI_FREE(p)            BufferPool_release(p)
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#define STBIW_MALLOC(sz)        BufferPool_alloc(sz)
+#define STBIW_REALLOC(p,newsz)  BufferPool_resize(p, newsz)
+#define STBIW_FREE(p)           BufferPool_release(p)
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
 
+#define STBIR_MALLOC(size,c)    ((void)(c), BufferPool_alloc(size))
+#define STBIR_FREE(ptr,c)       ((void)(c), BufferPool_release(ptr))
 #define STB_IMAGE_RESIZE_IMPLEMENTATION
 #define STBIR_DEFAULT_FILTER_DOWNSAMPLE STBIR_FILTER_BOX  // for sharper images
 #include "stb_image_resize.h"
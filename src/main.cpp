@@ -6,9 +6,24 @@
     #include "string_util.h"
 #endif
 
+#include <cstring>
+
 #include "gips_app.h"
+#include "gips_cli.h"
+#ifndef _WIN32
+    #include "gips_daemon.h"
+#endif
 
 int main(int argc, char* argv[]) {
+    if ((argc > 1) && GIPS::CLI::isCommand(argv[1])) {
+        return GIPS::CLI::run(argc, argv);
+    }
+    #ifndef _WIN32
+        if ((argc > 1) && !strcmp(argv[1], "--daemon")) {
+            static GIPS::Daemon daemon;
+            return daemon.run(argc, argv);
+        }
+    #endif
     static GIPS::App app;
     return app.run(argc, argv);
 }
@@ -8,6 +8,7 @@
 
 #include <algorithm>
 
+#include "thread_pool.h"
 #include "patterns.h"
 
 #include "gips_logo.h"
@@ -101,19 +102,23 @@ static void PatGradient(uint8_t* data, int width, int height, bool alpha) {
         { 63, 31, 55, 23, 61, 29, 53, 21 },
     };
 
-    // produce bitmap
-    for (int y = height;  y;  --y) {
-        for (int x = width;  x;  --x) {
-            int m = g(x, y) - mapMin;
-            int radj = int(bayer3[y&7][x&7]) << (23 - 6);
-            for (int c = 0;  c < nc;  ++c) {
-                *data++ = comp[c].c0 + uint8_t((comp[c].scale * m + radj) >> 23);
-            }
-            if (!alpha) {
-                *data++ = 0xFF;
+    // produce bitmap; rows are independent, so they're done in parallel
+    parallelFor(0, height, 0, [&] (int rowBegin, int rowEnd) {
+        uint8_t* p = &data[size_t(rowBegin) * size_t(width) * 4u];
+        Gradient gr(g);
+        for (int y = height - rowBegin;  y > (height - rowEnd);  --y) {
+            for (int x = width;  x;  --x) {
+                int m = gr(x, y) - mapMin;
+                int radj = int(bayer3[y&7][x&7]) << (23 - 6);
+                for (int c = 0;  c < nc;  ++c) {
+                    *p++ = comp[c].c0 + uint8_t((comp[c].scale * m + radj) >> 23);
+                }
+                if (!alpha) {
+                    *p++ = 0xFF;
+                }
             }
         }
-    }
+    });
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -282,21 +287,25 @@ const PatternDefinition Patterns[] = {
     float o1mod = r.getRange(0.5f, 5.0f);
     float cAmp = r.getRange(3.0f, 5.0f);
     float cPhase = r.getF() * 6.28f;
-    for (int iy = height;  iy;  --iy) {
-        float y = scale * float(iy - cy);
-        for (int ix = width;  ix;  --ix) {
-            float x = scale * float(ix - cx);
-            float f = o3(x,y);
-            f += o2(x,y) + std::sin(f * o2mod);
-            f += o1(x,y) + std::sin(f * o1mod);
-            f *= cAmp;
-            *data++ = uint8_t(128.0f + 127.9f * std::sin(f + cPhase));
-            *data++ = uint8_t(128.0f + 127.9f * std::sin(f + cPhase + 2.1f));
-            *data++ = uint8_t(128.0f + 127.9f * std::sin(f + cPhase + 4.2f));
-            *data++ = !alpha ? 255
-                    : uint8_t(128.0f + 127.9f * std::sin(f + cPhase + 3.1f));
+    parallelFor(0, height, 0, [&] (int rowBegin, int rowEnd) {
+        uint8_t* p = &data[size_t(rowBegin) * size_t(width) * 4u];
+        Octave p1(o1), p2(o2), p3(o3);
+        for (int iy = height - rowBegin;  iy > (height - rowEnd);  --iy) {
+            float y = scale * float(iy - cy);
+            for (int ix = width;  ix;  --ix) {
+                float x = scale * float(ix - cx);
+                float f = p3(x,y);
+                f += p2(x,y) + std::sin(f * o2mod);
+                f += p1(x,y) + std::sin(f * o1mod);
+                f *= cAmp;
+                *p++ = uint8_t(128.0f + 127.9f * std::sin(f + cPhase));
+                *p++ = uint8_t(128.0f + 127.9f * std::sin(f + cPhase + 2.1f));
+                *p++ = uint8_t(128.0f + 127.9f * std::sin(f + cPhase + 4.2f));
+                *p++ = !alpha ? 255
+                     : uint8_t(128.0f + 127.9f * std::sin(f + cPhase + 3.1f));
+            }
         }
-    }
+    });
 }},
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -337,19 +346,25 @@ const PatternDefinition Patterns[] = {
     }
     float distNorm = 1.0f / (std::sqrt(2.0f) * float(cellSize));
 
-    // JFA propagation
+    // JFA propagation; each pass works in-place along one axis only, so the
+    // rows (for horizontal passes) or columns (for vertical passes) are
+    // independent of each other and can be processed in parallel
     auto jfaSingleDir = [=](const int dx, const int dy) {
-        for (int y = std::max(0, -dy);  y < std::min(height, height - dy);  ++y) {
-            const auto *srcRow = &jfaMap[(y + dy) * width];
-            auto *destRow = &jfaMap[y * width];
-            for (int x = std::max(0, -dx);  x < std::min(width, width - dx);  ++x) {
-                const auto& src = srcRow[x + dx];
-                auto& dest = destRow[x];
-                if (!dest.valid() || (src.valid() && (src.distTo(x, y) < dest.distTo(x, y)))) {
-                    dest = src;
+        auto run = [=](int x0, int x1, int y0, int y1) {
+            for (int y = std::max(y0, -dy);  y < std::min(y1, height - dy);  ++y) {
+                const auto *srcRow = &jfaMap[(y + dy) * width];
+                auto *destRow = &jfaMap[y * width];
+                for (int x = std::max(x0, -dx);  x < std::min(x1, width - dx);  ++x) {
+                    const auto& src = srcRow[x + dx];
+                    auto& dest = destRow[x];
+                    if (!dest.valid() || (src.valid() && (src.distTo(x, y) < dest.distTo(x, y)))) {
+                        dest = src;
+                    }
                 }
             }
-        }
+        };
+        if (dy) { parallelFor(0, width,  0, [=](int x0, int x1) { run(x0, x1, 0, height); }); }
+        else    { parallelFor(0, height, 0, [=](int y0, int y1) { run(0, width, y0, y1); }); }
     };
     int stepSize = cellSize;
     while (stepSize & (stepSize + 1)) { stepSize |= (stepSize >> 1); }
@@ -360,37 +375,45 @@ const PatternDefinition Patterns[] = {
         jfaSingleDir(0, -stepSize);
     }
 
-    // convert JFA map into result image
-    const JFAPixel *pMap = jfaMap;
-    JFAPixel cluster; cluster.cx = cluster.cy = 0;
-    float baseCol[3] = {0.0f,};
-    for (int y = 0;  y < height;  ++y) {
-        for (int x = 0;  x < width;  ++x) {
-            // get current cluster and its base color
-            if ((pMap->cx != cluster.cx) || (pMap->cy != cluster.cy)) {
-                cluster = *pMap;
-                r.setSeed((uint32_t(cluster.cx) << 16) | uint32_t(cluster.cy));
-                (void)r.getU32();
-                baseCol[0] = r.getRange(0.0f, 0.5f);
-                baseCol[1] = r.getRange(0.5f, 1.0f);
-                baseCol[2] = r.getRange(baseCol[0], baseCol[1]);
-                std::swap(baseCol[0], baseCol[r.getRange(0, 2)]);
-                std::swap(baseCol[1], baseCol[r.getRange(1, 2)]);
-            }
-            ++pMap;
+    // convert JFA map into result image; the colors only depend on the
+    // cluster center, so rows can be converted in parallel
+    parallelFor(0, height, 0, [=](int rowBegin, int rowEnd) {
+        PRNG cr;
+        uint8_t* p = &data[size_t(rowBegin) * size_t(width) * 4u];
+        const JFAPixel *pMap = &jfaMap[rowBegin * width];
+        JFAPixel cluster; cluster.cx = cluster.cy = 0;
+        int64_t clusterID = -1;  // invalid, so every chunk starts with a lookup
+        float baseCol[3] = {0.0f,};
+        for (int y = rowBegin;  y < rowEnd;  ++y) {
+            for (int x = 0;  x < width;  ++x) {
+                // get current cluster and its base color
+                uint32_t id = (uint32_t(pMap->cx) << 16) | uint32_t(pMap->cy);
+                if (int64_t(id) != clusterID) {
+                    cluster = *pMap;
+                    clusterID = int64_t(id);
+                    cr.setSeed(id);
+                    (void)cr.getU32();
+                    baseCol[0] = cr.getRange(0.0f, 0.5f);
+                    baseCol[1] = cr.getRange(0.5f, 1.0f);
+                    baseCol[2] = cr.getRange(baseCol[0], baseCol[1]);
+                    std::swap(baseCol[0], baseCol[cr.getRange(0, 2)]);
+                    std::swap(baseCol[1], baseCol[cr.getRange(1, 2)]);
+                }
+                ++pMap;
 
-            // get (inverse) normalized distance from center
-            float dist = 1.0f - std::min(1.0f, distNorm * std::sqrt(float(cluster.distTo(x, y))));
+                // get (inverse) normalized distance from center
+                float dist = 1.0f - std::min(1.0f, distNorm * std::sqrt(float(cluster.distTo(x, y))));
 
-            // compute final color
-            for (int i = 0;  i < 3;  ++i) {
-                float c = baseCol[i];
-                if (!alpha) { c *= dist; }
-                *data++ = uint8_t(c * 255.984375f);
+                // compute final color
+                for (int i = 0;  i < 3;  ++i) {
+                    float c = baseCol[i];
+                    if (!alpha) { c *= dist; }
+                    *p++ = uint8_t(c * 255.984375f);
+                }
+                *p++ = alpha ? uint8_t(dist * 255.984375f) : 0xFF;
             }
-            *data++ = alpha ? uint8_t(dist * 255.984375f) : 0xFF;
         }
-    }
+    });
 
     delete[] jfaMap;
 }},
@@ -399,14 +422,17 @@ const PatternDefinition Patterns[] = {
 
 { "XOR", true,
 [](uint8_t* data, int width, int height, bool alpha) {
-    for (int y = 0;  y < height;  ++y) {
-        for (int x = 0;  x < width;  ++x) {
-            *data++ = uint8_t(x) ^ 255;
-            *data++ = uint8_t(x ^ y);
-            *data++ = uint8_t(y);
-            *data++ = alpha ? uint8_t(x - y) : 255;
+    parallelFor(0, height, 0, [=](int rowBegin, int rowEnd) {
+        uint8_t* p = &data[size_t(rowBegin) * size_t(width) * 4u];
+        for (int y = rowBegin;  y < rowEnd;  ++y) {
+            for (int x = 0;  x < width;  ++x) {
+                *p++ = uint8_t(x) ^ 255;
+                *p++ = uint8_t(x ^ y);
+                *p++ = uint8_t(y);
+                *p++ = alpha ? uint8_t(x - y) : 255;
+            }
         }
-    }
+    });
 }},
 
 ///////////////////////////////////////////////////////////////////////////////
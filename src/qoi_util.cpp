@@ -0,0 +1,259 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include "file_util.h"
+#include "buffer_pool.h"
+#include "thread_pool.h"
+
+#include "qoi_util.h"
+
+namespace QOIUtil {
+
+///////////////////////////////////////////////////////////////////////////////
+
+static constexpr size_t HeaderSize = 14;
+static constexpr uint8_t EndMarker[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+static constexpr int MaxPixels = 400000000;  // limit from the reference implementation
+
+static constexpr uint8_t OpIndex = 0x00;
+static constexpr uint8_t OpDiff  = 0x40;
+static constexpr uint8_t OpLuma  = 0x80;
+static constexpr uint8_t OpRun   = 0xC0;
+static constexpr uint8_t OpRGB   = 0xFE;
+static constexpr uint8_t OpRGBA  = 0xFF;
+static constexpr uint8_t OpMask  = 0xC0;
+
+// don't bother with multiple threads for small images
+static constexpr int MinPixelsPerChunk = 65536;
+
+union Pixel {
+    struct { uint8_t r, g, b, a; } c;
+    uint32_t v;
+};
+
+static inline int hashPixel(const Pixel& p) {
+    return (p.c.r * 3 + p.c.g * 5 + p.c.b * 7 + p.c.a * 11) & 63;
+}
+
+static inline uint32_t readBE32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+static inline void writeBE32(uint8_t* p, uint32_t x) {
+    p[0] = uint8_t(x >> 24);  p[1] = uint8_t(x >> 16);  p[2] = uint8_t(x >> 8);  p[3] = uint8_t(x);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool isQOI(const void* data, size_t size) {
+    return data && (size >= HeaderSize) && !memcmp(data, "qoif", 4);
+}
+
+uint8_t* decode(const void* data, size_t size, int &width, int &height, int* channels) {
+    width = height = 0;
+    if (!isQOI(data, size) || (size < (HeaderSize + sizeof(EndMarker)))) { return nullptr; }
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    uint32_t w = readBE32(&p[4]), h = readBE32(&p[8]);
+    int fileChannels = p[12];
+    if (!w || !h || (h >= uint32_t(MaxPixels) / w) || (fileChannels < 3) || (fileChannels > 4)) { return nullptr; }
+    int outChannels = channels ? fileChannels : 4;
+    size_t pixelCount = size_t(w) * size_t(h);
+    uint8_t* out = static_cast<uint8_t*>(BufferPool::alloc(pixelCount * size_t(outChannels)));
+    if (!out) { return nullptr; }
+
+    Pixel index[64];
+    memset(index, 0, sizeof(index));
+    Pixel px;
+    px.v = 0;  px.c.a = 255;
+    const uint8_t* pos = &p[HeaderSize];
+    const uint8_t* end = &p[size - sizeof(EndMarker)];
+    int run = 0;
+    uint8_t* dest = out;
+    for (size_t i = 0;  i < pixelCount;  ++i) {
+        if (run > 0) {
+            --run;
+        } else if (pos < end) {
+            uint8_t b1 = *pos++;
+            if (b1 == OpRGB) {
+                if ((end - pos) < 3) { break; }
+                px.c.r = pos[0];  px.c.g = pos[1];  px.c.b = pos[2];
+                pos += 3;
+            } else if (b1 == OpRGBA) {
+                if ((end - pos) < 4) { break; }
+                px.c.r = pos[0];  px.c.g = pos[1];  px.c.b = pos[2];  px.c.a = pos[3];
+                pos += 4;
+            } else if ((b1 & OpMask) == OpIndex) {
+                px = index[b1];
+            } else if ((b1 & OpMask) == OpDiff) {
+                px.c.r = uint8_t(px.c.r + ((b1 >> 4) & 3) - 2);
+                px.c.g = uint8_t(px.c.g + ((b1 >> 2) & 3) - 2);
+                px.c.b = uint8_t(px.c.b + ( b1       & 3) - 2);
+            } else if ((b1 & OpMask) == OpLuma) {
+                if (pos >= end) { break; }
+                uint8_t b2 = *pos++;
+                int vg = (b1 & 0x3F) - 32;
+                px.c.r = uint8_t(px.c.r + vg - 8 + ((b2 >> 4) & 0x0F));
+                px.c.g = uint8_t(px.c.g + vg);
+                px.c.b = uint8_t(px.c.b + vg - 8 +  (b2       & 0x0F));
+            } else {  // OpRun
+                run = b1 & 0x3F;
+            }
+            index[hashPixel(px)] = px;
+        }
+        dest[0] = px.c.r;  dest[1] = px.c.g;  dest[2] = px.c.b;
+        if (outChannels == 4) { dest[3] = px.c.a; }
+        dest += outChannels;
+    }
+    if (dest != &out[pixelCount * size_t(outChannels)]) {
+        BufferPool::release(out);
+        return nullptr;
+    }
+    width = int(w);
+    height = int(h);
+    if (channels) { *channels = outChannels; }
+    return out;
+}
+
+uint8_t* load(const char* filename, int &width, int &height, int* channels) {
+    width = height = 0;
+    FileUtil::MappedFile file;
+    if (!file.open(filename)) { return nullptr; }
+    return decode(file.data(), file.size(), width, height, channels);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Chunked encoding: each chunk (a range of rows) is encoded independently,
+// starting with the last pixel of the previous chunk as the "previous"
+// pixel. The decoder's color index, however, still contains entries from
+// the previous chunks that the chunk encoder doesn't know about. To stay
+// compatible, a chunk only emits index references to entries it has
+// written itself; the decoder has stored the very same pixels there.
+// The concatenation of all chunks is thus a regular QOI data stream.
+
+struct Chunk {
+    int firstPixel = 0;
+    int pixelCount = 0;
+    uint8_t* buf = nullptr;
+    size_t size = 0;
+    bool opaque = true;
+};
+
+static void encodeChunk(const uint8_t* data, Chunk& chunk) {
+    chunk.buf = static_cast<uint8_t*>(BufferPool::alloc(size_t(chunk.pixelCount) * 5u));
+    if (!chunk.buf) { return; }
+    uint8_t* out = chunk.buf;
+
+    Pixel index[64];
+    memset(index, 0, sizeof(index));
+    // the first chunk knows the decoder's initial (all-zero) index
+    uint64_t validIndex = chunk.firstPixel ? 0u : ~uint64_t(0);
+    Pixel prev;
+    if (chunk.firstPixel) {
+        memcpy(&prev.v, &data[(size_t(chunk.firstPixel) - 1u) * 4u], 4);
+    } else {
+        prev.v = 0;  prev.c.a = 255;
+    }
+
+    const uint8_t* src = &data[size_t(chunk.firstPixel) * 4u];
+    int run = 0;
+    for (int i = 0;  i < chunk.pixelCount;  ++i, src += 4) {
+        Pixel px;
+        memcpy(&px.v, src, 4);
+        if (px.c.a != 255) { chunk.opaque = false; }
+        if (px.v == prev.v) {
+            if (++run == 62) { *out++ = uint8_t(OpRun | (run - 1));  run = 0; }
+            continue;
+        }
+        if (run) { *out++ = uint8_t(OpRun | (run - 1));  run = 0; }
+        int h = hashPixel(px);
+        if (((validIndex >> h) & 1u) && (index[h].v == px.v)) {
+            *out++ = uint8_t(OpIndex | h);
+        } else {
+            index[h] = px;
+            validIndex |= uint64_t(1) << h;
+            if (px.c.a == prev.c.a) {
+                int vr = int(int8_t(uint8_t(px.c.r - prev.c.r)));
+                int vg = int(int8_t(uint8_t(px.c.g - prev.c.g)));
+                int vb = int(int8_t(uint8_t(px.c.b - prev.c.b)));
+                int vgr = vr - vg, vgb = vb - vg;
+                if ((vr >= -2) && (vr <= 1) && (vg >= -2) && (vg <= 1) && (vb >= -2) && (vb <= 1)) {
+                    *out++ = uint8_t(OpDiff | ((vr + 2) << 4) | ((vg + 2) << 2) | (vb + 2));
+                } else if ((vgr >= -8) && (vgr <= 7) && (vg >= -32) && (vg <= 31) && (vgb >= -8) && (vgb <= 7)) {
+                    *out++ = uint8_t(OpLuma | (vg + 32));
+                    *out++ = uint8_t(((vgr + 8) << 4) | (vgb + 8));
+                } else {
+                    *out++ = OpRGB;
+                    *out++ = px.c.r;  *out++ = px.c.g;  *out++ = px.c.b;
+                }
+            } else {
+                *out++ = OpRGBA;
+                *out++ = px.c.r;  *out++ = px.c.g;  *out++ = px.c.b;  *out++ = px.c.a;
+            }
+        }
+        prev = px;
+    }
+    if (run) { *out++ = uint8_t(OpRun | (run - 1)); }
+    chunk.size = size_t(out - chunk.buf);
+}
+
+bool save(const char* filename, const uint8_t* data, int width, int height, int threads) {
+    if (!filename || !filename[0] || !data || (width <= 0) || (height <= 0) || (height >= (MaxPixels / width))) {
+        return false;
+    }
+
+    // split into chunks of whole rows
+    if (threads <= 0) { threads = currentThreadCount(); }
+    int chunkCount = std::max(1, std::min({ threads, height, (width * height) / MinPixelsPerChunk }));
+    std::vector<Chunk> chunks(static_cast<size_t>(chunkCount));
+    for (int i = 0;  i < chunkCount;  ++i) {
+        int y0 = height * i / chunkCount, y1 = height * (i + 1) / chunkCount;
+        chunks[size_t(i)].firstPixel = y0 * width;
+        chunks[size_t(i)].pixelCount = (y1 - y0) * width;
+    }
+    #ifndef NDEBUG
+        fprintf(stderr, "encoding %dx%d QOI image in %d chunk(s)\n", width, height, chunkCount);
+    #endif
+
+    // encode all chunks in parallel
+    parallelFor(0, chunkCount, 1, [data, &chunks] (int begin, int end) {
+        for (int i = begin;  i < end;  ++i) { encodeChunk(data, chunks[size_t(i)]); }
+    });
+
+    bool ok = true, opaque = true;
+    for (const auto& c : chunks) {
+        ok = ok && c.buf;
+        opaque = opaque && c.opaque;
+    }
+    FILE* f = ok ? fopen(filename, "wb") : nullptr;
+    if (f) {
+        uint8_t header[HeaderSize] = { 'q', 'o', 'i', 'f' };
+        writeBE32(&header[4], uint32_t(width));
+        writeBE32(&header[8], uint32_t(height));
+        header[12] = opaque ? 3 : 4;
+        header[13] = 0;  // sRGB with linear alpha
+        ok = (fwrite(header, 1, HeaderSize, f) == HeaderSize);
+        for (const auto& c : chunks) {
+            ok = ok && (fwrite(c.buf, 1, c.size, f) == c.size);
+        }
+        ok = ok && (fwrite(EndMarker, 1, sizeof(EndMarker), f) == sizeof(EndMarker));
+        ok = (fclose(f) == 0) && ok;
+    } else {
+        ok = false;
+    }
+    for (auto& c : chunks) { BufferPool::release(c.buf); }
+    return ok;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+}  // namespace QOIUtil
@@ -0,0 +1,38 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+// Reader and writer for the "Quite OK Image" format (https://qoiformat.org),
+// a simple and very fast lossless format for scratch and intermediate files.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace QOIUtil {
+
+///////////////////////////////////////////////////////////////////////////////
+
+//! check whether a block of memory starts with a QOI header
+bool isQOI(const void* data, size_t size);
+
+//! decode a QOI image from memory as 32-bit RGBA; if channels is non-null,
+//! images that are marked as RGB in the header are decoded as 24-bit RGB
+//! instead, and the number of channels is stored there
+//! \returns pointer to the image, allocated from the buffer pool, to be
+//!          freed by the caller with BufferPool::release(); or nullptr on failure
+uint8_t* decode(const void* data, size_t size, int &width, int &height, int* channels=nullptr);
+
+//! load a QOI image file (see decode() for details)
+uint8_t* load(const char* filename, int &width, int &height, int* channels=nullptr);
+
+//! save a 32-bit (8-bit per channel) RGBA image as a QOI file; large images
+//! are split into chunks that are encoded in parallel, but the result is
+//! still a standard QOI file that any decoder can read
+//! \param threads  maximum number of threads to use (0 = all threads of the current pool)
+//! \returns true on success, false on failure
+bool save(const char* filename, const uint8_t* data, int width, int height, int threads=0);
+
+///////////////////////////////////////////////////////////////////////////////
+
+}  // namespace QOIUtil
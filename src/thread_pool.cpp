@@ -0,0 +1,246 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+#include <cstdio>
+
+#include <algorithm>
+
+#include "thread_pool.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+static ThreadPool* currentPool = nullptr;
+
+// worker identity of the calling thread (-1 = not a worker thread)
+static thread_local const ThreadPool* workerPool = nullptr;
+static thread_local int workerIndex = -1;
+
+ThreadPool* ThreadPool::current() {
+    return currentPool;
+}
+
+void ThreadPool::makeCurrent(ThreadPool* pool) {
+    currentPool = pool;
+}
+
+int ThreadPool::defaultThreadCount() {
+    return std::max(1, int(std::thread::hardware_concurrency()));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+ThreadPool::ThreadPool(int threads) : m_queued(0), m_nextQueue(0) {
+    start(((threads > 0) ? threads : defaultThreadCount()) - 1);
+}
+
+ThreadPool::~ThreadPool() {
+    stop();
+    if (currentPool == this) { currentPool = nullptr; }
+}
+
+void ThreadPool::setThreadCount(int threads) {
+    if (threads <= 0) { threads = defaultThreadCount(); }
+    if (threads == threadCount()) { return; }
+    stop();
+    start(threads - 1);
+}
+
+void ThreadPool::start(int workers) {
+    m_quit = false;
+    for (int i = 0;  i < workers;  ++i) {
+        m_workers.emplace_back(new Worker);
+    }
+    for (int i = 0;  i < workers;  ++i) {
+        m_workers[size_t(i)]->thread = std::thread(&ThreadPool::workerMain, this, i);
+    }
+    #ifndef NDEBUG
+        fprintf(stderr, "thread pool: started %d worker thread(s)\n", workers);
+    #endif
+}
+
+void ThreadPool::stop() {
+    // workers only quit when all queued tasks are done
+    {
+        std::lock_guard<std::mutex> lock(m_sleepLock);
+        m_quit = true;
+    }
+    m_wake.notify_all();
+    for (auto& w : m_workers) {
+        if (w->thread.joinable()) { w->thread.join(); }
+    }
+    m_workers.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void ThreadPool::submit(Task task) {
+    if (m_workers.empty()) { task(); return; }
+
+    // workers push into their own queue; other threads distribute
+    // their tasks over all queues
+    int index = (workerPool == this) ? workerIndex : int(m_nextQueue++ % unsigned(m_workers.size()));
+    Worker& w = *m_workers[size_t(index)];
+    {
+        std::lock_guard<std::mutex> lock(w.lock);
+        w.tasks.push_back(std::move(task));
+        ++m_queued;
+    }
+    // taking the lock makes sure that no worker is between checking
+    // m_queued and going to sleep, so the notification can't get lost
+    { std::lock_guard<std::mutex> lock(m_sleepLock); }
+    m_wake.notify_one();
+    m_waiters.notify_all();
+}
+
+bool ThreadPool::popTask(int ownIndex, Task& task) {
+    if (!m_queued) { return false; }
+    int count = int(m_workers.size());
+
+    // newest task of our own queue first
+    if (ownIndex >= 0) {
+        Worker& w = *m_workers[size_t(ownIndex)];
+        std::lock_guard<std::mutex> lock(w.lock);
+        if (!w.tasks.empty()) {
+            task = std::move(w.tasks.back());
+            w.tasks.pop_back();
+            --m_queued;
+            return true;
+        }
+    }
+
+    // otherwise, steal the oldest task of another queue
+    int start = (ownIndex >= 0) ? (ownIndex + 1) : 0;
+    for (int i = 0;  i < count;  ++i) {
+        int victim = (start + i) % count;
+        if (victim == ownIndex) { continue; }
+        Worker& w = *m_workers[size_t(victim)];
+        std::lock_guard<std::mutex> lock(w.lock);
+        if (!w.tasks.empty()) {
+            task = std::move(w.tasks.front());
+            w.tasks.pop_front();
+            --m_queued;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::waitForWork(const std::function<bool()>& done) {
+    std::unique_lock<std::mutex> lock(m_sleepLock);
+    m_waiters.wait(lock, [this, &done] { return done() || (m_queued > 0); });
+}
+
+void ThreadPool::notifyWaiters() {
+    // same as in submit(): the lock makes sure that the notification
+    // doesn't fall between a waiter's check and its sleep
+    { std::lock_guard<std::mutex> lock(m_sleepLock); }
+    m_waiters.notify_all();
+}
+
+bool ThreadPool::runOne() {
+    Task task;
+    if (!popTask((workerPool == this) ? workerIndex : -1, task)) { return false; }
+    task();
+    return true;
+}
+
+void ThreadPool::workerMain(int index) {
+    workerPool = this;
+    workerIndex = index;
+    for (;;) {
+        Task task;
+        if (popTask(index, task)) {
+            task();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_sleepLock);
+        m_wake.wait(lock, [this] { return m_quit || (m_queued > 0); });
+        if (m_quit && !m_queued) { break; }
+    }
+    workerPool = nullptr;
+    workerIndex = -1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void ThreadPool::parallelFor(int begin, int end, int grain, const RangeFunc& body) {
+    if (begin >= end) { return; }
+    int count = end - begin;
+    if (grain <= 0) {
+        // a few sub-ranges per thread, so that stealing can balance the load
+        grain = std::max(1, count / (threadCount() * 4));
+    }
+    if ((grain >= count) || m_workers.empty()) { body(begin, end); return; }
+
+    // queue all but the first sub-range, which is done in this thread
+    TaskGroup group(this);
+    for (int from = begin + grain;  from < end;  from += grain) {
+        int to = std::min(end, from + grain);
+        group.run([&body, from, to] { body(from, to); });
+    }
+    body(begin, begin + grain);
+    group.wait();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void TaskGroup::run(ThreadPool::Task task) {
+    if (!m_pool) { task(); return; }
+    ++m_open;
+    std::atomic<int>* open = &m_open;
+    ThreadPool* pool = m_pool;
+    m_pool->submit([task, open, pool] {
+        task();
+        // the group may be gone as soon as the counter reaches zero,
+        // so only the pool may be touched afterwards
+        if (--(*open) == 0) { pool->notifyWaiters(); }
+    });
+}
+
+void TaskGroup::wait() {
+    while (m_open > 0) {
+        if (!m_pool->runOne()) {
+            m_pool->waitForWork([this] { return m_open <= 0; });
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+int TaskGraph::add(ThreadPool::Task task, std::initializer_list<int> dependencies) {
+    return add(std::move(task), std::vector<int>(dependencies));
+}
+
+int TaskGraph::add(ThreadPool::Task task, const std::vector<int>& dependencies) {
+    int index = int(m_nodes.size());
+    m_nodes.emplace_back(new Node);
+    Node& node = *m_nodes.back();
+    node.task = std::move(task);
+    for (int dep : dependencies) {
+        if ((dep < 0) || (dep >= index)) { continue; }
+        m_nodes[size_t(dep)]->successors.push_back(index);
+        ++node.dependencies;
+    }
+    return index;
+}
+
+void TaskGraph::runNode(TaskGroup& group, int index) {
+    group.run([this, &group, index] {
+        Node& node = *m_nodes[size_t(index)];
+        if (node.task) { node.task(); }
+        for (int succ : node.successors) {
+            if (--m_nodes[size_t(succ)]->remaining == 0) { runNode(group, succ); }
+        }
+    });
+}
+
+void TaskGraph::run(ThreadPool* pool) {
+    for (auto& node : m_nodes) {
+        node->remaining = node->dependencies;
+    }
+    TaskGroup group(pool);
+    for (int i = 0;  i < int(m_nodes.size());  ++i) {
+        if (!m_nodes[size_t(i)]->dependencies) { runNode(group, i); }
+    }
+    group.wait();
+}
@@ -0,0 +1,140 @@
+// SPDX-FileCopyrightText: 2021 Martin J. Fiedler <keyj@emphy.de>
+// SPDX-License-Identifier: MIT
+
+// Work-stealing task scheduler for CPU-side work (image decoding, encoding
+// and resizing, pattern generation, directory scans). Every worker thread
+// has its own task queue: new tasks are pushed to the back of the current
+// worker's queue and taken from there again (LIFO, for cache locality),
+// while idle workers steal the oldest tasks from the front of the others.
+// Threads that wait for tasks to finish run queued tasks in the meantime,
+// so nested parallelism (e.g. a parallel encoder inside a task) can't
+// deadlock; if there's nothing to run, they sleep until there is, or until
+// the tasks they wait for are done.
+
+#pragma once
+
+#include <cstddef>
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <initializer_list>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+class ThreadPool {
+    friend class TaskGroup;
+public:
+    typedef std::function<void()> Task;
+    typedef std::function<void(int begin, int end)> RangeFunc;
+
+private:
+    struct Worker {
+        std::mutex lock;
+        std::deque<Task> tasks;
+        std::thread thread;
+    };
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::mutex m_sleepLock;
+    std::condition_variable m_wake;
+    std::condition_variable m_waiters;  //!< threads waiting in TaskGroup::wait()
+    std::atomic<int> m_queued;
+    std::atomic<unsigned> m_nextQueue;
+    bool m_quit = false;
+
+    void start(int workers);
+    void stop();
+    void workerMain(int index);
+    bool popTask(int ownIndex, Task& task);
+    //! sleep until tasks are queued or done() returns true
+    void waitForWork(const std::function<bool()>& done);
+    //! wake up threads in waitForWork() to check their condition again
+    void notifyWaiters();
+
+public:
+    //! \param threads  total number of threads, including the one(s)
+    //!                 submitting tasks (0 = number of CPU cores)
+    explicit ThreadPool(int threads=0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+
+    //! change the number of threads; must not be called while tasks are running
+    void setThreadCount(int threads);
+    inline int threadCount() const { return int(m_workers.size()) + 1; }
+    static int defaultThreadCount();
+
+    //! queue a task for asynchronous execution
+    void submit(Task task);
+    //! run one queued task in the calling thread, if there is one
+    //! \returns true if a task has been run
+    bool runOne();
+
+    //! run body(from, to) for consecutive sub-ranges of [begin, end) with
+    //! (at most) 'grain' items each, and wait until all are done;
+    //! grain = 0 chooses the sub-range size automatically
+    void parallelFor(int begin, int end, int grain, const RangeFunc& body);
+
+    //! pool used by library code that has no pool passed to it
+    //! (null = everything runs serially in the calling thread)
+    static ThreadPool* current();
+    static void makeCurrent(ThreadPool* pool);
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+//! set of tasks that can be waited for; without a pool, tasks are run
+//! immediately in the calling thread
+class TaskGroup {
+    ThreadPool* m_pool;
+    std::atomic<int> m_open;
+public:
+    explicit TaskGroup(ThreadPool* pool) : m_pool(pool), m_open(0) {}
+    ~TaskGroup() { wait(); }
+    TaskGroup(const TaskGroup&) = delete;
+
+    void run(ThreadPool::Task task);
+    //! wait until all tasks of the group have finished (running other
+    //! queued tasks in the meantime, and sleeping if there are none)
+    void wait();
+};
+
+//! tasks with dependencies; each task is started as soon as all tasks it
+//! depends on have finished
+class TaskGraph {
+    struct Node {
+        ThreadPool::Task task;
+        std::vector<int> successors;
+        int dependencies = 0;
+        std::atomic<int> remaining;
+        Node() : remaining(0) {}
+    };
+    std::vector<std::unique_ptr<Node>> m_nodes;
+    void runNode(TaskGroup& group, int index);
+public:
+    //! add a task that depends on previously added ones
+    //! \returns the task's index, to be used in later add() calls
+    int add(ThreadPool::Task task, std::initializer_list<int> dependencies={});
+    int add(ThreadPool::Task task, const std::vector<int>& dependencies);
+    //! run all tasks and wait until all of them have finished;
+    //! can be run multiple times
+    void run(ThreadPool* pool);
+    inline int taskCount() const { return int(m_nodes.size()); }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+//! parallel-for on the current pool (or serially if there is none)
+inline void parallelFor(int begin, int end, int grain, const ThreadPool::RangeFunc& body) {
+    ThreadPool* pool = ThreadPool::current();
+    if (pool) { pool->parallelFor(begin, end, grain, body); }
+    else if (begin < end) { body(begin, end); }
+}
+
+//! number of threads of the current pool (1 if there is none)
+inline int currentThreadCount() {
+    ThreadPool* pool = ThreadPool::current();
+    return pool ? pool->threadCount() : 1;
+}
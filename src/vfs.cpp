@@ -12,6 +12,7 @@
 
 #include "string_util.h"
 #include "file_util.h"
+#include "thread_pool.h"
 
 #include "vfs.h"
 
@@ -62,29 +63,41 @@ void TemporaryRoot::begin(const char* filename) {
 
 ///////////////////////////////////////////////////////////////////////////////
 
+static void scanDir(DirList& list, const char* root, const char* relRoot) {
+    char* absRoot = StringUtil::pathJoin(root, relRoot);
+    FileUtil::Directory d(absRoot);
+    while (d.nextNonDot()) {
+        list.items.emplace_back(root, relRoot, d.currentItemName(), d.currentItemIsDir());
+    }
+    #ifndef NDEBUG
+        fprintf(stderr, "scanned directory '%s' (%d items)\n", absRoot, int(list.items.size()));
+    #endif
+    std::sort(list.items.begin(), list.items.end());
+    ::free(absRoot);
+}
+
 DirList getDirList(const char* relRoot) {
-    DirList result;
-    for (const auto& root : roots) {
-        char* absRoot = StringUtil::pathJoin(root.c_str(), relRoot);
-        #ifndef NDEBUG
-            fprintf(stderr, "scanning directory '%s' ", absRoot);
-        #endif
-
-        DirList newList;
-        FileUtil::Directory d(absRoot);
-        while (d.nextNonDot()) {
-            newList.items.emplace_back(root.c_str(), relRoot, d.currentItemName(), d.currentItemIsDir());
+    // all roots are scanned in parallel, and the lists are merged pairwise
+    // as soon as both are available; merging prefers the newer file, or
+    // the earlier root if both are equally new, so the order of merges
+    // doesn't matter as long as the lists stay in root order
+    std::vector<DirList> lists(roots.size());
+    std::vector<int> tasks;
+    TaskGraph graph;
+    for (size_t i = 0;  i < roots.size();  ++i) {
+        DirList* list = &lists[i];
+        const char* root = roots[i].c_str();
+        tasks.push_back(graph.add([list, root, relRoot] { scanDir(*list, root, relRoot); }));
+    }
+    for (size_t step = 1;  step < lists.size();  step <<= 1) {
+        for (size_t i = 0;  (i + step) < lists.size();  i += 2 * step) {
+            DirList* dest = &lists[i];
+            DirList* src = &lists[i + step];
+            tasks[i] = graph.add([dest, src] { dest->merge(*src); }, { tasks[i], tasks[i + step] });
         }
-        #ifndef NDEBUG
-            fprintf(stderr, "(%d items)\n", int(newList.items.size()));
-        #endif
-
-        std::sort(newList.items.begin(), newList.items.end());
-        result.merge(newList);
-
-        ::free(absRoot);
     }
-    return result;
+    graph.run(ThreadPool::current());
+    return lists.empty() ? DirList() : std::move(lists[0]);
 }
 
 const DirList& getCachedDirList(const char* relRoot) {